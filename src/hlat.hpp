@@ -15,8 +15,11 @@
 #include <string>
 #include <string_view>
 #include <vector>
-#include <regex>
+#include <span>
+#include <cstdint>
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
 #include <algorithm>
 #include <cctype>
 #include <optional>
@@ -54,10 +57,13 @@ namespace hlat {
     };
 
     /// Represents a single lexed unit from the XPath input
+    ///
+    /// `value` points into the lexer's input, so tokens are valid only while that input is
+    /// alive and unchanged. The parser copies what it keeps into XLocators.
     struct Token {
-        TokenType   type;     ///< Category of this token
-        std::string value;    ///< Exact text matched (e.g., "book", "@id", "and")
-        size_t      position; ///< Zero-based index in input where token began
+        TokenType        type;     ///< Category of this token
+        std::string_view value;    ///< Exact text matched, a view into the lexer input (e.g., "book", "@id")
+        size_t           position; ///< Zero-based index in input where token began
     };
 
     // -----------------------------------------------------------------------------
@@ -69,16 +75,22 @@ namespace hlat {
         std::string name;  ///< Attribute name
         std::string value; ///< Attribute value
         std::string op;    ///< Comparison operator
+
+        bool operator==(const AttributePredicate&) const = default;
     };
 
     /// Represents a position-based predicate (e.g., [1], [last()])
     struct PositionPredicate {
         int position; ///< One-based position index
+
+        bool operator==(const PositionPredicate&) const = default;
     };
 
     /// Represents a complex predicate combining multiple conditions
     struct ComplexPredicate {
         std::vector<std::variant<AttributePredicate, PositionPredicate>> conditions;
+
+        bool operator==(const ComplexPredicate&) const = default;
     };
 
     /// Represents a single step in an XPath expression
@@ -87,6 +99,13 @@ namespace hlat {
         std::string                     tag;         ///< Node test: tag name or "*"
         std::optional<ComplexPredicate> predicate;   ///< Optional predicate conditions
         bool                            is_absolute; ///< True if step began with leading '/'
+
+        /// True for the implicit `descendant-or-self::*` step a '//' separator expands to
+        bool isDoubleSlash() const {
+            return axis == "descendant-or-self" && tag == "*" && !predicate;
+        }
+
+        bool operator==(const XLocator&) const = default;
     };
 
     // -----------------------------------------------------------------------------
@@ -111,25 +130,75 @@ namespace hlat {
             return str.find(needle) != std::string::npos;
         }
 
-        /// Converts a string to a canonical form suitable for UIDs
+        /// Appends the canonical form of `in` to the canonical string `out`, joined by a single '_'
+        ///
+        /// Runs of non-alphanumeric characters collapse to one '_' and are dropped at either end,
+        /// so appending piece by piece equals canonicalizing the '_'-joined whole. Linear in `in`.
+        inline void appendCanonical(std::string& out, std::string_view in) {
+            bool separate = !out.empty();
+            for (char c : in) {
+                if (!std::isalnum(static_cast<unsigned char>(c))) { separate = !out.empty(); continue; }
+                if (separate) { out += '_'; separate = false; }
+                out += c;
+            }
+        }
+
+        /// Converts a string to a canonical form suitable for UIDs (single pass, linear)
         inline std::string canonicalize(std::string_view in) {
             std::string out; out.reserve(in.size());
-            for (char c : in) out += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
-            static const std::regex collapse{ R"(_+)" };
-            out = std::regex_replace(out, collapse, "_");
-            if (!out.empty() && out.front() == '_') out.erase(0, 1);
-            if (!out.empty() && out.back() == '_') out.pop_back();
+            appendCanonical(out, in);
             return out;
         }
+
+        /// Mixes a value hash into a running seed (boost::hash_combine scheme)
+        inline size_t hashCombine(size_t seed, size_t value) {
+            return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+        }
+
+        /// Computes a structural hash of a predicate condition list
+        inline size_t structuralHash(const ComplexPredicate& pred) {
+            size_t h = pred.conditions.size();
+            for (auto const& cond : pred.conditions) {
+                if (std::holds_alternative<AttributePredicate>(cond)) {
+                    auto const& a = std::get<AttributePredicate>(cond);
+                    h = hashCombine(h, std::hash<std::string>{}(a.name));
+                    h = hashCombine(h, std::hash<std::string>{}(a.op));
+                    h = hashCombine(h, std::hash<std::string>{}(a.value));
+                }
+                else {
+                    h = hashCombine(h, std::hash<int>{}(std::get<PositionPredicate>(cond).position));
+                }
+            }
+            return h;
+        }
+
+        /// Computes a structural hash of a single XPath step
+        inline size_t structuralHash(const XLocator& step) {
+            size_t h = std::hash<std::string>{}(step.axis);
+            h = hashCombine(h, std::hash<std::string>{}(step.tag));
+            h = hashCombine(h, step.is_absolute);
+            h = hashCombine(h, step.predicate ? structuralHash(*step.predicate) : 0);
+            return h;
+        }
+
+        /// Computes a structural hash of a whole parsed selector
+        inline size_t structuralHash(const std::vector<XLocator>& steps) {
+            size_t h = steps.size();
+            for (auto const& step : steps) h = hashCombine(h, structuralHash(step));
+            return h;
+        }
     } // namespace util
 
     // -----------------------------------------------------------------------------
     // Heuristic Qt Widget Classifier
     // -----------------------------------------------------------------------------
 
-    /// Classifies HTML-like tags into Qt widget types
+    /// Classifies HTML-like tags into Qt widget types (linear in the tag length)
     class HeuristicQtClassifier {
     public:
+        /// Bumped whenever a tag maps to a different widget type; keys persistent caches
+        static constexpr uint32_t Version = 1;
+
         /// Maps a tag name to its corresponding Qt widget type
         std::string operator()(std::string_view tag_sv) const {
             std::string tag(tag_sv);
@@ -163,18 +232,56 @@ namespace hlat {
         }
     };
 
+    // -----------------------------------------------------------------------------
+    // Input Limits
+    // -----------------------------------------------------------------------------
+
+    /// Hard limits checked while lexing and parsing; exceeding one throws immediately
+    struct XPathLimits {
+        size_t max_length{ size_t{ 1 } << 20 };         ///< Maximum selector length in bytes
+        size_t max_literal_length{ size_t{ 64 } << 10 }; ///< Maximum quoted literal length in bytes
+        size_t max_steps{ 1024 };                      ///< Maximum location steps per selector
+        size_t max_conditions{ 256 };                  ///< Maximum conditions per predicate
+
+        /// Limits that never trigger
+        static constexpr XPathLimits unlimited() {
+            return { SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX };
+        }
+    };
+
     // -----------------------------------------------------------------------------
     // XPath Lexer
     // -----------------------------------------------------------------------------
 
     /// Tokenizes XPath expressions into a sequence of tokens
+    ///
+    /// Single forward pass: linear in the input length, one token per lexeme. The lexer
+    /// does not copy its input, and tokens view it (see Token): the input must outlive them.
     class XPathLexer {
     public:
-        explicit XPathLexer(std::string_view input) : input_(input) {}
+        explicit XPathLexer(std::string_view input, XPathLimits limits = {})
+            : input_(input), limits_(limits) {}
+
+        explicit XPathLexer(const char* input, XPathLimits limits = {})
+            : XPathLexer(std::string_view(input), limits) {}
+
+        /// A temporary string would die before the tokens viewing it
+        explicit XPathLexer(std::string&&, XPathLimits = {}) = delete;
 
         /// Tokenizes the input XPath expression
         std::vector<Token> tokenize() {
             std::vector<Token> tokens;
+            tokens.reserve(input_.length() / 2 + 2);
+            tokenize(tokens);
+            return tokens;
+        }
+
+        /// Tokenizes into `tokens`, reusing its capacity (allocation-free once warm)
+        void tokenize(std::vector<Token>& tokens) {
+            tokens.clear();
+            if (input_.length() > limits_.max_length)
+                throw std::runtime_error("Selector length " + std::to_string(input_.length())
+                    + " exceeds limit of " + std::to_string(limits_.max_length) + " bytes");
             while (pos_ < input_.length()) {
                 if (std::isspace(input_[pos_])) { ++pos_; continue; }
 
@@ -199,23 +306,22 @@ namespace hlat {
                     while (pos_ < input_.length() && input_[pos_] != q) {
                         if (input_[pos_] == '\\' && pos_ + 1 < input_.length()) ++pos_;
                         ++pos_;
+                        if (pos_ - start > limits_.max_literal_length)
+                            throw std::runtime_error("String literal at pos " + std::to_string(start)
+                                + " exceeds limit of " + std::to_string(limits_.max_literal_length) + " bytes");
                     }
                     if (pos_ >= input_.length())
                         throw std::runtime_error("Unterminated string literal");
-                    tokens.push_back({ TokenType::Literal,
-                        std::string(input_.substr(start, pos_ - start)),
-                        start });
+                    tokens.push_back({ TokenType::Literal, input_.substr(start, pos_ - start), start });
                     ++pos_;
                     continue;
                 }
 
                 case '=': case '!': case '>': case '<':
                 {
-                    std::string op(1, c); ++pos_;
-                    if (pos_ < input_.length() && input_[pos_] == '=') {
-                        op += '='; ++pos_;
-                    }
-                    tokens.push_back({ TokenType::Operator, op, pos_ - op.length() });
+                    size_t start = pos_++;
+                    if (pos_ < input_.length() && input_[pos_] == '=') ++pos_;
+                    tokens.push_back({ TokenType::Operator, input_.substr(start, pos_ - start), start });
                     continue;
                 }
 
@@ -237,9 +343,7 @@ namespace hlat {
                     if (pos_ + 1 < input_.length() &&
                         input_[pos_] == ':' && input_[pos_ + 1] == ':')
                     {
-                        tokens.push_back({ TokenType::Axis,
-                            std::string(input_.substr(start, pos_ - start)),
-                            start });
+                        tokens.push_back({ TokenType::Axis, input_.substr(start, pos_ - start), start });
                         pos_ += 2;
                         continue;
                     }
@@ -254,17 +358,15 @@ namespace hlat {
                 {
                     ++pos_;
                 }
-                tokens.push_back({ TokenType::Tag,
-                    std::string(input_.substr(start, pos_ - start)),
-                    start });
+                tokens.push_back({ TokenType::Tag, input_.substr(start, pos_ - start), start });
             }
 
             tokens.push_back({ TokenType::End, "", pos_ });
-            return tokens;
         }
 
     private:
         std::string_view input_;
+        XPathLimits      limits_;
         size_t           pos_{ 0 };
     };
 
@@ -273,22 +375,30 @@ namespace hlat {
     // -----------------------------------------------------------------------------
 
     /// Parses tokenized XPath expressions into a sequence of locators
+    ///
+    /// Recursive descent with bounded lookahead: linear in the number of tokens.
     class XPathParser {
     public:
-        explicit XPathParser(const std::vector<Token>& tokens)
-            : tokens_(tokens) {}
+        explicit XPathParser(const std::vector<Token>& tokens, XPathLimits limits = {})
+            : tokens_(tokens), limits_(limits) {}
 
         /// Parses the token stream into a sequence of XPath locators
         std::vector<XLocator> parse() {
             std::vector<XLocator> steps;
+            // One step per '/', two per '//' (the descendant-or-self step, then the named one)
+            size_t slashes = 0;
+            for (Token const& t : tokens_)
+                if (t.type == TokenType::Slash) slashes += t.value == "//" ? 2 : 1;
+            steps.reserve(slashes + 1);
             while (!isAtEnd()) {
+                if (steps.size() >= limits_.max_steps)
+                    throw std::runtime_error("Selector exceeds limit of "
+                        + std::to_string(limits_.max_steps) + " steps at pos " + std::to_string(current().position));
                 bool is_abs = false;
                 if (match(TokenType::Slash)) {
                     is_abs = true;
-                    if (match(TokenType::Slash)) {
+                    if (previous().value == "//" || match(TokenType::Slash))
                         steps.push_back({ "descendant-or-self", "*", std::nullopt, true });
-                        continue;
-                    }
                 }
                 steps.push_back(parseStep(is_abs));
             }
@@ -299,10 +409,10 @@ namespace hlat {
         /// Parses a single XPath step
         XLocator parseStep(bool is_abs) {
             XLocator step; step.is_absolute = is_abs;
-            step.axis = match(TokenType::Axis) ? previous().value : "child";
+            step.axis = match(TokenType::Axis) ? std::string(previous().value) : "child";
 
             if (match(TokenType::Wildcard)) step.tag = "*";
-            else if (match(TokenType::Tag)) step.tag = previous().value;
+            else if (match(TokenType::Tag)) step.tag = std::string(previous().value);
             else throw std::runtime_error("Expected tag or '*' at pos "
                 + std::to_string(current().position));
 
@@ -314,7 +424,7 @@ namespace hlat {
             }
 
             if (match(TokenType::Namespace))
-                step.tag = previous().value + ":" + step.tag;
+                step.tag = std::string(previous().value) + ":" + step.tag;
 
             return step;
         }
@@ -325,6 +435,9 @@ namespace hlat {
             while (true) {
                 if (check(TokenType::Predicate) && current().value == "]")
                     break;
+                if (pred.conditions.size() >= limits_.max_conditions)
+                    throw std::runtime_error("Predicate exceeds limit of "
+                        + std::to_string(limits_.max_conditions) + " conditions at pos " + std::to_string(current().position));
 
                 // Handle unprefixed comparisons (e.g., price>35)
                 if (check(TokenType::Tag)
@@ -332,23 +445,23 @@ namespace hlat {
                     && (peek(2).type == TokenType::Literal ||
                         peek(2).type == TokenType::Tag))
                 {
-                    std::string name = consume(TokenType::Tag).value;
-                    std::string op = consume(TokenType::Operator).value;
+                    std::string name(consume(TokenType::Tag).value);
+                    std::string op(consume(TokenType::Operator).value);
                     std::string raw;
                     if (match(TokenType::Literal))
                         raw = previous().value;
                     else
                         raw = consume(TokenType::Tag).value;
 
-                    pred.conditions.emplace_back(AttributePredicate{ name, raw, op });
+                    pred.conditions.emplace_back(AttributePredicate{ std::move(name), std::move(raw), std::move(op) });
                     continue;
                 }
 
                 // Handle attribute tests (@name='value')
                 if (match(TokenType::Attribute)) {
-                    std::string name = consume(TokenType::Tag).value;
-                    std::string op = consume(TokenType::Operator).value;
-                    std::string val = consume(TokenType::Literal).value;
+                    std::string name(consume(TokenType::Tag).value);
+                    std::string op(consume(TokenType::Operator).value);
+                    std::string_view val = consume(TokenType::Literal).value;
                     std::string clean; clean.reserve(val.size());
                     for (size_t i = 0; i < val.size(); ++i) {
                         if (val[i] == '\\' && i + 1 < val.size()) {
@@ -356,11 +469,11 @@ namespace hlat {
                         }
                         else clean += val[i];
                     }
-                    pred.conditions.emplace_back(AttributePredicate{ name, clean, op });
+                    pred.conditions.emplace_back(AttributePredicate{ std::move(name), std::move(clean), std::move(op) });
                 }
                 // Handle position predicates ([1], [last()])
-                else if (std::isdigit(current().value[0])) {
-                    int idx = std::stoi(consume(TokenType::Tag).value);
+                else if (!current().value.empty() && std::isdigit(static_cast<unsigned char>(current().value[0]))) {
+                    int idx = std::stoi(std::string(consume(TokenType::Tag).value));
                     pred.conditions.emplace_back(PositionPredicate{ idx });
                 }
                 // Handle logical operators (and, or)
@@ -388,6 +501,7 @@ namespace hlat {
         bool isAtEnd() const { return current().type == TokenType::End; }
 
         const std::vector<Token>& tokens_;
+        XPathLimits               limits_;
         size_t                    pos_{ 0 };
     };
 
@@ -401,19 +515,88 @@ namespace hlat {
         json        meta;      ///< JSON metadata about the widget
         std::string container; ///< UID of the containing widget
 
+        /// Bumped whenever conversion or finalize() output changes; keys persistent caches
+        static constexpr uint32_t Version = 1;
+
         /// Formats the locator as a string
         std::string finalize() const {
-            std::string res = uid + " = " + meta.dump(4);
-            if (!container.empty()) {
-                constexpr std::string_view trailer{ "\n}" };
-                if (res.ends_with(trailer)) {
-                    res.erase(res.size() - trailer.size());
-                }
-                res += ",\n    \"container\": " + container + "\n}";
-            }
-            res += "\n";
+            std::string res;
+            finalize(res);
             return res;
         }
+
+        /// Appends the formatted locator to `out` (linear in the declaration size)
+        void finalize(std::string& out) const {
+            constexpr std::string_view trailer{ "\n}" };
+            const std::string body = meta.dump(4);
+            out += uid;
+            out += " = ";
+            if (!container.empty() && body.ends_with(trailer)) {
+                out.append(body, 0, body.size() - trailer.size());
+                out += ",\n    \"container\": ";
+                out += container;
+                out += trailer;
+            }
+            else out += body;
+            out += '\n';
+        }
+    };
+
+    /// Strings stored back to back: string `i` is chars[offsets[i], offsets[i + 1])
+    struct PackedStrings {
+        std::string           chars;
+        std::vector<uint32_t> offsets{ 0 };
+
+        size_t size() const { return offsets.size() - 1; }
+
+        std::string_view operator[](size_t i) const {
+            return std::string_view(chars).substr(offsets[i], offsets[i + 1] - offsets[i]);
+        }
+
+        /// Appends a string and returns its index
+        uint32_t push(std::string_view s) {
+            chars += s;
+            offsets.push_back(static_cast<uint32_t>(chars.size()));
+            return static_cast<uint32_t>(size() - 1);
+        }
+    };
+
+    /// A batch of Qt locators stored column by column
+    ///
+    /// Holds the same data as the QtLocator rows of a batch, one row per locator: selector
+    /// after selector, each one's locators parents first. Scans that only read archetypes
+    /// or parents touch only those 32-bit columns. Archetypes and attribute keys and values
+    /// are pooled: each distinct string is stored once and referenced by index.
+    struct QtLocatorColumns {
+        /// `parents` value of a selector's first locator
+        static constexpr uint32_t NoParent = UINT32_MAX;
+
+        PackedStrings         uids;             ///< Canonical UID per row
+        std::vector<uint32_t> archetypes;       ///< Index into archetype_names per row
+        std::vector<uint32_t> parents;          ///< Row of the containing widget, or NoParent
+        std::vector<uint32_t> occurrences;      ///< Position among equal siblings; 1 unless a predicate says otherwise
+        std::vector<uint32_t> attribute_offsets{ 0 }; ///< Row i's attributes are [offsets[i], offsets[i + 1])
+        std::vector<uint32_t> attribute_keys;   ///< Index into key_pool per attribute
+        std::vector<uint32_t> attribute_values; ///< Index into value_pool per attribute
+        std::vector<uint32_t> selector_offsets{ 0 }; ///< Selector j's rows are [offsets[j], offsets[j + 1])
+        PackedStrings         archetype_names;  ///< Distinct archetypes
+        PackedStrings         key_pool;         ///< Distinct attribute names
+        PackedStrings         value_pool;       ///< Distinct attribute values
+
+        /// Number of rows
+        size_t size() const { return archetypes.size(); }
+
+        /// The row as a QtLocator, equal to what XPathConverter::convert() returns for it
+        QtLocator locator(size_t row) const {
+            json meta;
+            meta["archetype"] = archetype_names[archetypes[row]];
+            for (uint32_t a = attribute_offsets[row]; a < attribute_offsets[row + 1]; ++a)
+                meta[std::string(key_pool[attribute_keys[a]])] = value_pool[attribute_values[a]];
+            if (occurrences[row] > 1) meta["occurrence"] = occurrences[row];
+            meta["visible"] = 1;
+            return QtLocator{ std::string(uids[row]), std::move(meta),
+                parents[row] == NoParent ? std::string() : std::string(uids[parents[row]]) };
+        }
     };
 
     // -----------------------------------------------------------------------------
@@ -421,6 +604,10 @@ namespace hlat {
     // -----------------------------------------------------------------------------
 
     /// Converts XPath locators to Qt widget descriptors
+    ///
+    /// '//' steps only matter for evaluation and declare nothing; their children attach to
+    /// the enclosing widget. Linear in the size of the produced locators. Every UID embeds its parent UID, so a path
+    /// of depth d yields O(d^2) output bytes by construction; no stage adds work beyond that.
     template<typename Classifier = HeuristicQtClassifier>
     class XPathConverter {
     public:
@@ -434,62 +621,285 @@ namespace hlat {
             std::string parent;
 
             for (auto const& step : steps_) {
-                std::string arch = classifier_(step.tag);
-                std::string uid = generateUid(parent, step, arch);
-
-                json meta;
-                meta["archetype"] = arch;
-                if (step.predicate) {
-                    for (auto const& cond : step.predicate->conditions) {
-                        if (std::holds_alternative<AttributePredicate>(cond)) {
-                            auto const& a = std::get<AttributePredicate>(cond);
-                            meta[a.name] = a.value;
-                        }
-                        else {
-                            auto const& p = std::get<PositionPredicate>(cond);
-                            if (p.position > 1) meta["occurrence"] = p.position;
-                        }
+                if (step.isDoubleSlash()) continue;
+                out.push_back(convertStep(step, std::move(parent)));
+                parent = out.back().uid;
+            }
+            return out;
+        }
+
+        /// Converts a single step given the UID of its containing widget
+        QtLocator convertStep(XLocator const& step, std::string parent) const {
+            return convertStep(step, std::move(parent), classifier_);
+        }
+
+        /// Converts a single step with the classifier `classify`; needs no converter instance
+        static QtLocator convertStep(XLocator const& step, std::string parent, const Classifier& classify) {
+            std::string arch = classify(step.tag);
+            std::string uid = generateUid(parent, step, arch);
+
+            json meta;
+            meta["archetype"] = arch;
+            if (step.predicate) {
+                for (auto const& cond : step.predicate->conditions) {
+                    if (std::holds_alternative<AttributePredicate>(cond)) {
+                        auto const& a = std::get<AttributePredicate>(cond);
+                        meta[a.name] = a.value;
+                    }
+                    else {
+                        auto const& p = std::get<PositionPredicate>(cond);
+                        if (p.position > 1) meta["occurrence"] = p.position;
                     }
                 }
-                meta["visible"] = 1;
+            }
+            meta["visible"] = 1;
 
-                out.emplace_back(
-                    std::move(uid),
-                    std::move(meta),
-                    std::move(parent)
-                );
-                parent = out.back().uid;
+            return QtLocator{ std::move(uid), std::move(meta), std::move(parent) };
+        }
+
+        /// Converts a batch of parsed selectors straight into columns
+        ///
+        /// Rows match convert() on each selector in turn. UIDs are built from the parent row's
+        /// UID in one reused buffer, and no per-locator json or string is created.
+        static QtLocatorColumns convert(std::span<const std::vector<XLocator>> batch) {
+            QtLocatorColumns out;
+            Classifier classify{};
+            std::unordered_map<std::string, uint32_t> archetypes, keys, values;
+            std::string uid;
+            auto pooled = [](std::unordered_map<std::string, uint32_t>& index, PackedStrings& pool, std::string_view s) {
+                auto [it, inserted] = index.try_emplace(std::string(s), static_cast<uint32_t>(pool.size()));
+                if (inserted) pool.push(s);
+                return it->second;
+            };
+
+            for (auto const& steps : batch) {
+                uint32_t parent = QtLocatorColumns::NoParent;
+                for (auto const& step : steps) {
+                    if (step.isDoubleSlash()) continue;
+                    const std::string arch = classify(step.tag);
+                    const uint32_t row = static_cast<uint32_t>(out.size());
+
+                    uid.assign(parent == QtLocatorColumns::NoParent ? std::string_view{} : out.uids[parent]);
+                    appendUidParts(uid, step, arch);
+                    out.uids.push(uid);
+
+                    // Same precedence as the json meta: a later "occurrence" attribute hides a position
+                    uint32_t occurrence = 1;
+                    if (step.predicate) {
+                        for (auto const& cond : step.predicate->conditions) {
+                            if (std::holds_alternative<AttributePredicate>(cond)) {
+                                auto const& a = std::get<AttributePredicate>(cond);
+                                out.attribute_keys.push_back(pooled(keys, out.key_pool, a.name));
+                                out.attribute_values.push_back(pooled(values, out.value_pool, a.value));
+                                if (a.name == "occurrence") occurrence = 1;
+                            }
+                            else if (auto p = std::get<PositionPredicate>(cond).position; p > 1)
+                                occurrence = static_cast<uint32_t>(p);
+                        }
+                    }
+                    out.archetypes.push_back(pooled(archetypes, out.archetype_names, arch));
+                    out.parents.push_back(parent);
+                    out.occurrences.push_back(occurrence);
+                    out.attribute_offsets.push_back(static_cast<uint32_t>(out.attribute_keys.size()));
+                    parent = row;
+                }
+                out.selector_offsets.push_back(static_cast<uint32_t>(out.size()));
             }
             return out;
         }
 
     private:
         /// Generates a unique identifier for a widget
-        std::string generateUid(
+        ///
+        /// `parent` is already canonical, so only this step's pieces are canonicalized and
+        /// appended; the cost is the parent copy plus the step's own size.
+        static std::string generateUid(
             const std::string& parent,
             XLocator const& step,
             std::string const& arch
-        ) const {
-            std::string token = (step.tag == "*") ? "any" : step.tag;
-            std::string uid = parent.empty()
-                ? token + "_" + arch
-                : parent + "_" + token + "_" + arch;
+        ) {
+            std::string uid;
+            uid.reserve(parent.size() + step.tag.size() + arch.size() + 2);
+            uid = parent;
+            appendUidParts(uid, step, arch);
+            return uid;
+        }
+
+        /// Appends one step's canonical UID pieces: tag, archetype, then attribute names and values
+        static void appendUidParts(std::string& uid, XLocator const& step, std::string const& arch) {
+            util::appendCanonical(uid, (step.tag == "*") ? std::string_view{ "any" } : std::string_view{ step.tag });
+            util::appendCanonical(uid, arch);
 
             if (step.predicate) {
                 for (auto const& cond : step.predicate->conditions) {
                     if (std::holds_alternative<AttributePredicate>(cond)) {
                         auto const& a = std::get<AttributePredicate>(cond);
-                        uid += "_" + a.name + "_" + a.value;
+                        util::appendCanonical(uid, a.name);
+                        util::appendCanonical(uid, a.value);
                     }
                 }
             }
-            return util::canonicalize(uid);
         }
 
         const std::vector<XLocator>& steps_;
         Classifier classifier_{};
     };
 
+    // -----------------------------------------------------------------------------
+    // Hash-Consed AST Factory
+    // -----------------------------------------------------------------------------
+
+    /// Shares structurally identical steps and selector prefixes across a corpus
+    template<typename Classifier = HeuristicQtClassifier>
+    class XLocatorFactory {
+    public:
+        /// A selector prefix: one interned step hanging off its parent prefix
+        struct PathNode {
+            const XLocator*                  step;      ///< Shared step at the end of this prefix
+            const PathNode*                  parent;    ///< Prefix without the last step (nullptr for roots)
+            size_t                           depth;     ///< Number of steps in this prefix
+            size_t                           hash;      ///< Structural hash of the whole prefix
+            mutable std::optional<QtLocator> converted; ///< Memoized conversion of the last step
+        };
+
+        XLocatorFactory() = default;
+        XLocatorFactory(const XLocatorFactory&) = delete;
+        XLocatorFactory& operator=(const XLocatorFactory&) = delete;
+
+        /// Returns the shared copy of a step, copying it in only on first sight
+        const XLocator* step(const XLocator& s) {
+            auto it = steps_.find(s);
+            return it != steps_.end() ? &*it : &*steps_.insert(s).first;
+        }
+
+        /// Returns the shared copy of a step, moving it in on first sight
+        const XLocator* step(XLocator&& s) {
+            return &*steps_.insert(std::move(s)).first;
+        }
+
+        /// Interns a parsed selector and returns its deepest prefix node
+        const PathNode* path(const std::vector<XLocator>& steps) {
+            const PathNode* node = nullptr;
+            for (auto const& s : steps) node = child(node, step(s));
+            return node;
+        }
+
+        /// Returns the prefix extending `parent` by the shared step `s`
+        const PathNode* child(const PathNode* parent, const XLocator* s) {
+            auto [it, inserted] = index_.try_emplace(EdgeKey{ parent, s }, nullptr);
+            if (inserted) {
+                size_t h = util::hashCombine(parent ? parent->hash : 0, util::structuralHash(*s));
+                it->second = &nodes_.emplace_back(PathNode{ s, parent, parent ? parent->depth + 1 : 1, h, std::nullopt });
+            }
+            return it->second;
+        }
+
+        /// Reconstructs the step sequence of a prefix in source order
+        std::vector<XLocator> steps(const PathNode* node) const {
+            std::vector<XLocator> out(node ? node->depth : 0);
+            for (; node; node = node->parent) out[node->depth - 1] = *node->step;
+            return out;
+        }
+
+        /// Converts a prefix, reusing memoized conversions of shared ancestors
+        std::vector<QtLocator> convert(const PathNode* node) const {
+            std::vector<QtLocator> out;
+            if (node) convertNode(node);
+            for (const PathNode* n = node; n; n = n->parent)
+                if (!n->step->isDoubleSlash()) out.push_back(*n->converted);
+            std::reverse(out.begin(), out.end());
+            return out;
+        }
+
+        /// Returns the memoized conversion of the last step of a prefix
+        const QtLocator& locator(const PathNode* node) const { return convertNode(node); }
+
+        /// Number of distinct steps held by the factory
+        size_t uniqueSteps() const { return steps_.size(); }
+
+        /// Number of distinct selector prefixes held by the factory
+        size_t uniquePaths() const { return nodes_.size(); }
+
+    private:
+        /// Memoizes the conversion of a prefix node and any unconverted ancestors
+        const QtLocator& convertNode(const PathNode* node) const {
+            std::vector<const PathNode*> pending;
+            for (const PathNode* n = node; n && !n->converted; n = n->parent) pending.push_back(n);
+            for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+                const PathNode* n = *it;
+                if (n->step->isDoubleSlash()) { // declares nothing, stands in for its parent
+                    n->converted = n->parent ? *n->parent->converted : QtLocator{};
+                    continue;
+                }
+                std::string parent = n->parent ? n->parent->converted->uid : std::string{};
+                n->converted = XPathConverter<Classifier>::convertStep(*n->step, std::move(parent), classifier_);
+            }
+            return *node->converted;
+        }
+
+        struct StepHash {
+            size_t operator()(const XLocator& s) const { return util::structuralHash(s); }
+        };
+
+        struct EdgeKey {
+            const PathNode* parent;
+            const XLocator* step;
+            bool operator==(const EdgeKey&) const = default;
+        };
+
+        struct EdgeHash {
+            size_t operator()(const EdgeKey& k) const {
+                return util::hashCombine(std::hash<const void*>{}(k.parent), std::hash<const void*>{}(k.step));
+            }
+        };
+
+        std::unordered_set<XLocator, StepHash>                     steps_;
+        std::deque<PathNode>                                       nodes_;
+        std::unordered_map<EdgeKey, const PathNode*, EdgeHash>     index_;
+        Classifier                                                 classifier_{};
+    };
+
+    // -----------------------------------------------------------------------------
+    // Batch Declaration Emitter
+    // -----------------------------------------------------------------------------
+
+    /// Emits a corpus of selectors with each unique container declared exactly once
+    template<typename Classifier = HeuristicQtClassifier>
+    class QtBatchDeclarations {
+    public:
+        using PathNode = typename XLocatorFactory<Classifier>::PathNode;
+
+        explicit QtBatchDeclarations(XLocatorFactory<Classifier>& factory)
+            : factory_(factory) {}
+
+        /// Registers a parsed selector and queues its not yet declared prefixes
+        const PathNode* add(const std::vector<XLocator>& steps) {
+            const PathNode* leaf = factory_.path(steps);
+            size_t first = pending_.size();
+            for (const PathNode* n = leaf; n && declared_.insert(n).second; n = n->parent)
+                if (!n->step->isDoubleSlash()) { pending_.push_back(n); ++declarations_; }
+            std::reverse(pending_.begin() + first, pending_.end());
+            return leaf;
+        }
+
+        /// Emits declarations queued since the previous call, parents before children
+        std::string emit() {
+            std::string out;
+            for (const PathNode* n : pending_) out += factory_.locator(n).finalize();
+            pending_.clear();
+            return out;
+        }
+
+        /// Number of distinct declarations registered so far
+        size_t declarations() const { return declarations_; }
+
+    private:
+        XLocatorFactory<Classifier>&         factory_;
+        std::unordered_set<const PathNode*>  declared_;
+        std::vector<const PathNode*>         pending_;
+        size_t                               declarations_{ 0 };
+    };
+
     // -----------------------------------------------------------------------------
     // Pipeline Function Types
     // -----------------------------------------------------------------------------
@@ -498,6 +908,41 @@ namespace hlat {
     using QtLocatorBuilderFn = std::vector<QtLocator>(*)(const std::vector<XLocator>&);
     using QtLocatorEmitterFn = std::string(*)(std::vector<QtLocator>&);
 
+    // -----------------------------------------------------------------------------
+    // Pipeline Instrumentation
+    // -----------------------------------------------------------------------------
+
+    /// The four stages of the declaration pipeline
+    enum class PipelineStage {
+        Tokenize, ///< XPath text to tokens
+        Parse,    ///< Tokens to XLocator steps
+        Convert,  ///< XLocator steps to QtLocator descriptors
+        Declare   ///< QtLocator descriptors to emitted text
+    };
+
+    /// Number of pipeline stages
+    inline constexpr size_t PipelineStageCount = 4;
+
+    /// Returns the lowercase name of a pipeline stage
+    constexpr std::string_view stageName(PipelineStage stage) {
+        switch (stage) {
+        case PipelineStage::Tokenize: return "tokenize";
+        case PipelineStage::Parse:    return "parse";
+        case PipelineStage::Convert:  return "convert";
+        case PipelineStage::Declare:  return "declare";
+        }
+        return "unknown";
+    }
+
+    /// Instrumentation policy that records nothing and compiles away entirely
+    ///
+    /// A policy provides `scope(PipelineStage)`, returning an RAII object that lives for
+    /// exactly the duration of one stage call.
+    struct NoInstrumentation {
+        struct Scope {};
+        Scope scope(PipelineStage) const { return {}; }
+    };
+
     // -----------------------------------------------------------------------------
     // Pipeline Components
     // -----------------------------------------------------------------------------
@@ -508,15 +953,17 @@ namespace hlat {
         typename ParseFnSig,
         typename ConvertFnSig,
         typename DeclareFnSig,
-        typename Classifier = HeuristicQtClassifier
+        typename Classifier = HeuristicQtClassifier,
+        typename Instrumentation = NoInstrumentation
     >
     class QtPythonDeclarationsFrom {
     public:
-        std::decay_t<TokenizeFnSig>  tokenize_; ///< Tokenization function
-        std::decay_t<ParseFnSig>     parse_;    ///< Parsing function
-        std::decay_t<ConvertFnSig>   convert_;  ///< Conversion function
-        std::decay_t<DeclareFnSig>   declare_;  ///< Declaration function
-        std::decay_t<Classifier>     classifier_; ///< Widget classifier
+        std::decay_t<TokenizeFnSig>   tokenize_;   ///< Tokenization function
+        std::decay_t<ParseFnSig>      parse_;      ///< Parsing function
+        std::decay_t<ConvertFnSig>    convert_;    ///< Conversion function
+        std::decay_t<DeclareFnSig>    declare_;    ///< Declaration function
+        std::decay_t<Classifier>      classifier_; ///< Widget classifier
+        std::decay_t<Instrumentation> instrument_; ///< Per-stage instrumentation policy
 
         mutable std::vector<QtLocator> _cache; ///< Cache for converted locators
 
@@ -531,19 +978,43 @@ namespace hlat {
             , convert_(std::move(cv))
             , declare_(std::move(dc))
             , classifier_()
+            , instrument_()
+        {}
+
+        /// Constructs a pipeline with the given functions and instrumentation policy
+        QtPythonDeclarationsFrom(
+            TokenizeFnSig   tk,
+            ParseFnSig      ps,
+            ConvertFnSig    cv,
+            DeclareFnSig    dc,
+            Instrumentation in
+        ) : tokenize_(std::move(tk))
+            , parse_(std::move(ps))
+            , convert_(std::move(cv))
+            , declare_(std::move(dc))
+            , classifier_()
+            , instrument_(std::move(in))
         {}
 
         /// Processes an XPath expression through the pipeline
         auto operator()(std::string_view xpath) const {
-            auto tokens = tokenize_(xpath);
-            auto xlocs = parse_(tokens);
-            _cache = convert_(xlocs);
-            return declare_(_cache);
+            auto tokens = runStage(PipelineStage::Tokenize, tokenize_, xpath);
+            auto xlocs = runStage(PipelineStage::Parse, parse_, tokens);
+            _cache = runStage(PipelineStage::Convert, convert_, xlocs);
+            return runStage(PipelineStage::Declare, declare_, _cache);
+        }
+
+    private:
+        /// Invokes one stage inside an instrumentation scope
+        template<typename Fn, typename Arg>
+        decltype(auto) runStage(PipelineStage stage, Fn const& fn, Arg&& arg) const {
+            [[maybe_unused]] auto scope = instrument_.scope(stage);
+            return fn(std::forward<Arg>(arg));
         }
     };
 
-    template<class TL, class TP, class TC, class TD, class CL>
-    auto operator|(const hlat::QtPythonDeclarationsFrom<TL, TP, TC, TD, CL>& pipe,
+    template<class TL, class TP, class TC, class TD, class CL, class IN>
+    auto operator|(const hlat::QtPythonDeclarationsFrom<TL, TP, TC, TD, CL, IN>& pipe,
         std::string_view xpath)
         -> decltype(pipe(xpath))
     {
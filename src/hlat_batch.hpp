@@ -0,0 +1,563 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Batch Conversion
+ |  ---------------------------------------------------------------------------
+ |  Companion header for converting newline-delimited XPath corpora.
+ |  Features:
+ |      * Memory-mapped input, lexed in place without copies
+ |      * Multi-threaded conversion with input order preserved
+ |      * Large buffered output writes, bounded memory on any input size
+ |  Requires a POSIX platform (mmap/madvise).
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <cstdint>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hlat {
+
+    // -----------------------------------------------------------------------------
+    // Memory-Mapped Input
+    // -----------------------------------------------------------------------------
+
+    /// Read-only memory mapping of a whole file
+    ///
+    /// `advice` is the madvise() access pattern: sequential for streamed input, normal for
+    /// images used in place.
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path, int advice = MADV_SEQUENTIAL) {
+            fd_ = ::open(path.c_str(), O_RDONLY);
+            if (fd_ < 0)
+                throw std::runtime_error("Cannot open '" + path + "': " + std::strerror(errno));
+            struct stat st {};
+            if (::fstat(fd_, &st) != 0) {
+                ::close(fd_);
+                throw std::runtime_error("Cannot stat '" + path + "': " + std::strerror(errno));
+            }
+            size_ = static_cast<size_t>(st.st_size);
+            if (size_ > 0) {
+                void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+                if (p == MAP_FAILED) {
+                    ::close(fd_);
+                    throw std::runtime_error("Cannot map '" + path + "': " + std::strerror(errno));
+                }
+                data_ = static_cast<const char*>(p);
+                ::madvise(p, size_, advice);
+            }
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile() {
+            if (data_) ::munmap(const_cast<char*>(data_), size_);
+            if (fd_ >= 0) ::close(fd_);
+        }
+
+        /// The mapped file contents
+        std::string_view bytes() const { return { data_, size_ }; }
+
+        /// Drops the pages fully contained in [0, end) from this mapping
+        void release(size_t end) const {
+            const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            const size_t upto = std::min(end, size_) / page * page;
+            if (data_ && upto > released_) {
+                ::madvise(const_cast<char*>(data_) + released_, upto - released_, MADV_DONTNEED);
+                released_ = upto;
+            }
+        }
+
+    private:
+        int            fd_{ -1 };
+        const char*    data_{ nullptr };
+        size_t         size_{ 0 };
+        mutable size_t released_{ 0 };
+    };
+
+    // -----------------------------------------------------------------------------
+    // Buffered Output
+    // -----------------------------------------------------------------------------
+
+    /// Accumulates output and writes it to a file descriptor in large blocks
+    class BufferedWriter {
+    public:
+        /// Opens `path` for writing; "-" selects standard output
+        explicit BufferedWriter(const std::string& path, size_t capacity = size_t{ 8 } << 20)
+            : capacity_(capacity)
+        {
+            if (path == "-") fd_ = STDOUT_FILENO;
+            else {
+                fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                owned_ = true;
+            }
+            if (fd_ < 0)
+                throw std::runtime_error("Cannot open '" + path + "': " + std::strerror(errno));
+            buffer_.reserve(capacity_);
+        }
+
+        BufferedWriter(const BufferedWriter&) = delete;
+        BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+        ~BufferedWriter() {
+            try { flush(); } catch (...) {}
+            if (owned_) ::close(fd_);
+        }
+
+        /// Appends bytes, flushing whenever the buffer is full
+        void write(std::string_view bytes) {
+            if (buffer_.size() + bytes.size() > capacity_) flush();
+            if (bytes.size() >= capacity_) writeAll(bytes);
+            else buffer_.append(bytes);
+        }
+
+        /// Writes out everything buffered so far
+        void flush() {
+            writeAll(buffer_);
+            buffer_.clear();
+        }
+
+    private:
+        void writeAll(std::string_view bytes) {
+            while (!bytes.empty()) {
+                ssize_t n = ::write(fd_, bytes.data(), bytes.size());
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    throw std::runtime_error(std::string("Write failed: ") + std::strerror(errno));
+                }
+                bytes.remove_prefix(static_cast<size_t>(n));
+            }
+        }
+
+        int         fd_{ -1 };
+        bool        owned_{ false };
+        size_t      capacity_;
+        std::string buffer_;
+    };
+
+    // -----------------------------------------------------------------------------
+    // Line Splitting
+    // -----------------------------------------------------------------------------
+
+    /// Splits a byte range into non-empty lines without copying
+    class LineSplitter {
+    public:
+        explicit LineSplitter(std::string_view bytes) : bytes_(bytes) {}
+
+        /// Returns the next non-empty line (CR/LF stripped), or nullopt at the end
+        std::optional<std::string_view> next() {
+            while (pos_ < bytes_.size()) {
+                size_t eol = bytes_.find('\n', pos_);
+                if (eol == std::string_view::npos) eol = bytes_.size();
+                std::string_view line = bytes_.substr(pos_, eol - pos_);
+                pos_ = eol + 1;
+                ++line_;
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                if (!line.empty()) return line;
+            }
+            return std::nullopt;
+        }
+
+        /// Byte offset just past the last returned line
+        size_t offset() const { return std::min(pos_, bytes_.size()); }
+
+        /// One-based number of the last returned line
+        size_t lineNumber() const { return line_; }
+
+    private:
+        std::string_view bytes_;
+        size_t           pos_{ 0 };
+        size_t           line_{ 0 };
+    };
+
+    // -----------------------------------------------------------------------------
+    // Lock-Free Ring Buffers
+    // -----------------------------------------------------------------------------
+
+    namespace detail {
+        /// Rounds up to the next power of two (minimum 2)
+        inline size_t ceilPow2(size_t n) {
+            size_t p = 2;
+            while (p < n) p <<= 1;
+            return p;
+        }
+
+        /// Spin briefly, then yield the time slice
+        inline void backoff(unsigned& spins) {
+            if (++spins < 64) return;
+            std::this_thread::yield();
+        }
+
+        /// Lets threads sleep until another thread reports progress on what they poll
+        ///
+        /// A waiter takes a ticket with prepare(), checks its condition once more and only then
+        /// calls wait(ticket), which returns at once if notify() ran in between, so no wake-up
+        /// is lost. notify() costs a fence and a load while nobody sleeps.
+        class EventCount {
+        public:
+            uint32_t prepare() {
+                waiters_.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                return epoch_.load(std::memory_order_acquire);
+            }
+
+            void cancel() { waiters_.fetch_sub(1, std::memory_order_relaxed); }
+
+            void wait(uint32_t ticket) {
+                epoch_.wait(ticket, std::memory_order_acquire);
+                waiters_.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            /// Wakes every sleeping waiter; call after making progress visible
+            void notify() {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (waiters_.load(std::memory_order_relaxed) == 0) return;
+                epoch_.fetch_add(1, std::memory_order_release);
+                epoch_.notify_all();
+            }
+
+        private:
+            std::atomic<uint32_t> epoch_{ 0 };
+            std::atomic<uint32_t> waiters_{ 0 };
+        };
+
+        /// Retries `ready` with backoff for a bounded number of rounds, then sleeps on `event`
+        /// between retries
+        template<typename Ready>
+        void await(EventCount& event, Ready&& ready) {
+            constexpr unsigned SpinRounds = 128; // 64 busy spins, then 64 yields
+            for (unsigned spins = 0; spins < SpinRounds; ) {
+                if (ready()) return;
+                backoff(spins);
+            }
+            while (!ready()) {
+                const uint32_t ticket = event.prepare();
+                if (ready()) { event.cancel(); return; }
+                event.wait(ticket);
+            }
+        }
+    } // namespace detail
+
+    /// Bounded single-producer/single-consumer ring
+    template<typename T>
+    class SpscRing {
+    public:
+        explicit SpscRing(size_t capacity)
+            : mask_(detail::ceilPow2(capacity) - 1)
+            , cells_(std::make_unique<T[]>(mask_ + 1)) {}
+
+        /// Enqueues `value` unless the ring is full
+        bool tryPush(T value) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) > mask_) return false;
+            cells_[tail & mask_] = std::move(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Dequeues into `value` unless the ring is empty
+        bool tryPop(T& value) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) return false;
+            value = std::move(cells_[head & mask_]);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Approximate number of queued elements
+        size_t size() const {
+            return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+        }
+
+        /// Maximum number of queued elements
+        size_t capacity() const { return mask_ + 1; }
+
+    private:
+        size_t                           mask_;
+        std::unique_ptr<T[]>             cells_;
+        alignas(64) std::atomic<size_t>  head_{ 0 };
+        alignas(64) std::atomic<size_t>  tail_{ 0 };
+    };
+
+    /// Bounded multi-producer/multi-consumer ring (Vyukov sequence-cell design)
+    template<typename T>
+    class MpmcRing {
+    public:
+        explicit MpmcRing(size_t capacity)
+            : mask_(detail::ceilPow2(capacity) - 1)
+            , cells_(std::make_unique<Cell[]>(mask_ + 1))
+        {
+            for (size_t i = 0; i <= mask_; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        /// Enqueues `value` unless the ring is full
+        bool tryPush(T value) {
+            size_t pos = tail_.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = cells_[pos & mask_];
+                const auto dif = static_cast<std::ptrdiff_t>(cell.seq.load(std::memory_order_acquire) - pos);
+                if (dif == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (dif < 0) return false;
+                else pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        /// Dequeues into `value` unless the ring is empty
+        bool tryPop(T& value) {
+            size_t pos = head_.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = cells_[pos & mask_];
+                const auto dif = static_cast<std::ptrdiff_t>(cell.seq.load(std::memory_order_acquire) - (pos + 1));
+                if (dif == 0) {
+                    if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        value = std::move(cell.value);
+                        cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (dif < 0) return false;
+                else pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        /// Approximate number of queued elements
+        size_t size() const {
+            const size_t tail = tail_.load(std::memory_order_acquire);
+            const size_t head = head_.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+        /// Maximum number of queued elements
+        size_t capacity() const { return mask_ + 1; }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> seq;
+            T                   value;
+        };
+
+        size_t                           mask_;
+        std::unique_ptr<Cell[]>          cells_;
+        alignas(64) std::atomic<size_t>  head_{ 0 };
+        alignas(64) std::atomic<size_t>  tail_{ 0 };
+    };
+
+    // -----------------------------------------------------------------------------
+    // Batch Converter
+    // -----------------------------------------------------------------------------
+
+    /// Tuning knobs for batch conversion
+    struct BatchOptions {
+        unsigned threads{ std::max(1u, std::thread::hardware_concurrency()) }; ///< Worker threads
+        size_t   chunk_lines{ 4096 };                                          ///< Lines per chunk
+        size_t   chunks_in_flight{ 0 };                                        ///< Chunk slots (0: 4 per worker)
+    };
+
+    /// A selector that failed to convert
+    struct BatchError {
+        size_t      line;    ///< One-based input line number
+        std::string message; ///< Exception text
+    };
+
+    /// Occupancy of one pipeline queue, sampled by its single-threaded side
+    struct QueueStats {
+        size_t capacity{ 0 }; ///< Ring capacity
+        size_t samples{ 0 };  ///< Number of occupancy samples taken
+        size_t total{ 0 };    ///< Sum of sampled occupancies
+        size_t peak{ 0 };     ///< Largest sampled occupancy
+        size_t stalls{ 0 };   ///< Times the sampling side found the ring full (push) or empty (pop)
+
+        /// Mean sampled occupancy
+        double mean() const { return samples ? static_cast<double>(total) / samples : 0.0; }
+
+        /// Records one occupancy sample
+        void sample(size_t occupancy) {
+            ++samples; total += occupancy;
+            peak = std::max(peak, occupancy);
+        }
+    };
+
+    /// Outcome of a batch run
+    struct BatchReport {
+        std::vector<BatchError> errors;    ///< Selectors that failed, in input order
+        size_t                  selectors; ///< Non-empty input lines processed
+        size_t                  chunks;    ///< Chunks committed by the writer
+        QueueStats              free;      ///< Recycled chunk slots (writer -> reader), sampled by the reader
+        QueueStats              work;      ///< Filled chunks (reader -> workers), sampled by the reader
+        QueueStats              done;      ///< Converted chunks (workers -> writer), sampled by the writer
+    };
+
+    /// Converts newline-delimited XPaths through a bounded reader -> workers -> writer pipeline
+    ///
+    /// The reader splits the mapped input into chunks of lines, N workers run every line through
+    /// their own copy of the pipeline into a per-chunk buffer, and the writer commits chunks in
+    /// sequence order. A fixed pool of chunk slots circulates through lock-free rings, so memory
+    /// is capped by `chunks_in_flight * chunk_lines` regardless of input size. A stage that
+    /// finds its ring empty (or full) spins and yields for a bounded number of rounds, then
+    /// sleeps until the stage feeding it makes progress.
+    template<typename Pipeline>
+    class BatchConverter {
+    public:
+        /// Each worker receives its own copy of `prototype`
+        explicit BatchConverter(const Pipeline& prototype, BatchOptions options = {})
+            : prototype_(prototype), options_(options)
+        {
+            options_.threads = std::max(1u, options_.threads);
+            options_.chunk_lines = std::max<size_t>(1, options_.chunk_lines);
+            if (options_.chunks_in_flight == 0) options_.chunks_in_flight = 4 * size_t{ options_.threads };
+            options_.chunks_in_flight = std::max<size_t>(2, options_.chunks_in_flight);
+        }
+
+        /// Converts every line of `input` and writes declarations in input order
+        BatchReport run(const MappedFile& input, BufferedWriter& output) const {
+            struct Line { std::string_view xpath; size_t number; };
+            struct Chunk {
+                size_t                  seq{ 0 };
+                size_t                  end{ 0 };
+                std::vector<Line>       lines;
+                std::string             output;
+                std::vector<BatchError> errors;
+            };
+
+            const size_t slots = options_.chunks_in_flight;
+            std::vector<Chunk> pool(slots);
+            SpscRing<Chunk*> free(slots);
+            MpmcRing<Chunk*> work(slots + options_.threads);
+            MpmcRing<Chunk*> done(slots);
+            for (auto& c : pool) free.tryPush(&c);
+            detail::EventCount freed, filled, converted; // progress on free, work and done
+
+            BatchReport report{ {}, 0, 0,
+                { free.capacity() }, { work.capacity() }, { done.capacity() } };
+            std::atomic<size_t> total{ SIZE_MAX };
+            std::atomic<bool>   abort{ false };
+            std::exception_ptr  failure;
+
+            // Reader: fills recycled slots with chunks of lines
+            std::jthread reader([&] {
+                LineSplitter lines(input.bytes());
+                size_t seq = 0, count = 0;
+                bool more = true;
+                while (more) {
+                    Chunk* c = nullptr;
+                    if (!free.tryPop(c)) {
+                        ++report.free.stalls;
+                        detail::await(freed, [&] { return free.tryPop(c) || abort.load(std::memory_order_relaxed); });
+                    }
+                    if (!c) break;
+                    report.free.sample(free.size());
+                    c->lines.clear();
+                    while (c->lines.size() < options_.chunk_lines) {
+                        auto line = lines.next();
+                        if (!line) { more = false; break; }
+                        c->lines.push_back({ *line, lines.lineNumber() });
+                    }
+                    if (c->lines.empty()) break;
+                    count += c->lines.size();
+                    c->seq = seq++;
+                    c->end = lines.offset();
+                    report.work.sample(work.size());
+                    work.tryPush(c); // never full: holds every slot plus one stop marker per worker
+                    filled.notify();
+                }
+                report.selectors = count;
+                total.store(seq, std::memory_order_release);
+                converted.notify(); // the writer may be waiting for a chunk that will never come
+                for (unsigned t = 0; t < options_.threads; ++t) work.tryPush(nullptr);
+                filled.notify();
+            });
+
+            // Workers: run each line through a private pipeline copy
+            std::vector<std::jthread> workers;
+            for (unsigned t = 0; t < options_.threads; ++t) {
+                workers.emplace_back([&] {
+                    Pipeline pipeline(prototype_);
+                    while (true) {
+                        Chunk* c = nullptr;
+                        detail::await(filled, [&] { return work.tryPop(c); });
+                        if (!c) return;
+                        c->output.clear();
+                        c->errors.clear();
+                        for (auto const& line : c->lines) {
+                            if constexpr (requires { pipeline.instrument_.beginSelector(line.number); })
+                                pipeline.instrument_.beginSelector(line.number);
+                            try {
+                                c->output += pipeline(line.xpath);
+                                c->output += '\n';
+                            }
+                            catch (const std::exception& e) {
+                                c->errors.push_back({ line.number, e.what() });
+                            }
+                        }
+                        done.tryPush(c); // never full: holds every slot
+                        converted.notify();
+                    }
+                });
+            }
+
+            // Writer: commits chunks in sequence order and recycles their slots
+            try {
+                std::vector<Chunk*> pending(slots, nullptr);
+                size_t next = 0;
+                while (next != total.load(std::memory_order_acquire)) {
+                    Chunk* c = nullptr;
+                    if (!done.tryPop(c)) {
+                        ++report.done.stalls;
+                        detail::await(converted, [&] { return done.tryPop(c) || next == total.load(std::memory_order_acquire); });
+                        if (!c) continue;
+                    }
+                    report.done.sample(done.size());
+                    pending[c->seq % slots] = c;
+                    while ((c = pending[next % slots]) && c->seq == next) {
+                        pending[next % slots] = nullptr;
+                        output.write(c->output);
+                        for (auto& err : c->errors) report.errors.push_back(std::move(err));
+                        input.release(c->end);
+                        free.tryPush(c);
+                        freed.notify();
+                        ++next;
+                    }
+                }
+                report.chunks = next;
+                output.flush();
+            }
+            catch (...) {
+                failure = std::current_exception();
+                abort.store(true, std::memory_order_relaxed);
+                freed.notify();
+            }
+
+            reader.join();
+            workers.clear();
+            if (failure) std::rethrow_exception(failure);
+            return report;
+        }
+
+    private:
+        Pipeline     prototype_;
+        BatchOptions options_;
+    };
+
+} // namespace hlat
@@ -0,0 +1,1432 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Benchmark Suite
+ |  ---------------------------------------------------------------------------
+ |  Per-stage and end-to-end benchmarks over a seeded synthetic XPath corpus,
+ |  plus selector evaluation against a seeded synthetic widget tree.
+ |  Reports ns/selector, input bytes/s and allocations/selector.
+ |
+ |  Usage: hlat_bench [options]
+ |      --selectors <n>       Corpus size (default: 10000)
+ |      --seed <n>            Generator seed (default: 42)
+ |      --depth <min>:<max>   Steps per selector (default: 2:6)
+ |      --predicates <n>      Max predicate conditions per step (default: 2)
+ |      --value-len <n>       Attribute value length (default: 8)
+ |      --vocab <n>           Distinct tag names (default: 32)
+ |      --tree-nodes <n>      Widget tree size for evaluation benchmarks (default: 100000)
+ |      --min-time <s>        Minimum measuring time per benchmark (default: 0.5)
+ |      --filter <text>       Only run benchmarks whose name contains <text>
+ |      --json                Emit results as JSON
+ |      --check-budgets       Assert per-stage allocation budgets on reference XPaths
+ |      --check-complexity    Flag stages whose cost grows superlinearly on pathological inputs
+ |      --check-eval          Compare every evaluation path with a naive evaluator on random trees
+ |
+ |  Build: g++ -std=c++20 -O2 -pthread -Isrc src/hlat_bench.cpp -o hlat_bench
+ *============================================================================*/
+
+#define HLAT_COUNT_ALLOCATIONS
+#include "hlat.hpp"
+#include "hlat_instrument.hpp"
+#include "hlat_corpusdiff.hpp"
+#include "hlat_diskcache.hpp"
+#include "hlat_eval.hpp"
+#include "hlat_incremental.hpp"
+#include "hlat_parallel.hpp"
+#include "hlat_resultcache.hpp"
+#include "hlat_selectorset.hpp"
+#include "hlat_snapshot.hpp"
+#include "hlat_stream.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    // -----------------------------------------------------------------------------
+    // Synthetic XPath Generator
+    // -----------------------------------------------------------------------------
+
+    /// Shape of the generated corpus
+    struct CorpusOptions {
+        size_t   selectors{ 10000 };  ///< Number of selectors
+        uint64_t seed{ 42 };          ///< Generator seed; equal seeds give equal corpora
+        size_t   min_depth{ 2 };      ///< Minimum steps per selector
+        size_t   max_depth{ 6 };      ///< Maximum steps per selector
+        size_t   max_predicates{ 2 }; ///< Maximum predicate conditions per step
+        size_t   value_length{ 8 };   ///< Length of attribute values
+        size_t   vocabulary{ 32 };    ///< Number of distinct tag names
+    };
+
+    /// Generates reproducible XPath selectors with tunable shape
+    class SyntheticXPathGenerator {
+    public:
+        explicit SyntheticXPathGenerator(CorpusOptions options)
+            : options_(options), rng_(options.seed)
+        {
+            static const char* base[] = {
+                "div", "span", "button", "form", "panel", "label", "textfield", "checkbox",
+                "combobox", "slider", "listview", "container", "section", "item", "radiobutton", "text"
+            };
+            for (size_t i = 0; i < std::max<size_t>(1, options_.vocabulary); ++i) {
+                std::string tag = base[i % std::size(base)];
+                if (i >= std::size(base)) tag += std::to_string(i / std::size(base));
+                tags_.push_back(std::move(tag));
+            }
+        }
+
+        /// Generates one selector
+        std::string next() {
+            std::string out;
+            const size_t depth = pick(options_.min_depth, std::max(options_.min_depth, options_.max_depth));
+            for (size_t d = 0; d < depth; ++d) {
+                out += chance(0.3) ? "//" : "/";
+                out += chance(0.1) ? "*" : tags_[pick(0, tags_.size() - 1)];
+                const size_t preds = pick(0, options_.max_predicates);
+                if (preds == 0) continue;
+                out += '[';
+                for (size_t p = 0; p < preds; ++p) {
+                    if (p) out += " and ";
+                    if (chance(0.25)) out += std::to_string(pick(1, 5));
+                    else {
+                        static const char* attrs[] = { "class", "name", "id", "objectName", "type", "enabled" };
+                        out += '@';
+                        out += attrs[pick(0, std::size(attrs) - 1)];
+                        out += "='";
+                        out += value();
+                        out += '\'';
+                    }
+                }
+                out += ']';
+            }
+            return out;
+        }
+
+        /// Generates the whole corpus
+        std::vector<std::string> corpus() {
+            std::vector<std::string> out;
+            out.reserve(options_.selectors);
+            for (size_t i = 0; i < options_.selectors; ++i) out.push_back(next());
+            return out;
+        }
+
+    private:
+        size_t pick(size_t lo, size_t hi) { return std::uniform_int_distribution<size_t>(lo, hi)(rng_); }
+        bool   chance(double p) { return std::bernoulli_distribution(p)(rng_); }
+
+        std::string value() {
+            static constexpr char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+            std::string v(options_.value_length, ' ');
+            for (char& c : v) c = alphabet[pick(0, sizeof(alphabet) - 2)];
+            return v;
+        }
+
+        CorpusOptions            options_;
+        std::mt19937_64          rng_;
+        std::vector<std::string> tags_;
+    };
+
+    // -----------------------------------------------------------------------------
+    // Synthetic Widget Tree Generator
+    // -----------------------------------------------------------------------------
+
+    /// Shape of the generated widget tree
+    struct TreeOptions {
+        size_t   nodes{ 100000 };   ///< Number of widgets
+        size_t   fanout{ 6 };       ///< Typical number of children per widget
+        size_t   selectors{ 1000 }; ///< Number of selectors sampled from the tree
+        uint64_t seed{ 42 };        ///< Generator seed
+    };
+
+    /// A reproducible widget tree plus selectors sampled from its real paths
+    struct SyntheticWidgetTree {
+        hlat::WidgetTree         tree;
+        std::vector<std::string> selectors;
+
+        explicit SyntheticWidgetTree(TreeOptions options) {
+            static const char* tags[] = {
+                "root", "form", "panel", "container", "button", "label", "textfield", "checkbox",
+                "combobox", "slider", "listview", "item", "section", "radiobutton", "dialog", "toolbar"
+            };
+            std::mt19937_64 rng(options.seed);
+            auto pick = [&](size_t lo, size_t hi) { return std::uniform_int_distribution<size_t>(lo, hi)(rng); };
+
+            // Random parents with a bounded fan-out keep the depth logarithmic
+            const size_t n = std::max<size_t>(1, options.nodes);
+            std::vector<size_t> parent(n, 0), tag(n, 0);
+            std::vector<std::vector<size_t>> children(n);
+            for (size_t i = 1; i < n; ++i) {
+                parent[i] = pick((i - 1) / (2 * options.fanout), (i - 1) / options.fanout);
+                tag[i] = pick(1, std::size(tags) - 1);
+                children[parent[i]].push_back(i);
+            }
+
+            hlat::WidgetTreeBuilder builder;
+            std::vector<std::pair<size_t, size_t>> stack{ { 0, 0 } }; // node, next child
+            auto open = [&](size_t i) {
+                builder.open(tags[tag[i]]);
+                builder.attribute("objectName", std::string(tags[tag[i]]) + "_" + std::to_string(i));
+                builder.attribute("class", "c" + std::to_string(i % 8));
+                builder.attribute("enabled", i % 5 ? "true" : "false");
+            };
+            open(0);
+            while (!stack.empty()) {
+                auto& [node, next] = stack.back();
+                if (next == children[node].size()) { builder.close(); stack.pop_back(); continue; }
+                const size_t child = children[node][next++];
+                open(child);
+                stack.push_back({ child, 0 });
+            }
+            tree = std::move(builder).build();
+
+            auto path = [&](size_t i) {
+                std::string out;
+                for (size_t p = i; ; p = parent[p]) {
+                    out.insert(0, std::string("/") + tags[tag[p]]);
+                    if (p == 0) return out;
+                }
+            };
+            for (size_t s = 0; s < options.selectors; ++s) {
+                const size_t i = pick(1, n - 1), up = parent[parent[i]];
+                const std::string name = tags[tag[i]];
+                switch (s % 5) {
+                case 0: selectors.push_back("//" + name + "[@objectName='" + name + "_" + std::to_string(i) + "']"); break;
+                case 1: selectors.push_back("//" + std::string(tags[tag[parent[i]]]) + "/" + name); break;
+                case 2: selectors.push_back(path(i)); break;
+                case 3: selectors.push_back("//" + std::string(tags[tag[up]]) + "//" + name + "[2]"); break;
+                case 4: selectors.push_back("//*[@class='c" + std::to_string(i % 8) + "' and @enabled='false']/" + name); break;
+                }
+            }
+        }
+    };
+
+    /// XML or JSON dump of a tree for the snapshot loading benchmarks; the generated
+    /// names and values need no escaping. JSON widgets carry their tag under "type".
+    std::string snapshotOf(const hlat::WidgetTree& tree, hlat::SnapshotFormat format) {
+        const bool xml = format == hlat::SnapshotFormat::Xml;
+        std::string out = xml ? "" : "[";
+        std::vector<hlat::NodeId> open;
+        auto closeTo = [&](hlat::NodeId n) {
+            for (; !open.empty() && tree.node(open.back()).end <= n; open.pop_back()) {
+                if (xml) out.append("</").append(tree.tagName(open.back())).append(">\n");
+                else out += tree.node(open.back()).first_child == hlat::NoNode ? "}" : "]}";
+            }
+        };
+        for (hlat::NodeId n = 1; n < tree.size(); ++n) {
+            closeTo(n);
+            const bool first = tree.node(n).prev_sibling == hlat::NoNode;
+            if (xml) out.append("<").append(tree.tagName(n));
+            else out.append(first ? "\n" : ",\n").append("{\"type\": \"").append(tree.tagName(n)).append("\"");
+            for (auto const& a : tree.attributes(n)) {
+                const auto name = tree.strings().view(a.name), value = tree.strings().view(a.value);
+                if (xml) out.append(" ").append(name).append("=\"").append(value).append("\"");
+                else out.append(", \"").append(name).append("\": \"").append(value).append("\"");
+            }
+            if (xml) out += ">";
+            else if (tree.node(n).first_child != hlat::NoNode) out += ", \"children\": [";
+            open.push_back(n);
+        }
+        closeTo(static_cast<hlat::NodeId>(tree.size()));
+        return xml ? out : out + "]";
+    }
+
+    /// Feeds a tree to a stream as start / attribute / end events, then finishes it
+    void replayEvents(const hlat::WidgetTree& tree, hlat::SelectorStream& stream) {
+        std::vector<hlat::NodeId> open;
+        for (hlat::NodeId n = 1; n < tree.size(); ++n) {
+            while (!open.empty() && tree.node(open.back()).end <= n) { stream.close(); open.pop_back(); }
+            stream.open(tree.tagName(n));
+            for (auto const& a : tree.attributes(n))
+                stream.attribute(tree.strings().view(a.name), tree.strings().view(a.value));
+            open.push_back(n);
+        }
+        for (; !open.empty(); open.pop_back()) stream.close();
+        stream.finish();
+    }
+
+    // -----------------------------------------------------------------------------
+    // Benchmark Harness
+    // -----------------------------------------------------------------------------
+
+    /// Keeps the optimizer from discarding a computed value
+    template<typename T>
+    inline void doNotOptimize(T const& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink; sink = &value;
+#endif
+    }
+
+    /// What one benchmark measures: `run` processes item `i` of a corpus of `items` entries
+    struct Fixture {
+        size_t                      items; ///< Number of distinct inputs
+        size_t                      bytes; ///< Total input bytes across all items
+        std::function<void(size_t)> run;
+    };
+
+    /// One benchmark; `setup` builds its inputs, and runs only if the benchmark is selected
+    ///
+    /// The fixture is destroyed once measured, along with its threads and buffers. Run
+    /// functions may refer to Lazy inputs owned by the benchmark list, which outlives them.
+    struct Benchmark {
+        std::string              name;
+        std::function<Fixture()> setup;
+    };
+
+    /// An input shared by several benchmarks, built by the first selected one that needs it
+    template<typename T>
+    class Lazy {
+    public:
+        explicit Lazy(std::function<T()> make) : make_(std::move(make)) {}
+
+        T& operator*() {
+            if (!value_) value_.emplace(make_());
+            return *value_;
+        }
+        T* operator->() { return &**this; }
+
+    private:
+        std::function<T()> make_;
+        std::optional<T>   value_;
+    };
+
+    template<typename Fn>
+    auto lazy(Fn make) { return std::make_shared<Lazy<std::invoke_result_t<Fn&>>>(std::move(make)); }
+
+    struct Result {
+        std::string name;
+        uint64_t    iterations;
+        double      ns_per_item;
+        double      bytes_per_second;
+        double      allocs_per_item;
+    };
+
+    /// Runs whole passes over the inputs until `min_time` has elapsed
+    Result measure(const std::string& name, const Fixture& bm, double min_time) {
+        using clock = std::chrono::steady_clock;
+        for (size_t i = 0; i < std::min<size_t>(bm.items, 64); ++i) bm.run(i); // warm-up
+
+        auto& allocs = hlat::instrument::threadAllocations();
+        const uint64_t allocs_before = allocs.count;
+        uint64_t iterations = 0;
+        const auto start = clock::now();
+        double elapsed = 0;
+        do {
+            for (size_t i = 0; i < bm.items; ++i) bm.run(i);
+            iterations += bm.items;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        } while (elapsed < min_time);
+
+        const double passes = static_cast<double>(iterations) / static_cast<double>(bm.items);
+        return {
+            name, iterations,
+            elapsed * 1e9 / static_cast<double>(iterations),
+            static_cast<double>(bm.bytes) * passes / elapsed,
+            static_cast<double>(allocs.count - allocs_before) / static_cast<double>(iterations)
+        };
+    }
+
+    // -----------------------------------------------------------------------------
+    // Stage Benchmarks
+    // -----------------------------------------------------------------------------
+
+    /// Precomputed inputs of every stage for one corpus
+    struct StageInputs {
+        std::vector<std::string>                  xpaths;
+        std::vector<std::vector<hlat::Token>>     tokens;
+        std::vector<std::vector<hlat::XLocator>>  xlocs;
+        std::vector<std::vector<hlat::QtLocator>> qtlocs;
+        std::vector<std::string>                  tags;
+        std::vector<std::string>                  raw_uids;
+
+        explicit StageInputs(std::vector<std::string> corpus) : xpaths(std::move(corpus)) {
+            for (auto const& x : xpaths) {
+                tokens.push_back(hlat::XPathLexer(x).tokenize());
+                xlocs.push_back(hlat::XPathParser(tokens.back()).parse());
+                qtlocs.push_back(hlat::XPathConverter(xlocs.back()).convert());
+                for (auto const& step : xlocs.back()) {
+                    tags.push_back(step.tag);
+                    raw_uids.push_back(step.tag + "_" + step.axis + "__" + (step.is_absolute ? "abs" : "rel"));
+                }
+            }
+        }
+    };
+
+    template<typename Range, typename Size>
+    size_t totalBytes(const Range& range, Size size) {
+        return std::accumulate(range.begin(), range.end(), size_t{ 0 },
+            [&](size_t acc, auto const& v) { return acc + size(v); });
+    }
+
+
+    /// A tree image saved to a temporary file for as long as a benchmark needs it
+    struct ImageFile {
+        std::string path;
+        size_t      bytes;
+
+        explicit ImageFile(const hlat::WidgetTree& tree)
+            : path((std::filesystem::temp_directory_path() / "hlat_bench.hlwt").string()) {
+            hlat::saveWidgetTree(tree, path);
+            bytes = std::filesystem::file_size(path);
+        }
+        ImageFile(const ImageFile&) = delete;
+        ImageFile& operator=(const ImageFile&) = delete;
+        ~ImageFile() { std::filesystem::remove(path); }
+    };
+
+    /// Evaluation benchmarks; each item resolves one sampled selector against the whole tree
+    std::vector<Benchmark> evaluationBenchmarks(TreeOptions options) {
+        using Steps = std::vector<std::vector<hlat::XLocator>>;
+        auto in = lazy([=] { return SyntheticWidgetTree(options); });
+        auto steps = lazy([=] {
+            Steps out;
+            for (auto const& x : (*in)->selectors) {
+                auto tokens = hlat::XPathLexer(x).tokenize();
+                out.push_back(hlat::XPathParser(tokens).parse());
+            }
+            return out;
+        });
+        auto evaluator = lazy([=] { return hlat::SelectorEvaluator((*in)->tree); });
+        auto bytes = [=] { return totalBytes((*in)->selectors, [](auto const& s) { return s.size(); }); };
+
+        std::vector<Benchmark> out = {
+            { "SelectorEvaluator::evaluate", [=] {
+                return Fixture{ (*steps)->size(), bytes(), [&e = **evaluator, &s = **steps](size_t i) {
+                    doNotOptimize(e.evaluate(s[i]));
+                } };
+            } },
+            // Same selectors, stopping at the first result in document order
+            { "SelectorEvaluator::findFirst", [=] {
+                return Fixture{ (*steps)->size(), bytes(), [&e = **evaluator, &s = **steps](size_t i) {
+                    doNotOptimize(e.findFirst(s[i]));
+                } };
+            } },
+            // Caches holding every sampled selector's result, so each item is a hit
+            { "ResultCache::evaluate (hit)", [=] {
+                auto cache = std::make_shared<hlat::ResultCache>((*steps)->size());
+                for (auto const& s : **steps) cache->evaluate(**evaluator, s);
+                return Fixture{ (*steps)->size(), bytes(), [&e = **evaluator, &s = **steps, cache](size_t i) {
+                    doNotOptimize(cache->evaluate(e, s[i]));
+                } };
+            } },
+            { "ConcurrentResultCache::evaluate (hit)", [=] {
+                auto cache = std::make_shared<hlat::ConcurrentResultCache>((*steps)->size() * 2);
+                for (auto const& s : **steps) cache->evaluate(**evaluator, s);
+                return Fixture{ (*steps)->size(), bytes(), [&e = **evaluator, &s = **steps, cache](size_t i) {
+                    doNotOptimize(cache->evaluate(e, s[i]));
+                } };
+            } },
+            // What a cache hit costs: decoding a serialized program and binding it to the tree
+            { "SelectorEvaluator::bind", [=] {
+                auto programs = std::make_shared<std::vector<std::string>>();
+                for (auto const& s : **steps) programs->push_back(hlat::SelectorCompiler(s).compile().serialize());
+                return Fixture{ (*steps)->size(), bytes(), [&e = **evaluator, programs](size_t i) {
+                    doNotOptimize(e.bind(hlat::SelectorProgram::deserialize((*programs)[i])));
+                } };
+            } },
+            // One item is the whole set; divide by the selector count to compare with evaluate
+            { "SelectorSet::match", [=] {
+                auto set = std::make_shared<hlat::SelectorSet>((*in)->tree);
+                for (auto const& s : **steps) set->add(s);
+                return Fixture{ 1, bytes(), [set](size_t) { doNotOptimize(set->match()); } };
+            } },
+            // One item is one pass over the tree's events with every streamable selector
+            { "SelectorStream", [=] {
+                auto streamable = std::make_shared<std::vector<hlat::SelectorProgram>>();
+                hlat::SelectorStream probe([](size_t, hlat::NodeId) {});
+                for (auto const& s : **steps) {
+                    auto program = hlat::SelectorCompiler(s).compile();
+                    try { probe.add(program); streamable->push_back(std::move(program)); }
+                    catch (const std::runtime_error&) {}
+                }
+                return Fixture{ 1, bytes(), [streamable, &tree = (*in)->tree](size_t) {
+                    size_t matches = 0;
+                    hlat::SelectorStream stream([&](size_t, hlat::NodeId) { ++matches; });
+                    for (auto const& p : *streamable) stream.add(p);
+                    replayEvents(tree, stream);
+                    doNotOptimize(matches);
+                } };
+            } },
+            // Dumps of the same tree; bytes are the dump sizes, so bytes/s is load throughput
+            { "SnapshotReader::load (XML)", [=] {
+                auto xml = std::make_shared<std::string>(snapshotOf((*in)->tree, hlat::SnapshotFormat::Xml));
+                return Fixture{ 1, xml->size(), [xml](size_t) { doNotOptimize(hlat::SnapshotReader(*xml).load()); } };
+            } },
+            { "SnapshotReader::load (JSON)", [=] {
+                auto json = std::make_shared<std::string>(snapshotOf((*in)->tree, hlat::SnapshotFormat::Json));
+                hlat::SnapshotOptions json_options;
+                json_options.tag_key = "type";
+                return Fixture{ 1, json->size(), [json, json_options](size_t) {
+                    doNotOptimize(hlat::SnapshotReader(*json, json_options).load());
+                } };
+            } },
+            // One attribute delta and the re-evaluation of the selectors it touches; every
+            // selector is registered once, and each item toggles one widget's "enabled" property
+            { "IncrementalEvaluator::setAttribute", [=] {
+                auto incremental = std::make_shared<hlat::IncrementalEvaluator>((*in)->tree);
+                for (auto const& s : **steps) incremental->add(s);
+                auto toggled = std::make_shared<size_t>(0);
+                return Fixture{ 1, bytes(), [incremental, toggled](size_t) {
+                    const auto node = static_cast<hlat::NodeId>(1 + (*toggled)++ * 7919 % (incremental->tree().size() - 1));
+                    const auto value = incremental->tree().strings().find("true") ==
+                        incremental->tree().attribute(node, incremental->tree().strings().find("enabled")) ? "false" : "true";
+                    doNotOptimize(incremental->setAttribute(node, "enabled", value));
+                } };
+            } },
+            // Opening a tree image in place: what a test process pays instead of re-parsing a dump
+            { "WidgetTree::view", [=] {
+                auto image = std::make_shared<std::string>((*in)->tree.serialize());
+                return Fixture{ 1, image->size(), [image](size_t) { doNotOptimize(hlat::WidgetTree::view(*image, image)); } };
+            } },
+            // The same through a file: open, map and view, and with the linear verification pass
+            { "mapWidgetTree", [=] {
+                auto file = std::make_shared<ImageFile>((*in)->tree);
+                return Fixture{ 1, file->bytes, [file](size_t) { doNotOptimize(hlat::mapWidgetTree(file->path)); } };
+            } },
+            { "mapWidgetTree (verified)", [=] {
+                auto file = std::make_shared<ImageFile>((*in)->tree);
+                return Fixture{ 1, file->bytes, [file](size_t) { doNotOptimize(hlat::mapWidgetTree(file->path, true)); } };
+            } },
+        };
+
+        // Scaling from 1 to 64 threads: the whole sample as one batch, and one selector at a
+        // time, whose leading '//' step is split into ID ranges. Pools live only while measured.
+        for (unsigned threads = 1; threads <= 64; threads *= 2) {
+            const std::string suffix = " (" + std::to_string(threads) + (threads == 1 ? " thread)" : " threads)");
+            out.push_back({ "ParallelEvaluator batch" + suffix, [=] {
+                auto parallel = std::make_shared<hlat::ParallelEvaluator>((*in)->tree, threads);
+                return Fixture{ 1, bytes(), [parallel, &s = **steps](size_t) {
+                    doNotOptimize(parallel->evaluate(std::span<const std::vector<hlat::XLocator>>(s)));
+                } };
+            } });
+            out.push_back({ "ParallelEvaluator::evaluate" + suffix, [=] {
+                auto parallel = std::make_shared<hlat::ParallelEvaluator>((*in)->tree, threads);
+                return Fixture{ (*steps)->size(), bytes(), [parallel, &s = **steps](size_t i) {
+                    doNotOptimize(parallel->evaluate(s[i]));
+                } };
+            } });
+        }
+        return out;
+    }
+
+    std::vector<Benchmark> stageBenchmarks(CorpusOptions corpus) {
+        using Pipeline = hlat::QtPythonDeclarationsFrom<
+            hlat::XPathLexerFn, hlat::XPathParserFn, hlat::QtLocatorBuilderFn, hlat::QtLocatorEmitterFn>;
+        auto inputs = lazy([=] { return StageInputs(SyntheticXPathGenerator(corpus).corpus()); });
+        auto pipeline = lazy([] {
+            return Pipeline(
+                [](std::string_view xpath) { return hlat::XPathLexer(xpath).tokenize(); },
+                [](auto const& toks) { return hlat::XPathParser(toks).parse(); },
+                [](auto const& xlocs) { return hlat::XPathConverter(xlocs).convert(); },
+                [](std::vector<hlat::QtLocator>& qtlocs) -> std::string {
+                    std::string out;
+                    for (auto const& qt : qtlocs) out += qt.finalize();
+                    return out;
+                });
+        });
+        auto xpathBytes = [=] { return totalBytes((*inputs)->xpaths, [](auto const& s) { return s.size(); }); };
+        auto perSelector = [](const std::vector<std::string>& strings) {
+            return totalBytes(strings, [](auto const& s) { return s.size(); });
+        };
+        // A conversion cache file holding the whole corpus, so each item is a hit
+        auto conversionCache = [=] {
+            const auto path = std::filesystem::temp_directory_path() / "hlat_bench.cache";
+            std::filesystem::remove(path);
+            {
+                hlat::ConversionCache cache(path.string());
+                for (auto const& x : (*inputs)->xpaths) cache.insert(x, (**pipeline)(x));
+                cache.flush();
+            }
+            return std::make_shared<hlat::ConversionCache>(path.string());
+        };
+
+        return {
+            { "XPathLexer::tokenize", [=] {
+                return Fixture{ (*inputs)->xpaths.size(), xpathBytes(), [&in = **inputs](size_t i) {
+                    doNotOptimize(hlat::XPathLexer(in.xpaths[i]).tokenize());
+                } };
+            } },
+            { "XPathParser::parse", [=] {
+                return Fixture{ (*inputs)->xpaths.size(), xpathBytes(), [&in = **inputs](size_t i) {
+                    doNotOptimize(hlat::XPathParser(in.tokens[i]).parse());
+                } };
+            } },
+            { "XPathConverter::convert", [=] {
+                return Fixture{ (*inputs)->xpaths.size(), xpathBytes(), [&in = **inputs](size_t i) {
+                    doNotOptimize(hlat::XPathConverter(in.xlocs[i]).convert());
+                } };
+            } },
+            { "HeuristicQtClassifier", [=] {
+                return Fixture{ (*inputs)->tags.size(), perSelector((*inputs)->tags), [&in = **inputs](size_t i) {
+                    doNotOptimize(hlat::HeuristicQtClassifier{}(in.tags[i]));
+                } };
+            } },
+            { "util::canonicalize", [=] {
+                return Fixture{ (*inputs)->raw_uids.size(), perSelector((*inputs)->raw_uids), [&in = **inputs](size_t i) {
+                    doNotOptimize(hlat::util::canonicalize(in.raw_uids[i]));
+                } };
+            } },
+            { "QtLocator::finalize", [=] {
+                return Fixture{ (*inputs)->xpaths.size(), xpathBytes(), [&in = **inputs](size_t i) {
+                    for (auto const& qt : in.qtlocs[i]) doNotOptimize(qt.finalize());
+                } };
+            } },
+            { "QtPythonDeclarationsFrom", [=] {
+                return Fixture{ (*inputs)->xpaths.size(), xpathBytes(), [&in = **inputs, &p = **pipeline](size_t i) {
+                    doNotOptimize(p(in.xpaths[i]));
+                } };
+            } },
+            { "ConversionCache::find (hit)", [=] {
+                auto cache = conversionCache();
+                return Fixture{ (*inputs)->xpaths.size(), xpathBytes(), [&in = **inputs, cache](size_t i) {
+                    doNotOptimize(cache->find(in.xpaths[i]));
+                } };
+            } },
+            { "CachedDeclarations (hit)", [=] {
+                auto cache = conversionCache();
+                auto cached = std::make_shared<hlat::CachedDeclarations<Pipeline>>(**pipeline, *cache);
+                return Fixture{ (*inputs)->xpaths.size(), xpathBytes(), [&in = **inputs, cache, cached](size_t i) {
+                    doNotOptimize((*cached)(in.xpaths[i]));
+                } };
+            } },
+            // One item patches the whole corpus' output after 1% of its selectors changed: the
+            // corpus and its output, and a copy with every 100th selector given a new first step
+            { "IncrementalConverter::run (1% changed)", [=] {
+                auto const& xpaths = (*inputs)->xpaths;
+                auto old_corpus = std::make_shared<std::string>(), old_output = std::make_shared<std::string>();
+                auto new_corpus = std::make_shared<std::string>();
+                for (size_t i = 0; i < xpaths.size(); ++i) {
+                    *old_corpus += xpaths[i] + '\n';
+                    *old_output += (**pipeline)(xpaths[i]) + '\n';
+                    *new_corpus += (i % 100 ? "" : "/patched" + std::to_string(i)) + xpaths[i] + '\n';
+                }
+                auto incremental = std::make_shared<hlat::IncrementalConverter<Pipeline>>(**pipeline, 1);
+                return Fixture{ 1, new_corpus->size(), [=](size_t) {
+                    hlat::BufferedWriter sink("/dev/null");
+                    doNotOptimize(incremental->run(*old_corpus, *old_output, *new_corpus, sink));
+                } };
+            } },
+            // One item is the whole corpus converted into columns
+            { "XPathConverter::convert (columns)", [=] {
+                return Fixture{ 1, xpathBytes(), [&in = **inputs](size_t) {
+                    doNotOptimize(hlat::XPathConverter<>::convert(in.xlocs));
+                } };
+            } },
+            // Archetype histogram: json lookups per row against one 32-bit column
+            { "Archetype count (QtLocator rows)", [=] {
+                return Fixture{ 1, xpathBytes(), [&in = **inputs](size_t) {
+                    std::unordered_map<std::string, size_t> counts;
+                    for (auto const& qts : in.qtlocs)
+                        for (auto const& qt : qts) ++counts[qt.meta["archetype"].get_ref<const std::string&>()];
+                    doNotOptimize(counts);
+                } };
+            } },
+            { "Archetype count (columns)", [=] {
+                auto columns = std::make_shared<hlat::QtLocatorColumns>(hlat::XPathConverter<>::convert((*inputs)->xlocs));
+                return Fixture{ 1, xpathBytes(), [columns](size_t) {
+                    std::vector<size_t> counts(columns->archetype_names.size());
+                    for (uint32_t a : columns->archetypes) ++counts[a];
+                    doNotOptimize(counts);
+                } };
+            } },
+        };
+    }
+
+    // -----------------------------------------------------------------------------
+    // Allocation Budgets
+    // -----------------------------------------------------------------------------
+
+    /// Selectors whose steady-state allocation profile is pinned by budgets
+    const std::vector<std::string>& referenceXPaths() {
+        static const std::vector<std::string> xpaths = {
+            "//div[@class='header']/span[1]/text()",
+            "//*[@name='content']//button[2]",
+            "//form/child::container[1]/following-sibling::button",
+            "//button[@name='submit' and @enabled='true']",
+            "//ns:form//*[@type='input']",
+            "//bookstore/book[price>35]/title",
+            "//ul/li[position()<3]",
+            "//section[@id='intro']/descendant::p",
+            "//*[local-name()='svg']/*[name()='path']",
+            "/root/*[2]//child::leaf",
+            "//parent::node()/preceding-sibling::sibling"
+        };
+        return xpaths;
+    }
+
+    /// Per-stage allocation budgets, expressed in terms of the parsed selector's shape
+    struct AllocationBudgets {
+        uint64_t convert_per_step{ 16 };   ///< json meta, UID and container strings
+        uint64_t finalize_per_step{ 12 };  ///< json dump and declaration assembly
+        uint64_t batch_per_selector{ 1 };  ///< Columnar batch conversion of a selector never seen before
+    };
+
+    /// Allocations the parser may make: the step vector, predicate growth and non-SSO strings
+    uint64_t parseBudget(const std::vector<hlat::XLocator>& steps) {
+        const size_t sso = std::string().capacity();
+        auto heap = [&](const std::string& str) -> uint64_t { return str.size() > sso ? 1 : 0; };
+        uint64_t budget = 1;
+        for (auto const& step : steps) {
+            budget += heap(step.axis) + heap(step.tag);
+            if (!step.predicate) continue;
+            budget += step.predicate->conditions.size();
+            for (auto const& cond : step.predicate->conditions) {
+                if (auto a = std::get_if<hlat::AttributePredicate>(&cond))
+                    budget += heap(a->name) + heap(a->value) + heap(a->op);
+            }
+        }
+        return budget;
+    }
+
+    /// Measures every stage on the reference XPaths and checks it against its budget
+    int checkBudgets() {
+        using hlat::instrument::countAllocations;
+        const AllocationBudgets budgets;
+        bool ok = true;
+
+        std::printf("%-58s %-10s %8s %8s %10s\n", "Selector", "Stage", "allocs", "budget", "bytes");
+        std::printf("%s\n", std::string(98, '-').c_str());
+        auto check = [&](const std::string& xpath, const char* stage, hlat::instrument::AllocationDelta d, uint64_t budget) {
+            const bool pass = d.count <= budget;
+            ok = ok && pass;
+            std::printf("%-58s %-10s %8llu %8llu %10llu%s\n", xpath.c_str(), stage,
+                static_cast<unsigned long long>(d.count), static_cast<unsigned long long>(budget),
+                static_cast<unsigned long long>(d.bytes), pass ? "" : "  OVER BUDGET");
+        };
+
+        std::vector<hlat::Token> tokens;
+        for (auto const& xpath : referenceXPaths()) {
+            hlat::XPathLexer(xpath).tokenize(tokens); // warm the reused buffer
+            check(xpath, "tokenize", countAllocations([&] { hlat::XPathLexer(xpath).tokenize(tokens); }), 0);
+
+            auto steps = hlat::XPathParser(tokens).parse();
+            check(xpath, "parse", countAllocations([&] { doNotOptimize(hlat::XPathParser(tokens).parse()); }),
+                parseBudget(steps));
+
+            check(xpath, "convert", countAllocations([&] { doNotOptimize(hlat::XPathConverter(steps).convert()); }),
+                budgets.convert_per_step * steps.size());
+
+            auto qtlocs = hlat::XPathConverter(steps).convert();
+            check(xpath, "finalize", countAllocations([&] { for (auto const& qt : qtlocs) doNotOptimize(qt.finalize()); }),
+                budgets.finalize_per_step * qtlocs.size());
+        }
+
+        // Batch mode: converting a corpus into columns may only allocate as the columns grow,
+        // so the reference XPaths are made distinct by a unique last step and converted once,
+        // after a warm-up on the plain reference corpus
+        constexpr size_t BatchSelectors = 4096;
+        std::vector<std::vector<hlat::XLocator>> warmup, fresh;
+        for (auto const& xpath : referenceXPaths()) {
+            auto toks = hlat::XPathLexer(xpath).tokenize();
+            warmup.push_back(hlat::XPathParser(toks).parse());
+        }
+        for (size_t i = 0; i < BatchSelectors; ++i) {
+            const std::string xpath = referenceXPaths()[i % referenceXPaths().size()] + "/w" + std::to_string(i);
+            auto toks = hlat::XPathLexer(xpath).tokenize();
+            fresh.push_back(hlat::XPathParser(toks).parse());
+        }
+        doNotOptimize(hlat::XPathConverter<>::convert(warmup));
+        check("<" + std::to_string(BatchSelectors) + " fresh selectors, first pass>", "batch",
+            countAllocations([&] { doNotOptimize(hlat::XPathConverter<>::convert(fresh)); }),
+            budgets.batch_per_selector * fresh.size());
+
+        std::printf("\n%s\n", ok ? "All allocation budgets met." : "Allocation budgets exceeded.");
+        return ok ? 0 : 1;
+    }
+
+    // -----------------------------------------------------------------------------
+    // Complexity Checks
+    // -----------------------------------------------------------------------------
+
+    /// A family of pathological selectors parameterized by size
+    struct PathologicalFamily {
+        const char*                                             name;
+        size_t                                                  base; ///< Smallest size measured
+        std::function<std::string(size_t, std::mt19937_64&)>   make;
+    };
+
+    std::vector<PathologicalFamily> pathologicalFamilies() {
+        auto word = [](std::mt19937_64& rng, size_t len) {
+            static constexpr char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_- .";
+            std::string w(len, ' ');
+            for (char& c : w) c = alphabet[rng() % (sizeof(alphabet) - 1)];
+            return w;
+        };
+        return {
+            { "deep path (steps)", 128, [=](size_t n, std::mt19937_64& rng) {
+                std::string x;
+                for (size_t i = 0; i < n; ++i) x += (rng() % 3 ? "/" : "//") + std::string("n") + "[@k='" + word(rng, 4) + "']";
+                return x;
+            } },
+            { "long literal (bytes)", 4096, [=](size_t n, std::mt19937_64& rng) {
+                return "//a[@k='" + word(rng, n) + "']/b";
+            } },
+            { "escaped literal (escapes)", 2048, [](size_t n, std::mt19937_64&) {
+                std::string x = "//a[@k='";
+                for (size_t i = 0; i < n; ++i) x += "\\'";
+                return x + "']";
+            } },
+            { "and-chain (conditions)", 256, [=](size_t n, std::mt19937_64& rng) {
+                std::string x = "//a[";
+                for (size_t i = 0; i < n; ++i) x += (i ? " and @k" : "@k") + std::to_string(i) + "='" + word(rng, 3) + "'";
+                return x + "]";
+            } },
+            { "long tag (bytes)", 4096, [=](size_t n, std::mt19937_64& rng) {
+                std::string tag(n, 'a');
+                for (char& c : tag) c = static_cast<char>('a' + rng() % 26);
+                return "//" + tag + "/" + tag;
+            } },
+            { "fuzz (scaled shape)", 32, [](size_t n, std::mt19937_64& rng) {
+                CorpusOptions shape;
+                shape.seed = rng();
+                shape.min_depth = shape.max_depth = n;
+                shape.max_predicates = 3;
+                shape.value_length = n / 4 + 1;
+                return SyntheticXPathGenerator(shape).next();
+            } },
+        };
+    }
+
+    /// Best-of-N wall time of `fn` in nanoseconds, repeating for at least `budget`
+    template<typename Fn>
+    double bestTime(Fn&& fn, std::chrono::milliseconds budget = std::chrono::milliseconds(40)) {
+        using clock = std::chrono::steady_clock;
+        double best = std::numeric_limits<double>::max();
+        const auto until = clock::now() + budget;
+        int runs = 0;
+        do {
+            const auto start = clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock::now() - start).count());
+        } while (++runs < 3 || clock::now() < until);
+        return best;
+    }
+
+    /// Doubles each pathological input four times and flags stages whose time per unit of work grows
+    ///
+    /// Work is input bytes for tokenize/parse and output bytes for convert/finalize, whose output
+    /// is inherently quadratic in depth because every UID embeds its parent.
+    int checkComplexity(uint64_t seed) {
+        constexpr double max_growth = 3.0; // allowed (ns/work at 16x) / (ns/work at 1x)
+        const auto limits = hlat::XPathLimits::unlimited();
+        bool ok = true;
+
+        std::printf("%-26s %-9s %14s %14s %9s\n", "Family", "Stage", "ns/unit @1x", "ns/unit @16x", "growth");
+        std::printf("%s\n", std::string(76, '-').c_str());
+        for (auto const& family : pathologicalFamilies()) {
+            std::array<double, 4> first{}, last{};
+            for (size_t scale = 1; scale <= 16; scale *= 2) {
+                std::mt19937_64 rng(seed);
+                const std::string xpath = family.make(family.base * scale, rng);
+
+                std::vector<hlat::Token> tokens;
+                const double t_lex = bestTime([&] { hlat::XPathLexer(xpath, limits).tokenize(tokens); });
+                std::vector<hlat::XLocator> steps;
+                const double t_parse = bestTime([&] { steps = hlat::XPathParser(tokens, limits).parse(); });
+                std::vector<hlat::QtLocator> qtlocs;
+                const double t_convert = bestTime([&] { qtlocs = hlat::XPathConverter(steps).convert(); });
+                std::string out;
+                const double t_finalize = bestTime([&] { out.clear(); for (auto const& qt : qtlocs) qt.finalize(out); });
+
+                const double in = static_cast<double>(xpath.size());
+                const double produced = static_cast<double>(out.size());
+                const std::array<double, 4> per_unit{ t_lex / in, t_parse / in, t_convert / produced, t_finalize / produced };
+                if (scale == 1) first = per_unit;
+                last = per_unit;
+            }
+            static const char* stages[] = { "tokenize", "parse", "convert", "finalize" };
+            for (size_t i = 0; i < 4; ++i) {
+                const double growth = last[i] / first[i];
+                const bool pass = growth <= max_growth;
+                ok = ok && pass;
+                std::printf("%-26s %-9s %14.2f %14.2f %9.2f%s\n", family.name, stages[i], first[i], last[i], growth,
+                    pass ? "" : "  SUPERLINEAR");
+            }
+        }
+
+        std::printf("\n%s\n", ok ? "All stages scale linearly." : "Superlinear growth detected.");
+        return ok ? 0 : 1;
+    }
+
+    // -----------------------------------------------------------------------------
+    // Evaluation Checks
+    // -----------------------------------------------------------------------------
+
+    /// A widget and its subtree as plain values, for applying deltas the obvious way
+    struct ModelWidget {
+        std::string                                      tag;
+        std::vector<std::pair<std::string, std::string>> attributes;
+        std::vector<ModelWidget>                         children;
+    };
+
+    /// A random document of `nodes` widgets over a small vocabulary, so that selectors
+    /// often match, siblings share tags and attribute values collide; the rarer "id" values
+    /// make index-seeded plans worthwhile
+    ModelWidget randomWidgets(std::mt19937_64& rng, size_t nodes) {
+        static const char* tags[] = { "a", "b", "c", "ns:a" };
+        static const char* values[] = { "x", "y", "z" };
+        // Parents are either any earlier widget or one of the last few, mixing bushy and deep shapes
+        std::vector<ModelWidget> flat(nodes + 1);
+        std::vector<size_t> parent(nodes + 1, 0);
+        for (size_t i = 1; i <= nodes; ++i) {
+            parent[i] = rng() % 2 ? rng() % i : i - 1 - rng() % std::min<size_t>(i, 4);
+            flat[i].tag = tags[rng() % std::size(tags)];
+            if (rng() % 3) flat[i].attributes.push_back({ "k", values[rng() % std::size(values)] });
+            if (rng() % 2) flat[i].attributes.push_back({ "n", rng() % 8 ? std::to_string(rng() % 6) : "none" });
+            if (rng() % 4) flat[i].attributes.push_back({ "id", "w" + std::to_string(rng() % 32) });
+        }
+        // Children before parents, then back into insertion order
+        for (size_t i = nodes; i > 0; --i) {
+            std::reverse(flat[i].children.begin(), flat[i].children.end());
+            flat[parent[i]].children.push_back(std::move(flat[i]));
+        }
+        std::reverse(flat[0].children.begin(), flat[0].children.end());
+        return std::move(flat[0]);
+    }
+
+    void buildWidget(hlat::WidgetTreeBuilder& builder, const ModelWidget& widget) {
+        builder.open(widget.tag);
+        for (auto const& [name, value] : widget.attributes) builder.attribute(name, value);
+        for (auto const& child : widget.children) buildWidget(builder, child);
+        builder.close();
+    }
+
+    hlat::WidgetTree widgetTreeOf(const ModelWidget& document) {
+        hlat::WidgetTreeBuilder builder;
+        for (auto const& child : document.children) buildWidget(builder, child);
+        return std::move(builder).build();
+    }
+
+    /// Every widget of a model with its parent, in document order; index 0 is the document
+    void preorder(ModelWidget& widget, ModelWidget* parent, std::vector<std::pair<ModelWidget*, ModelWidget*>>& out) {
+        out.push_back({ &widget, parent });
+        for (auto& child : widget.children) preorder(child, &widget, out);
+    }
+
+    /// A random selector over the vocabulary of randomWidgets(), using every axis
+    std::string randomSelector(std::mt19937_64& rng) {
+        static const char* axes[] = { "child", "descendant", "descendant-or-self", "self", "parent", "ancestor",
+            "ancestor-or-self", "following-sibling", "preceding-sibling", "following", "preceding" };
+        static const char* tests[] = { "a", "b", "c", "ns:a", "*", "*", "node()", "text()" };
+        static const char* conditions[] = { "@k='x'", "@k!='y'", "@n>2", "@n<=3", "@missing='x'", "1", "2",
+            "position()<3", "position()>1", "name()='b'", "name()!='c'", "local-name()='a'" };
+        static const char* separators[] = { "/", "//", "//", "" };
+        std::string x;
+        for (size_t step = 0, steps = 1 + rng() % 4; step < steps; ++step) {
+            x += step == 0 ? separators[rng() % std::size(separators)] : separators[rng() % 2];
+            if (rng() % 3 == 0) x += std::string(axes[rng() % std::size(axes)]) + "::";
+            x += tests[rng() % std::size(tests)];
+            auto condition = [&]() -> std::string {
+                if (rng() % 4 == 0) return "@id='w" + std::to_string(rng() % 32) + "'";
+                return conditions[rng() % std::size(conditions)];
+            };
+            if (rng() % 2) {
+                x += "[" + condition();
+                if (rng() % 3 == 0) x += " and " + condition();
+                x += "]";
+            }
+        }
+        return x;
+    }
+
+    /// Evaluates a parsed selector the slow, obvious way
+    ///
+    /// Walks the parser's XLocator steps as XPath reads them, without SelectorCompiler: a
+    /// '//' is its own descendant-or-self::node() step and the step after it runs from every
+    /// node that produced, so positions count children of one parent. Every step walks its
+    /// axis from every context node through parent, child and sibling links and tests
+    /// candidates by their text. A predicate's conditions must all hold; its positions number
+    /// the candidates that pass its other conditions, in axis order. No bytecode, index, plan
+    /// or bound string ID is involved.
+    class ReferenceEvaluator {
+    public:
+        explicit ReferenceEvaluator(const hlat::WidgetTree& tree) : tree_(tree) {}
+
+        std::vector<hlat::NodeId> evaluate(const std::vector<hlat::XLocator>& steps) const {
+            std::vector<hlat::NodeId> current{ hlat::WidgetTree::Document };
+            for (size_t i = 0; i < steps.size(); ++i) {
+                const hlat::XLocator* step = &steps[i];
+                std::string axis = step->axis, tag = step->tag;
+                // The lexer leaves "axis::" on the tag, alone before a relative '*' step or
+                // in front of the name
+                if (tag.ends_with("::") && i + 1 < steps.size() && !steps[i + 1].is_absolute) {
+                    axis = tag.substr(0, tag.size() - 2);
+                    step = &steps[++i];
+                    tag = step->tag;
+                }
+                else if (auto sep = tag.find("::"); sep != std::string::npos) {
+                    axis = tag.substr(0, sep);
+                    tag = tag.substr(sep + 2);
+                }
+                current = apply(axisNamed(axis), step->isDoubleSlash() ? "node()" : tag, step->predicate, current);
+            }
+            return current;
+        }
+
+    private:
+        using Predicate = std::optional<hlat::ComplexPredicate>;
+
+        static hlat::Axis axisNamed(const std::string& name) {
+            using hlat::Axis;
+            static const std::pair<const char*, Axis> axes[] = { { "child", Axis::Child },
+                { "descendant", Axis::Descendant }, { "descendant-or-self", Axis::DescendantOrSelf },
+                { "self", Axis::Self }, { "parent", Axis::Parent }, { "ancestor", Axis::Ancestor },
+                { "ancestor-or-self", Axis::AncestorOrSelf }, { "following-sibling", Axis::FollowingSibling },
+                { "preceding-sibling", Axis::PrecedingSibling }, { "following", Axis::Following },
+                { "preceding", Axis::Preceding } };
+            for (auto const& [text, axis] : axes)
+                if (name == text) return axis;
+            throw std::runtime_error("Unknown axis '" + name + "'");
+        }
+
+        static bool compare(double a, const std::string& op, double b) {
+            if (op == "=")  return a == b;
+            if (op == "!=") return a != b;
+            if (op == "<")  return a < b;
+            if (op == "<=") return a <= b;
+            if (op == ">")  return a > b;
+            return op == ">=" && a >= b;
+        }
+
+        std::vector<hlat::NodeId> apply(hlat::Axis axis, const std::string& tag, const Predicate& predicate,
+            const std::vector<hlat::NodeId>& contexts) const
+        {
+            std::vector<hlat::NodeId> out;
+            for (hlat::NodeId c : contexts) {
+                size_t position = 0;
+                for (hlat::NodeId n : nodesOn(axis, c)) {
+                    if (!test(tag, n) || !passes(predicate, n)) continue;
+                    ++position;
+                    if (positioned(predicate, position)) out.push_back(n);
+                }
+            }
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+            return out;
+        }
+
+        /// Nodes on `axis` from `n`: forward axes in document order, reverse axes nearest first
+        std::vector<hlat::NodeId> nodesOn(hlat::Axis axis, hlat::NodeId n) const {
+            using hlat::Axis;
+            std::vector<hlat::NodeId> out;
+            auto const& node = [&](hlat::NodeId id) -> const hlat::WidgetNode& { return tree_.node(id); };
+            auto descend = [&](auto&& self, hlat::NodeId id) -> void {
+                for (hlat::NodeId c = node(id).first_child; c != hlat::NoNode; c = node(c).next_sibling) {
+                    out.push_back(c);
+                    self(self, c);
+                }
+            };
+            auto above = [&](hlat::NodeId a, hlat::NodeId d) { // a is a proper ancestor of d
+                for (hlat::NodeId p = node(d).parent; p != hlat::NoNode; p = node(p).parent)
+                    if (p == a) return true;
+                return false;
+            };
+            switch (axis) {
+            case Axis::Self: out.push_back(n); break;
+            case Axis::Child:
+                for (hlat::NodeId c = node(n).first_child; c != hlat::NoNode; c = node(c).next_sibling) out.push_back(c);
+                break;
+            case Axis::DescendantOrSelf: out.push_back(n); [[fallthrough]];
+            case Axis::Descendant: descend(descend, n); break;
+            case Axis::AncestorOrSelf: out.push_back(n); [[fallthrough]];
+            case Axis::Ancestor:
+            case Axis::Parent:
+                for (hlat::NodeId p = node(n).parent; p != hlat::NoNode; p = node(p).parent) {
+                    out.push_back(p);
+                    if (axis == Axis::Parent) break;
+                }
+                break;
+            case Axis::FollowingSibling:
+                for (hlat::NodeId s = node(n).next_sibling; s != hlat::NoNode; s = node(s).next_sibling) out.push_back(s);
+                break;
+            case Axis::PrecedingSibling:
+                for (hlat::NodeId s = node(n).prev_sibling; s != hlat::NoNode; s = node(s).prev_sibling) out.push_back(s);
+                break;
+            case Axis::Following:
+                for (hlat::NodeId m = n + 1; m < tree_.size(); ++m)
+                    if (!above(n, m)) out.push_back(m);
+                break;
+            case Axis::Preceding:
+                for (hlat::NodeId m = n; m-- > 0; )
+                    if (!above(m, n)) out.push_back(m);
+                break;
+            }
+            return out;
+        }
+
+        /// node() takes every node, '*' every widget; other functions, like text(), match nothing
+        bool test(const std::string& tag, hlat::NodeId n) const {
+            if (tag == "node()") return true;
+            if (n == hlat::WidgetTree::Document || tag.ends_with("()")) return false;
+            return tag == "*" || tree_.tagName(n) == tag;
+        }
+
+        std::optional<std::string_view> attribute(hlat::NodeId n, std::string_view name) const {
+            for (auto const& a : tree_.attributes(n))
+                if (tree_.strings().view(a.name) == name) return tree_.strings().view(a.value);
+            return std::nullopt;
+        }
+
+        static bool positional(const std::variant<hlat::AttributePredicate, hlat::PositionPredicate>& condition) {
+            auto a = std::get_if<hlat::AttributePredicate>(&condition);
+            return !a || a->name == "position()";
+        }
+
+        /// Whether `n` passes every condition but the positional ones
+        bool passes(const Predicate& predicate, hlat::NodeId n) const {
+            if (!predicate) return true;
+            const std::string_view name = tree_.tagName(n);
+            for (auto const& condition : predicate->conditions) {
+                if (positional(condition)) continue;
+                auto const& a = std::get<hlat::AttributePredicate>(condition);
+                const bool equality = a.op == "=" || a.op == "!=";
+                bool holds;
+                if (a.name == "name()" || a.name == "local-name()") {
+                    const std::string_view text = a.name == "name()" ? name : name.substr(name.rfind(':') + 1);
+                    holds = equality && (text == a.value) == (a.op == "=");
+                }
+                else if (auto v = attribute(n, a.name); equality) holds = v && (*v == a.value) == (a.op == "=");
+                else holds = compare(v ? hlat::eval::toNumber(*v) : std::numeric_limits<double>::quiet_NaN(),
+                    a.op, hlat::eval::toNumber(a.value));
+                if (!holds) return false;
+            }
+            return true;
+        }
+
+        /// Whether the `position`-th candidate passing passes() meets every positional condition
+        static bool positioned(const Predicate& predicate, size_t position) {
+            if (!predicate) return true;
+            for (auto const& condition : predicate->conditions) {
+                if (auto p = std::get_if<hlat::PositionPredicate>(&condition)) {
+                    if (static_cast<double>(position) != p->position) return false;
+                }
+                else if (auto const& a = std::get<hlat::AttributePredicate>(condition); a.name == "position()"
+                    && !compare(static_cast<double>(position), a.op, hlat::eval::toNumber(a.value))) return false;
+            }
+            return true;
+        }
+
+        const hlat::WidgetTree& tree_;
+    };
+
+    /// Tally of one evaluation path against the reference
+    struct EvalCheck {
+        const char* name;
+        size_t      checked{ 0 };
+        size_t      failed{ 0 };
+        std::string first; ///< Selector and tree of the first mismatch
+    };
+
+    /// Compares every evaluation path with ReferenceEvaluator on seeded random trees
+    ///
+    /// Each tree gets a batch of random selectors over every axis, node test and predicate
+    /// kind. Results must be identical for SelectorEvaluator (evaluate and findFirst),
+    /// SelectorSet, SelectorStream (streamable selectors only), ParallelEvaluator (batches,
+    /// and single selectors split into ID ranges on the large trees), a tree opened from its
+    /// serialize() image, and IncrementalEvaluator after each of a series of random deltas,
+    /// which are also applied to a plain copy of the tree that is then rebuilt from scratch.
+    /// WidgetTree::verify must accept every tree built along the way; images with random
+    /// words overwritten must either be rejected or evaluate every selector safely.
+    int checkEval(uint64_t seed) {
+        constexpr size_t Trees = 200, LargeTrees = 2, Selectors = 40, Deltas = 6;
+        std::vector<EvalCheck> checks;
+        for (const char* name : { "SelectorEvaluator::evaluate", "SelectorEvaluator::findFirst", "SelectorSet::match",
+            "SelectorStream", "ParallelEvaluator batch", "ParallelEvaluator::evaluate", "WidgetTree::view",
+            "IncrementalEvaluator", "WidgetTree::verify" })
+            checks.push_back({ name, 0, 0, {} });
+        auto expect = [](EvalCheck& check, bool same, const std::string& xpath, uint64_t tree) {
+            ++check.checked;
+            if (same) return;
+            if (check.failed++ == 0) check.first = xpath + " on tree " + std::to_string(tree);
+        };
+
+        for (uint64_t t = 0; t < Trees + LargeTrees; ++t) {
+            std::mt19937_64 rng(seed + t);
+            ModelWidget model = randomWidgets(rng, t < Trees ? rng() % 300 : 12000 + rng() % 4000);
+            const hlat::WidgetTree tree = widgetTreeOf(model);
+
+            std::vector<std::string> xpaths;
+            std::vector<std::vector<hlat::XLocator>> selectors;
+            std::vector<hlat::SelectorProgram> programs;
+            for (size_t attempt = 0; selectors.size() < Selectors && attempt < 20 * Selectors; ++attempt) {
+                std::string xpath = randomSelector(rng);
+                try {
+                    auto tokens = hlat::XPathLexer(xpath).tokenize();
+                    auto steps = hlat::XPathParser(tokens).parse();
+                    programs.push_back(hlat::SelectorCompiler(steps).compile());
+                    selectors.push_back(std::move(steps));
+                    xpaths.push_back(std::move(xpath));
+                }
+                catch (const std::runtime_error&) {} // outside the supported grammar
+            }
+            std::vector<std::vector<hlat::NodeId>> expected;
+            for (auto const& steps : selectors) expected.push_back(ReferenceEvaluator(tree).evaluate(steps));
+
+            hlat::SelectorEvaluator evaluator(tree);
+            auto image = std::make_shared<std::string>(tree.serialize());
+            hlat::SelectorEvaluator viewed(hlat::WidgetTree::view(*image, image));
+            expect(checks[8], tree.verify() == nullptr && viewed.tree().verify() == nullptr, "(intact image)", t);
+            for (size_t damage = 0; damage < 4; ++damage) {
+                auto damaged = std::make_shared<std::string>(*image);
+                for (size_t w = 0, words = 1 + rng() % 3; w < words; ++w) {
+                    const size_t at = rng() % (damaged->size() / 4) * 4;
+                    const auto word = static_cast<uint32_t>(rng() % 4 ? rng() % 64 : rng());
+                    std::memcpy(damaged->data() + at, &word, 4);
+                }
+                try {
+                    const auto opened = hlat::WidgetTree::view(*damaged, damaged);
+                    if (opened.verify()) continue;
+                    hlat::SelectorEvaluator evaluator(opened);
+                    for (auto const& steps : selectors) doNotOptimize(evaluator.evaluate(steps));
+                }
+                catch (const std::runtime_error&) {}
+            }
+            hlat::SelectorSet set(tree);
+            for (size_t i = 0; i < selectors.size(); ++i) {
+                set.add(selectors[i]);
+                expect(checks[0], evaluator.evaluate(selectors[i]) == expected[i], xpaths[i], t);
+                expect(checks[1], evaluator.findFirst(selectors[i]) == (expected[i].empty() ? hlat::NoNode : expected[i].front()),
+                    xpaths[i], t);
+                expect(checks[6], viewed.evaluate(selectors[i]) == expected[i], xpaths[i], t);
+            }
+            const auto matched = set.match();
+            for (size_t i = 0; i < selectors.size(); ++i) expect(checks[2], matched[i] == expected[i], xpaths[i], t);
+
+            std::vector<size_t> streamed;
+            std::vector<std::vector<hlat::NodeId>> stream_results(selectors.size());
+            hlat::SelectorStream stream([&](size_t s, hlat::NodeId n) { stream_results[streamed[s]].push_back(n); });
+            for (size_t i = 0; i < programs.size(); ++i) {
+                try { stream.add(programs[i]); streamed.push_back(i); }
+                catch (const std::runtime_error&) {} // not streamable
+            }
+            replayEvents(tree, stream);
+            for (size_t i : streamed) expect(checks[3], stream_results[i] == expected[i], xpaths[i], t);
+
+            hlat::ParallelEvaluator parallel(tree, 4);
+            const auto batch = parallel.evaluate(std::span<const std::vector<hlat::XLocator>>(selectors));
+            for (size_t i = 0; i < selectors.size(); ++i) {
+                expect(checks[4], batch[i] == expected[i], xpaths[i], t);
+                expect(checks[5], parallel.evaluate(selectors[i]) == expected[i], xpaths[i], t);
+            }
+
+            if (t >= Trees) continue; // rebuilding the large trees after every delta adds little
+            hlat::IncrementalEvaluator incremental(tree);
+            for (auto const& steps : selectors) incremental.add(steps);
+            for (size_t d = 0; d < Deltas; ++d) {
+                std::vector<std::pair<ModelWidget*, ModelWidget*>> widgets;
+                preorder(model, nullptr, widgets);
+                const auto size = static_cast<hlat::NodeId>(widgets.size());
+                const auto node = static_cast<hlat::NodeId>(rng() % size);
+                ModelWidget* widget = widgets[node].first;
+                ModelWidget* parent = widgets[node].second;
+                auto idOf = [&](const ModelWidget* w) {
+                    return static_cast<hlat::NodeId>(std::find_if(widgets.begin(), widgets.end(),
+                        [&](auto const& entry) { return entry.first == w; }) - widgets.begin());
+                };
+                std::string delta;
+                switch (rng() % 3) {
+                case 0:
+                {
+                    // Before one of the children, or after the last
+                    const size_t at = rng() % (widget->children.size() + 1);
+                    const hlat::NodeId before = at == widget->children.size() ? hlat::NoNode : idOf(&widget->children[at]);
+                    ModelWidget fragment = randomWidgets(rng, 1 + rng() % 5);
+                    incremental.insert(node, before, widgetTreeOf(fragment));
+                    widget->children.insert(widget->children.begin() + static_cast<std::ptrdiff_t>(at),
+                        fragment.children.begin(), fragment.children.end());
+                    delta = "insert under " + std::to_string(node);
+                    break;
+                }
+                case 1:
+                {
+                    if (node == hlat::WidgetTree::Document) continue;
+                    incremental.remove(node);
+                    auto& siblings = parent->children;
+                    siblings.erase(siblings.begin() + (widget - siblings.data()));
+                    delta = "remove " + std::to_string(node);
+                    break;
+                }
+                default:
+                {
+                    if (node == hlat::WidgetTree::Document) continue;
+                    static const char* values[] = { "x", "y", "3", "5" };
+                    const std::string name = rng() % 2 ? "k" : "n";
+                    auto& attributes = widget->attributes;
+                    auto it = std::find_if(attributes.begin(), attributes.end(), [&](auto const& a) { return a.first == name; });
+                    if (rng() % 4 == 0) {
+                        incremental.setAttribute(node, name, std::nullopt);
+                        if (it != attributes.end()) attributes.erase(it);
+                    }
+                    else {
+                        const std::string value = values[rng() % std::size(values)];
+                        incremental.setAttribute(node, name, value);
+                        if (it != attributes.end()) it->second = value;
+                        else attributes.push_back({ name, value });
+                    }
+                    delta = "set @" + name + " of " + std::to_string(node);
+                    break;
+                }
+                }
+                const hlat::WidgetTree rebuilt = widgetTreeOf(model);
+                expect(checks[8], incremental.tree().verify() == nullptr, "(after " + delta + ")", t);
+                for (size_t i = 0; i < programs.size(); ++i) {
+                    const auto results = incremental.results(i);
+                    const auto reference = ReferenceEvaluator(rebuilt).evaluate(selectors[i]);
+                    expect(checks[7], std::equal(results.begin(), results.end(), reference.begin(), reference.end()),
+                        xpaths[i] + " after " + delta, t);
+                }
+            }
+        }
+
+        bool ok = true;
+        std::printf("%-34s %10s %12s\n", "Evaluation path", "checked", "mismatches");
+        std::printf("%s\n", std::string(58, '-').c_str());
+        for (auto const& check : checks) {
+            ok = ok && check.failed == 0 && check.checked > 0;
+            std::printf("%-34s %10zu %12zu%s\n", check.name, check.checked, check.failed,
+                check.failed ? ("  first: " + check.first).c_str() : "");
+        }
+        std::printf("\n%s\n", ok ? "All evaluation paths agree with the reference." : "Evaluation mismatches found.");
+        return ok ? 0 : 1;
+    }
+
+    // -----------------------------------------------------------------------------
+    // Command Line
+    // -----------------------------------------------------------------------------
+
+    struct Options {
+        CorpusOptions corpus{};
+        TreeOptions   tree{};
+        double        min_time{ 0.5 };
+        std::string   filter;
+        bool          json{ false };
+        bool          check_budgets{ false };
+        bool          check_complexity{ false };
+        bool          check_eval{ false };
+    };
+
+    [[noreturn]] void usage(int code) {
+        (code ? std::cerr : std::cout)
+            << "Usage: hlat_bench [options]\n"
+            << "  --selectors <n>       Corpus size (default: 10000)\n"
+            << "  --seed <n>            Generator seed (default: 42)\n"
+            << "  --depth <min>:<max>   Steps per selector (default: 2:6)\n"
+            << "  --predicates <n>      Max predicate conditions per step (default: 2)\n"
+            << "  --value-len <n>       Attribute value length (default: 8)\n"
+            << "  --vocab <n>           Distinct tag names (default: 32)\n"
+            << "  --tree-nodes <n>      Widget tree size for evaluation benchmarks (default: 100000)\n"
+            << "  --min-time <s>        Minimum measuring time per benchmark (default: 0.5)\n"
+            << "  --filter <text>       Only run benchmarks whose name contains <text>\n"
+            << "  --json                Emit results as JSON\n"
+            << "  --check-budgets       Assert per-stage allocation budgets on reference XPaths\n"
+            << "  --check-complexity    Flag stages whose cost grows superlinearly on pathological inputs\n"
+            << "  --check-eval          Compare every evaluation path with a naive evaluator on random trees\n";
+        std::exit(code);
+    }
+
+    Options parseArgs(int argc, char** argv) {
+        Options opts;
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) usage(2);
+                return argv[++i];
+            };
+            if (arg == "-h" || arg == "--help") usage(0);
+            else if (arg == "--selectors") opts.corpus.selectors = std::stoull(value());
+            else if (arg == "--seed") opts.corpus.seed = std::stoull(value());
+            else if (arg == "--depth") {
+                std::string v = value();
+                auto colon = v.find(':');
+                opts.corpus.min_depth = std::stoull(v.substr(0, colon));
+                opts.corpus.max_depth = colon == std::string::npos ? opts.corpus.min_depth : std::stoull(v.substr(colon + 1));
+            }
+            else if (arg == "--predicates") opts.corpus.max_predicates = std::stoull(value());
+            else if (arg == "--value-len") opts.corpus.value_length = std::stoull(value());
+            else if (arg == "--vocab") opts.corpus.vocabulary = std::stoull(value());
+            else if (arg == "--tree-nodes") opts.tree.nodes = std::stoull(value());
+            else if (arg == "--min-time") opts.min_time = std::stod(value());
+            else if (arg == "--filter") opts.filter = value();
+            else if (arg == "--json") opts.json = true;
+            else if (arg == "--check-budgets") opts.check_budgets = true;
+            else if (arg == "--check-complexity") opts.check_complexity = true;
+            else if (arg == "--check-eval") opts.check_eval = true;
+            else usage(2);
+        }
+        if (opts.corpus.selectors == 0 || opts.corpus.min_depth == 0) usage(2);
+        opts.tree.seed = opts.corpus.seed;
+        return opts;
+    }
+
+    void printText(const std::vector<Result>& results) {
+        std::printf("%-42s %14s %12s %14s %14s\n", "Benchmark", "Iterations", "ns/item", "MB/s", "allocs/item");
+        std::printf("%s\n", std::string(100, '-').c_str());
+        for (auto const& r : results) {
+            std::printf("%-42s %14llu %12.1f %14.2f %14.2f\n", r.name.c_str(),
+                static_cast<unsigned long long>(r.iterations), r.ns_per_item,
+                r.bytes_per_second / 1e6, r.allocs_per_item);
+        }
+    }
+
+    void printJson(const Options& opts, const std::vector<Result>& results) {
+        hlat::json out;
+        out["corpus"] = {
+            { "selectors", opts.corpus.selectors }, { "seed", opts.corpus.seed },
+            { "min_depth", opts.corpus.min_depth }, { "max_depth", opts.corpus.max_depth },
+            { "max_predicates", opts.corpus.max_predicates }, { "value_length", opts.corpus.value_length },
+            { "vocabulary", opts.corpus.vocabulary }
+        };
+        out["tree"] = { { "nodes", opts.tree.nodes }, { "selectors", opts.tree.selectors } };
+        out["benchmarks"] = hlat::json::array();
+        for (auto const& r : results) {
+            out["benchmarks"].push_back({
+                { "name", r.name }, { "iterations", r.iterations }, { "ns_per_item", r.ns_per_item },
+                { "bytes_per_second", r.bytes_per_second }, { "allocs_per_item", r.allocs_per_item }
+            });
+        }
+        std::cout << out.dump(4) << "\n";
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts = parseArgs(argc, argv);
+    try {
+        if (opts.check_budgets) return checkBudgets();
+        if (opts.check_complexity) return checkComplexity(opts.corpus.seed);
+        if (opts.check_eval) return checkEval(opts.corpus.seed);
+
+        std::vector<Result> results;
+        auto runAll = [&](const std::vector<Benchmark>& benchmarks) {
+            for (auto const& bm : benchmarks) {
+                if (!opts.filter.empty() && bm.name.find(opts.filter) == std::string::npos) continue;
+                const Fixture fixture = bm.setup();
+                if (fixture.items == 0) continue;
+                results.push_back(measure(bm.name, fixture, opts.min_time));
+            }
+        };
+        runAll(stageBenchmarks(opts.corpus));
+        runAll(evaluationBenchmarks(opts.tree));
+
+        if (opts.json) printJson(opts, results);
+        else printText(results);
+        return 0;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "hlat_bench: " << e.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,421 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Selector Bytecode
+ |  ---------------------------------------------------------------------------
+ |  Lowers parsed selectors (std::vector<XLocator>) into compact word code.
+ |  Features:
+ |      * One header per step with axis, node test and jump lengths
+ |      * Predicate guards as flat instructions over literal indices
+ |      * Tree-independent: literals are bound to a tree's strings later
+ |      * Versioned binary serialization for caching across runs
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat.hpp"
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace hlat {
+
+    /// XPath axes understood by the evaluator
+    enum class Axis : uint8_t {
+        Child,
+        Descendant,
+        DescendantOrSelf,
+        Self,
+        Parent,
+        Ancestor,
+        AncestorOrSelf,
+        FollowingSibling,
+        PrecedingSibling,
+        Following,
+        Preceding
+    };
+
+    namespace eval {
+
+        /// Maps an XPath axis name to its Axis; throws for the attribute and namespace axes
+        inline Axis axisFromName(std::string_view name) {
+            if (name == "child")              return Axis::Child;
+            if (name == "descendant")         return Axis::Descendant;
+            if (name == "descendant-or-self") return Axis::DescendantOrSelf;
+            if (name == "self")               return Axis::Self;
+            if (name == "parent")             return Axis::Parent;
+            if (name == "ancestor")           return Axis::Ancestor;
+            if (name == "ancestor-or-self")   return Axis::AncestorOrSelf;
+            if (name == "following-sibling")  return Axis::FollowingSibling;
+            if (name == "preceding-sibling")  return Axis::PrecedingSibling;
+            if (name == "following")          return Axis::Following;
+            if (name == "preceding")          return Axis::Preceding;
+            throw std::runtime_error("Unsupported axis '" + std::string(name) + "'");
+        }
+
+        /// Parses a numeric literal or attribute value; NaN if it is not a number
+        inline double toNumber(std::string_view s) {
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+            double v = std::numeric_limits<double>::quiet_NaN();
+            auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+            return ec == std::errc{} && end == s.data() + s.size() ? v : std::numeric_limits<double>::quiet_NaN();
+        }
+
+        /// Comparison operators of predicate conditions
+        enum class Op : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+
+        inline Op opFromText(std::string_view op) {
+            if (op == "=")  return Op::Eq;
+            if (op == "!=") return Op::Ne;
+            if (op == "<")  return Op::Lt;
+            if (op == "<=") return Op::Le;
+            if (op == ">")  return Op::Gt;
+            if (op == ">=") return Op::Ge;
+            throw std::runtime_error("Unsupported operator '" + std::string(op) + "'");
+        }
+
+        /// Applies a relational operator to numbers; false whenever either side is NaN
+        inline bool compare(double lhs, Op op, double rhs) {
+            switch (op) {
+            case Op::Eq: return lhs == rhs;
+            case Op::Ne: return lhs != rhs;
+            case Op::Lt: return lhs < rhs;
+            case Op::Le: return lhs <= rhs;
+            case Op::Gt: return lhs > rhs;
+            case Op::Ge: return lhs >= rhs;
+            }
+            return false;
+        }
+
+        /// The part of a tag after its namespace prefix, as local-name() reports it
+        inline std::string_view localName(std::string_view tag) {
+            if (auto colon = tag.rfind(':'); colon != std::string_view::npos) tag.remove_prefix(colon + 1);
+            return tag;
+        }
+
+        /// What a step's node test accepts
+        enum class NodeTest : uint8_t {
+            Name,    ///< Elements with one tag
+            Element, ///< '*': every element
+            Any,     ///< node(): every node, including the document node
+            None     ///< Never matches (unknown tag, text(), ...)
+        };
+
+    } // namespace eval
+
+    namespace bc {
+
+        /// Instruction opcodes; the low byte of an instruction's first word
+        ///
+        /// Operands follow in the next words. Strings are literal indices in a
+        /// SelectorProgram and tree StringIds once bound (see SelectorEvaluator::bind()).
+        enum class Opcode : uint8_t {
+            Step,     ///< axis | test << 8 | per_parent << 16; tag, guard length, position length
+            Fail,     ///< Never holds
+            AttrEq,   ///< name, value: attribute equals value
+            AttrNe,   ///< name, value: attribute present and different
+            AttrCmp,  ///< op; name, number (2 words): attribute compared numerically
+            NameEq,   ///< value: name() equals value
+            NameNe,   ///< value: name() differs from value
+            LocalEq,  ///< text: local-name() equals text
+            LocalNe,  ///< text: local-name() differs from text
+            TagIn,    ///< count; tags...: the node's tag is one of them (local-name() bound to a tree)
+            TagNotIn, ///< count; tags...: the node's tag is none of them
+            Position  ///< op; number (2 words): the candidate's position compared
+        };
+
+        /// Marks a missing literal, such as the tag of a '*' step
+        inline constexpr uint32_t NoLiteral = UINT32_MAX;
+
+        /// Words of a step header before its guard
+        inline constexpr size_t StepHeader = 4;
+
+        constexpr uint32_t instr(Opcode op, uint32_t arg = 0) { return static_cast<uint32_t>(op) | arg << 8; }
+        constexpr Opcode opcode(uint32_t word) { return static_cast<Opcode>(word & 0xff); }
+        constexpr uint32_t argument(uint32_t word) { return word >> 8; }
+
+        /// Words taken by the instruction starting with `word`, operands included
+        constexpr size_t length(uint32_t word) {
+            switch (opcode(word)) {
+            case Opcode::Step:     return StepHeader;
+            case Opcode::Fail:     return 1;
+            case Opcode::AttrEq:
+            case Opcode::AttrNe:   return 3;
+            case Opcode::AttrCmp:  return 4;
+            case Opcode::NameEq:
+            case Opcode::NameNe:
+            case Opcode::LocalEq:
+            case Opcode::LocalNe:  return 2;
+            case Opcode::TagIn:
+            case Opcode::TagNotIn: return 1 + size_t{ argument(word) };
+            case Opcode::Position: return 3;
+            }
+            return 1;
+        }
+
+        inline void pushNumber(std::vector<uint32_t>& code, double v) {
+            const auto bits = std::bit_cast<uint64_t>(v);
+            code.push_back(static_cast<uint32_t>(bits));
+            code.push_back(static_cast<uint32_t>(bits >> 32));
+        }
+
+        inline double number(const uint32_t* words) {
+            return std::bit_cast<double>(uint64_t{ words[0] } | uint64_t{ words[1] } << 32);
+        }
+
+    } // namespace bc
+
+    /// A selector lowered to bytecode, independent of any tree
+    ///
+    /// `code` is a sequence of steps. Each step is a four-word header followed by its guard
+    /// (attribute and name conditions, all of which must hold) and its position conditions,
+    /// counted over the guard's survivors:
+    ///
+    ///     Step(axis, test, per_parent)  tag  guard_len  position_len  guard...  positions...
+    ///
+    /// The two lengths are the jump targets of the interpreter: a step ends at
+    /// `pc + StepHeader + guard_len + position_len`. Tags, names and values are indices into
+    /// `strings`, so a program can be serialized once and bound to every new snapshot.
+    struct SelectorProgram {
+        /// Bumped whenever the instruction set or layout changes
+        static constexpr uint32_t Version = 1;
+
+        bool                     absolute{ false }; ///< Starts from the document node
+        std::vector<uint32_t>    code;
+        std::vector<std::string> strings;           ///< Literal pool
+
+        bool operator==(const SelectorProgram&) const = default;
+
+        /// Encodes the program as little-endian words: magic, version, flags, literals, code
+        std::string serialize() const {
+            std::string out;
+            auto put = [&](uint32_t w) { for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(w >> (8 * i))); };
+            out.append(Magic, 4);
+            put(Version);
+            put(absolute ? 1 : 0);
+            put(static_cast<uint32_t>(strings.size()));
+            for (auto const& s : strings) {
+                put(static_cast<uint32_t>(s.size()));
+                out += s;
+            }
+            put(static_cast<uint32_t>(code.size()));
+            for (uint32_t w : code) put(w);
+            return out;
+        }
+
+        /// Decodes and validates a serialized program; throws on malformed or foreign input
+        static SelectorProgram deserialize(std::string_view bytes) {
+            size_t at = 0;
+            auto fail = [](const char* what) -> void { throw std::runtime_error(std::string("Malformed selector program: ") + what); };
+            auto get = [&]() {
+                if (bytes.size() - at < 4) fail("truncated");
+                uint32_t w = 0;
+                for (int i = 0; i < 4; ++i) w |= uint32_t{ static_cast<unsigned char>(bytes[at + i]) } << (8 * i);
+                at += 4;
+                return w;
+            };
+            if (bytes.substr(0, 4) != std::string_view(Magic, 4)) fail("bad magic");
+            at = 4;
+            if (get() != Version) fail("unsupported version");
+
+            SelectorProgram p;
+            p.absolute = get() != 0;
+            const uint32_t n_strings = get();
+            if (n_strings > (bytes.size() - at) / 4) fail("truncated");
+            p.strings.reserve(n_strings);
+            for (uint32_t i = 0; i < n_strings; ++i) {
+                const uint32_t len = get();
+                if (bytes.size() - at < len) fail("truncated");
+                p.strings.emplace_back(bytes.substr(at, len));
+                at += len;
+            }
+            const uint32_t n_code = get();
+            if (n_code > (bytes.size() - at) / 4) fail("truncated");
+            p.code.reserve(n_code);
+            for (uint32_t i = 0; i < n_code; ++i) p.code.push_back(get());
+            if (at != bytes.size()) fail("trailing bytes");
+            if (const char* error = p.verify()) fail(error);
+            return p;
+        }
+
+        /// Checks the code's structure; returns a description of the first defect, or nullptr
+        const char* verify() const {
+            auto literal = [&](uint32_t i) { return i < strings.size(); };
+            for (size_t pc = 0; pc < code.size(); ) {
+                if (code.size() - pc < bc::StepHeader || bc::opcode(code[pc]) != bc::Opcode::Step) return "expected a step";
+                const uint32_t arg = bc::argument(code[pc]);
+                if ((arg & 0xff) > static_cast<uint32_t>(Axis::Preceding)
+                    || (arg >> 8 & 0xff) > static_cast<uint32_t>(eval::NodeTest::None) || arg >> 16 > 1)
+                    return "bad step header";
+                const bool named = static_cast<eval::NodeTest>(arg >> 8 & 0xff) == eval::NodeTest::Name;
+                if (named != literal(code[pc + 1])) return "bad tag";
+                const size_t guard = code[pc + 2], positions = code[pc + 3];
+                const size_t body = pc + bc::StepHeader;
+                if (guard > code.size() - body || positions > code.size() - body - guard) return "step overruns code";
+
+                for (size_t i = body, end = body + guard + positions; i < end; ) {
+                    const uint32_t w = code[i];
+                    const size_t len = bc::length(w);
+                    const bool in_guard = i < body + guard;
+                    if (len > end - i || (bc::opcode(w) == bc::Opcode::Position) == in_guard) return "bad instruction";
+                    switch (bc::opcode(w)) {
+                    case bc::Opcode::Fail:     break;
+                    case bc::Opcode::AttrEq:
+                    case bc::Opcode::AttrNe:   if (!literal(code[i + 1]) || !literal(code[i + 2])) return "bad literal"; break;
+                    case bc::Opcode::AttrCmp:  if (!literal(code[i + 1]) || bc::argument(w) > 5) return "bad operand"; break;
+                    case bc::Opcode::NameEq:
+                    case bc::Opcode::NameNe:
+                    case bc::Opcode::LocalEq:
+                    case bc::Opcode::LocalNe:  if (!literal(code[i + 1])) return "bad literal"; break;
+                    case bc::Opcode::Position: if (bc::argument(w) > 5) return "bad operand"; break;
+                    default:                   return "bad opcode";
+                    }
+                    i += len;
+                }
+                pc = body + guard + positions;
+            }
+            return nullptr;
+        }
+
+    private:
+        static constexpr char Magic[4] = { 'H', 'L', 'B', 'C' };
+    };
+
+    /// Lowers a parsed selector into a SelectorProgram
+    ///
+    /// Resolves the lexer's conventions once, so evaluation never sees them: multi-letter
+    /// axes kept on the tag ("child::container", "preceding::" + "*") become step axes, and a
+    /// '//' followed by a child step is fused into one per-parent descendant step.
+    class SelectorCompiler {
+    public:
+        explicit SelectorCompiler(const std::vector<XLocator>& steps)
+            : steps_(steps) {}
+
+        /// Compiles the selector; throws for axes, operators and functions the evaluator lacks
+        SelectorProgram compile() {
+            program_ = {};
+            literals_.clear();
+            program_.absolute = !steps_.empty() && steps_.front().is_absolute;
+            bool after_gap = false;
+            size_t last_step = 0;
+            for (size_t i = 0; i < steps_.size(); ++i) {
+                const XLocator* step = &steps_[i];
+                std::string_view axis = step->axis, tag = step->tag;
+                // "preceding::*" lexes as the tag "preceding::" followed by a relative '*' step
+                if (tag.ends_with("::") && i + 1 < steps_.size() && !steps_[i + 1].is_absolute) {
+                    axis = tag.substr(0, tag.size() - 2);
+                    step = &steps_[++i];
+                    tag = step->tag;
+                }
+                // The lexer keeps multi-letter axes on the tag ("child::container")
+                else if (auto sep = tag.find("::"); sep != std::string_view::npos && axis == "child") {
+                    axis = tag.substr(0, sep);
+                    tag = tag.substr(sep + 2);
+                }
+                Axis resolved = eval::axisFromName(axis);
+
+                // '//' followed by a child step is a descendant lookup: replace the '//' step
+                const bool fused = after_gap && resolved == Axis::Child;
+                if (fused) {
+                    program_.code.resize(last_step);
+                    resolved = Axis::Descendant;
+                }
+                after_gap = step->isDoubleSlash();
+                last_step = program_.code.size();
+                emitStep(*step, resolved, tag, fused);
+            }
+            return std::move(program_);
+        }
+
+    private:
+        void emitStep(const XLocator& step, Axis axis, std::string_view tag, bool per_parent) {
+            using eval::NodeTest;
+            // '//' is descendant-or-self::node(), which includes the document node
+            NodeTest test = NodeTest::Name;
+            if (step.isDoubleSlash() || tag == "node()") test = NodeTest::Any;
+            else if (tag == "*") test = NodeTest::Element;
+            else if (tag.ends_with("()")) test = NodeTest::None;
+
+            auto& code = program_.code;
+            const size_t header = code.size();
+            code.push_back(bc::instr(bc::Opcode::Step,
+                static_cast<uint32_t>(axis) | static_cast<uint32_t>(test) << 8 | uint32_t{ per_parent } << 16));
+            code.push_back(test == NodeTest::Name ? literal(tag) : bc::NoLiteral);
+            code.push_back(0);
+            code.push_back(0);
+
+            // Guard conditions first, then positions, each in source order
+            const size_t guard = code.size();
+            if (step.predicate) {
+                for (bool positional : { false, true }) {
+                    if (positional) code[header + 2] = static_cast<uint32_t>(code.size() - guard);
+                    for (auto const& cond : step.predicate->conditions)
+                        emitCondition(cond, positional);
+                }
+            }
+            code[header + 3] = static_cast<uint32_t>(code.size() - guard - code[header + 2]);
+        }
+
+        /// Emits `cond` if it is a position condition and `positional` is set, or neither is
+        void emitCondition(const std::variant<AttributePredicate, PositionPredicate>& cond, bool positional) {
+            using bc::Opcode;
+            auto& code = program_.code;
+            if (auto p = std::get_if<PositionPredicate>(&cond)) {
+                if (!positional) return;
+                code.push_back(bc::instr(Opcode::Position, static_cast<uint32_t>(eval::Op::Eq)));
+                bc::pushNumber(code, p->position);
+                return;
+            }
+            auto const& a = std::get<AttributePredicate>(cond);
+            if ((a.name == "position()") != positional) return;
+            const eval::Op op = eval::opFromText(a.op);
+            const bool equality = op == eval::Op::Eq || op == eval::Op::Ne;
+            if (positional) {
+                code.push_back(bc::instr(Opcode::Position, static_cast<uint32_t>(op)));
+                bc::pushNumber(code, eval::toNumber(a.value));
+            }
+            else if (a.name == "name()" || a.name == "local-name()") {
+                // Names are never numbers: relational comparisons fail
+                if (!equality) { code.push_back(bc::instr(Opcode::Fail)); return; }
+                const bool local = a.name == "local-name()";
+                code.push_back(bc::instr(op == eval::Op::Eq
+                    ? (local ? Opcode::LocalEq : Opcode::NameEq) : (local ? Opcode::LocalNe : Opcode::NameNe)));
+                code.push_back(literal(a.value));
+            }
+            else if (a.name.ends_with("()")) throw std::runtime_error("Unsupported function '" + a.name + "'");
+            else if (equality) {
+                code.push_back(bc::instr(op == eval::Op::Eq ? Opcode::AttrEq : Opcode::AttrNe));
+                code.push_back(literal(a.name));
+                code.push_back(literal(a.value));
+            }
+            else {
+                code.push_back(bc::instr(Opcode::AttrCmp, static_cast<uint32_t>(op)));
+                code.push_back(literal(a.name));
+                bc::pushNumber(code, eval::toNumber(a.value));
+            }
+        }
+
+        /// Index of `s` in the literal pool, adding it on first use; expected O(|s|)
+        ///
+        /// `s` always points into steps_, which outlive the compile, so the index can key on it.
+        uint32_t literal(std::string_view s) {
+            auto [it, added] = literals_.try_emplace(s, static_cast<uint32_t>(program_.strings.size()));
+            if (added) program_.strings.emplace_back(s);
+            return it->second;
+        }
+
+        const std::vector<XLocator>&                   steps_;
+        SelectorProgram                                program_;
+        std::unordered_map<std::string_view, uint32_t> literals_; ///< Pool index by text
+    };
+
+} // namespace hlat
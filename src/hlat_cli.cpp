@@ -0,0 +1,287 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Command Line Tool
+ |  ---------------------------------------------------------------------------
+ |  Converts a newline-delimited XPath file into Qt Python declarations.
+ |
+ |  Usage: hlat [options] <input.xpaths>
+ |      -o, --output <file>   Output file ("-" for stdout, the default)
+ |      -j, --threads <n>     Worker threads (default: hardware concurrency)
+ |      --chunk <n>           Lines per chunk (default: 4096)
+ |      --in-flight <n>       Chunk slots bounding memory (default: 4 per thread)
+ |      --dedup               Declare shared containers once (single-threaded)
+ |      --stats               Report pipeline queue occupancy on stderr
+ |      --profile             Report per-stage latency/allocation histograms on stderr
+ |      --trace <file>        Write per-selector stage spans as Chrome trace-event JSON
+ |                            (not with --profile)
+ |      --cache <file>        Reuse declarations of selectors converted by earlier runs
+ |      --cache-prune         Drop cached selectors this run did not see
+ |      --old <file>          Corpus of an earlier run; with --old-output, convert only new selectors
+ |      --old-output <file>   Output of that run, patched into the new output (may equal -o)
+ |
+ |  Build: g++ -std=c++20 -O2 -pthread -Isrc src/hlat_cli.cpp -o hlat
+ |  Add -DHLAT_COUNT_ALLOCATIONS for allocation counts in --profile. That
+ |  replaces the global operator new with a counting one for every run, so
+ |  release builds leave it out.
+ *============================================================================*/
+
+#include "hlat_batch.hpp"
+#include "hlat_corpusdiff.hpp"
+#include "hlat_diskcache.hpp"
+#include "hlat_instrument.hpp"
+
+#include <charconv>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <system_error>
+
+namespace {
+
+    template<typename Instrumentation = hlat::NoInstrumentation>
+    using Pipeline = hlat::QtPythonDeclarationsFrom<
+        hlat::XPathLexerFn,
+        hlat::XPathParserFn,
+        hlat::QtLocatorBuilderFn,
+        hlat::QtLocatorEmitterFn,
+        hlat::HeuristicQtClassifier,
+        Instrumentation
+    >;
+
+    template<typename Instrumentation = hlat::NoInstrumentation>
+    Pipeline<Instrumentation> makePipeline(Instrumentation instrumentation = {}) {
+        return Pipeline<Instrumentation>{
+            [](std::string_view xpath) { return hlat::XPathLexer(xpath).tokenize(); },
+            [](auto const& toks) { return hlat::XPathParser(toks).parse(); },
+            [](auto const& xlocs) { return hlat::XPathConverter(xlocs).convert(); },
+            [](std::vector<hlat::QtLocator>& qtlocs) -> std::string {
+                return std::accumulate(
+                    qtlocs.begin(), qtlocs.end(),
+                    std::string{},
+                    [](std::string acc, auto& qt) {
+                        return std::move(acc) + qt.finalize();
+                    }
+                );
+            },
+            std::move(instrumentation)
+        };
+    }
+
+    struct Options {
+        std::string        input;
+        std::string        output{ "-" };
+        hlat::BatchOptions batch{};
+        bool               dedup{ false };
+        bool               stats{ false };
+        bool               profile{ false };
+        std::string        trace;
+        std::string        cache;
+        bool               cache_prune{ false };
+        std::string        old_corpus;
+        std::string        old_output;
+    };
+
+    [[noreturn]] void usage(int code) {
+        (code ? std::cerr : std::cout)
+            << "Usage: hlat [options] <input.xpaths>\n"
+            << "  -o, --output <file>   Output file (\"-\" for stdout, the default)\n"
+            << "  -j, --threads <n>     Worker threads (default: hardware concurrency)\n"
+            << "  --chunk <n>           Lines per chunk (default: 4096)\n"
+            << "  --in-flight <n>       Chunk slots bounding memory (default: 4 per thread)\n"
+            << "  --dedup               Declare shared containers once (single-threaded)\n"
+            << "  --stats               Report pipeline queue occupancy on stderr\n"
+            << "  --profile             Report per-stage latency/allocation histograms on stderr\n"
+            << "  --trace <file>        Write per-selector stage spans as Chrome trace-event JSON\n"
+            << "                        (not with --profile)\n"
+            << "  --cache <file>        Reuse declarations of selectors converted by earlier runs\n"
+            << "  --cache-prune         Drop cached selectors this run did not see\n"
+            << "  --old <file>          Corpus of an earlier run; with --old-output, convert only new selectors\n"
+            << "  --old-output <file>   Output of that run, patched into the new output (may equal -o)\n";
+        std::exit(code);
+    }
+
+    /// Parses a whole decimal option value; anything else, or a value out of range, is a usage error
+    template<typename T>
+    T count(std::string_view text) {
+        T v{};
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), v);
+        if (ec != std::errc{} || end != text.data() + text.size()) usage(2);
+        return v;
+    }
+
+    Options parseArgs(int argc, char** argv) {
+        Options opts;
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) usage(2);
+                return argv[++i];
+            };
+            if (arg == "-h" || arg == "--help") usage(0);
+            else if (arg == "-o" || arg == "--output") opts.output = value();
+            else if (arg == "-j" || arg == "--threads") opts.batch.threads = count<unsigned>(value());
+            else if (arg == "--chunk") opts.batch.chunk_lines = count<size_t>(value());
+            else if (arg == "--in-flight") opts.batch.chunks_in_flight = count<size_t>(value());
+            else if (arg == "--dedup") opts.dedup = true;
+            else if (arg == "--stats") opts.stats = true;
+            else if (arg == "--profile") opts.profile = true;
+            else if (arg == "--trace") opts.trace = value();
+            else if (arg == "--cache") opts.cache = value();
+            else if (arg == "--cache-prune") opts.cache_prune = true;
+            else if (arg == "--old") opts.old_corpus = value();
+            else if (arg == "--old-output") opts.old_output = value();
+            else if (!arg.empty() && arg.front() == '-' && arg != "-") usage(2);
+            else if (opts.input.empty()) opts.input = arg;
+            else usage(2);
+        }
+        if (opts.input.empty()) usage(2);
+        if (opts.dedup && !opts.cache.empty()) {
+            std::cerr << "hlat: --cache caches per-selector output and cannot be combined with --dedup\n";
+            std::exit(2);
+        }
+        if (opts.cache_prune && opts.cache.empty()) usage(2);
+        if (opts.old_corpus.empty() != opts.old_output.empty()) usage(2);
+        if (opts.dedup && !opts.old_corpus.empty()) {
+            std::cerr << "hlat: --old patches per-selector output and cannot be combined with --dedup\n";
+            std::exit(2);
+        }
+        if (opts.profile && !opts.trace.empty()) {
+            std::cerr << "hlat: --profile and --trace instrument the same stages; choose one\n";
+            std::exit(2);
+        }
+        return opts;
+    }
+
+    void printQueue(const char* name, const hlat::QueueStats& q) {
+        if (q.capacity == 0) return; // deduplicated runs bypass the queues
+        std::cerr << "  " << name << ": capacity " << q.capacity
+            << ", mean " << q.mean() << ", peak " << q.peak
+            << ", stalls " << q.stalls << "\n";
+    }
+
+    void printReport(const hlat::BatchReport& report) {
+        std::cerr << "hlat: " << report.selectors << " selectors in "
+            << report.chunks << " chunks\n";
+        printQueue("free (writer -> reader) ", report.free);
+        printQueue("work (reader -> workers)", report.work);
+        printQueue("done (workers -> writer)", report.done);
+    }
+
+    /// Converts every selector into one shared declaration set
+    hlat::BatchReport runDeduplicated(
+        const hlat::MappedFile& input, hlat::BufferedWriter& output, size_t chunk_lines)
+    {
+        hlat::BatchReport report{};
+        hlat::XLocatorFactory<> factory;
+        hlat::QtBatchDeclarations<> batch(factory);
+        hlat::LineSplitter lines(input.bytes());
+
+        while (auto line = lines.next()) {
+            try {
+                auto tokens = hlat::XPathLexer(*line).tokenize();
+                batch.add(hlat::XPathParser(tokens).parse());
+            }
+            catch (const std::exception& e) {
+                report.errors.push_back({ lines.lineNumber(), e.what() });
+            }
+            if (++report.selectors % chunk_lines == 0) {
+                output.write(batch.emit());
+                ++report.chunks;
+            }
+        }
+        output.write(batch.emit());
+        output.flush();
+        return report;
+    }
+
+    /// Whether two paths name the same existing file
+    bool sameFile(const std::string& a, const std::string& b) {
+        struct stat sa {}, sb {};
+        return a != "-" && ::stat(a.c_str(), &sa) == 0 && ::stat(b.c_str(), &sb) == 0
+            && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+    }
+
+    /// Writes the new corpus' output, reusing the old output for selectors the old corpus has
+    template<typename Pipeline>
+    hlat::BatchReport runIncremental(const Pipeline& pipeline, const Options& opts,
+        const hlat::MappedFile& input, hlat::BufferedWriter& output)
+    {
+        hlat::MappedFile old_corpus(opts.old_corpus), old_output(opts.old_output);
+        auto inc = hlat::IncrementalConverter(pipeline, opts.batch.threads)
+            .run(old_corpus.bytes(), old_output.bytes(), input.bytes(), output);
+        if (!inc.aligned)
+            std::cerr << "hlat: '" << opts.old_output << "' is not the output of '" << opts.old_corpus
+                << "'; converted every selector\n";
+        if (opts.stats)
+            std::cerr << "hlat: " << inc.diff.changed.size() << " changed, " << inc.diff.added.size() << " added, "
+                << inc.diff.removed.size() << " removed, " << inc.diff.kept << " kept; "
+                << inc.converted << " converted\n";
+        hlat::BatchReport report{};
+        report.errors = std::move(inc.errors);
+        report.selectors = inc.selectors;
+        report.chunks = inc.chunks;
+        return report;
+    }
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts = parseArgs(argc, argv);
+    try {
+        hlat::MappedFile input(opts.input);
+        // Patching the old output in place: write next to it and rename once done
+        const bool in_place = !opts.old_output.empty() && sameFile(opts.output, opts.old_output);
+        hlat::BufferedWriter output(in_place ? opts.output + ".tmp" : opts.output);
+
+        std::optional<hlat::ConversionCache> cache;
+        if (!opts.cache.empty()) cache.emplace(opts.cache);
+        auto run = [&](auto const& pipeline) {
+            if (!opts.old_corpus.empty()) return runIncremental(pipeline, opts, input, output);
+            return hlat::BatchConverter(pipeline, opts.batch).run(input, output);
+        };
+        auto convert = [&](auto pipeline) {
+            if (!cache) return run(pipeline);
+            return run(hlat::CachedDeclarations(std::move(pipeline), *cache));
+        };
+
+        hlat::BatchReport report;
+        if (opts.dedup) report = runDeduplicated(input, output, opts.batch.chunk_lines);
+        else if (opts.profile) {
+            hlat::StageHistograms histograms;
+            report = convert(makePipeline(histograms));
+            std::cerr << histograms.report().text();
+#ifndef HLAT_COUNT_ALLOCATIONS
+            std::cerr << "hlat: allocations were not counted; build with -DHLAT_COUNT_ALLOCATIONS\n";
+#endif
+        }
+        else if (!opts.trace.empty()) {
+            hlat::ChromeTracer tracer(opts.trace);
+            report = convert(makePipeline(tracer));
+        }
+        else report = convert(makePipeline());
+
+        if (in_place && std::rename((opts.output + ".tmp").c_str(), opts.output.c_str()) != 0)
+            throw std::runtime_error("Cannot replace '" + opts.output + "': " + std::strerror(errno));
+
+        if (cache) {
+            // Blocks reused by --old never reach the cache; keep their records through a prune
+            if (!opts.old_corpus.empty())
+                for (auto const& line : hlat::corpusLines(input.bytes())) cache->touch(line.xpath);
+            cache->flush();
+            // Compact once more than half the file is dead records
+            if (opts.cache_prune || cache->staleBytes() * 2 > cache->fileBytes()) cache->compact(opts.cache_prune);
+            if (opts.stats)
+                std::cerr << "hlat: cache " << cache->hits() << " hits, " << cache->misses() << " misses, "
+                    << cache->size() << " records\n";
+        }
+
+        for (auto const& err : report.errors)
+            std::cerr << opts.input << ":" << err.line << ": " << err.message << "\n";
+        if (opts.stats) printReport(report);
+        return report.errors.empty() ? 0 : 1;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "hlat: " << e.what() << "\n";
+        return 2;
+    }
+}
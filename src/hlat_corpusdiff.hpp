@@ -0,0 +1,239 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Incremental Conversion
+ |  ---------------------------------------------------------------------------
+ |  Patches the output of an earlier batch run after its corpus changed,
+ |  converting only the selectors that are new.
+ |  Features:
+ |      * Changed, added and removed selectors by XPath hash, in one linear pass
+ |      * Old declaration blocks reused as they are, in the new corpus order
+ |      * Only new selectors converted, on a work-stealing pool
+ |      * Falls back to converting everything if the old output does not line up
+ |  Requires a POSIX platform (see hlat_batch.hpp).
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_batch.hpp"
+#include "hlat_parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hlat {
+
+    /// One non-empty line of a corpus
+    struct CorpusLine {
+        std::string_view xpath;  ///< CR/LF stripped
+        size_t           number; ///< One-based line number
+    };
+
+    /// Splits a newline-delimited corpus the way BatchConverter reads it
+    inline std::vector<CorpusLine> corpusLines(std::string_view bytes) {
+        std::vector<CorpusLine> out;
+        LineSplitter lines(bytes);
+        while (auto line = lines.next()) out.push_back({ *line, lines.lineNumber() });
+        return out;
+    }
+
+    /// Splits BatchConverter output into one block per converted selector
+    ///
+    /// A block is the selector's declarations followed by an empty line. Declarations never
+    /// contain an empty line (UIDs are canonical, metadata is indented JSON), so every block
+    /// ends at the first "\n\n" after its start, or is a lone "\n" for a selector without
+    /// declarations. Trailing bytes that do not end a block are returned as a last, partial
+    /// block, which blockComplete() rejects.
+    inline std::vector<std::string_view> outputBlocks(std::string_view output) {
+        std::vector<std::string_view> out;
+        for (size_t at = 0; at < output.size(); ) {
+            size_t end = at + 1;
+            if (output[at] != '\n') {
+                end = output.find("\n\n", at);
+                end = end == std::string_view::npos ? output.size() : end + 2;
+            }
+            out.push_back(output.substr(at, end - at));
+            at = end;
+        }
+        return out;
+    }
+
+    /// Whether a block from outputBlocks() is whole rather than a truncated tail
+    inline bool blockComplete(std::string_view block) {
+        return block == "\n" || block.ends_with("\n\n");
+    }
+
+    /// Differences between two corpora, by XPath text
+    struct CorpusDiff {
+        std::vector<std::pair<size_t, size_t>> changed;   ///< (old, new) line indices replaced in place
+        std::vector<size_t>                    added;     ///< New line indices without an old counterpart
+        std::vector<size_t>                    removed;   ///< Old line indices without a new counterpart
+        size_t                                 kept{ 0 }; ///< Lines paired with an equal line of the other corpus
+    };
+
+    /// Classifies the lines of two corpora in O(n log n)
+    ///
+    /// The k-th occurrences of an XPath in both corpora pair up as kept lines. The longest run
+    /// of kept pairs in the same order on both sides anchors the comparison, as in patience
+    /// diff; the other kept pairs are moved selectors. Between consecutive anchors, removed old
+    /// lines facing added new lines are changed selectors, like a 'c' hunk of diff(1).
+    inline CorpusDiff diffCorpora(const std::vector<CorpusLine>& before, const std::vector<CorpusLine>& after) {
+        constexpr size_t None = SIZE_MAX;
+        // First unpaired new occurrence of each XPath, and the next occurrence after each line
+        std::unordered_map<std::string_view, size_t> first;
+        std::vector<size_t> next(after.size());
+        first.reserve(after.size());
+        for (size_t j = after.size(); j-- > 0; ) {
+            auto [it, fresh] = first.try_emplace(after[j].xpath, j);
+            next[j] = fresh ? None : std::exchange(it->second, j);
+        }
+        std::vector<size_t> partner(before.size(), None);
+        std::vector<bool> fresh(after.size(), true);
+        for (size_t i = 0; i < before.size(); ++i) {
+            auto it = first.find(before[i].xpath);
+            if (it == first.end() || it->second == None) continue;
+            partner[i] = it->second;
+            fresh[partner[i]] = false;
+            it->second = next[partner[i]];
+        }
+
+        // Longest increasing subsequence of partners: tails[k] ends the best run of length k+1
+        std::vector<size_t> tails, link(before.size(), None);
+        for (size_t i = 0; i < before.size(); ++i) {
+            if (partner[i] == None) continue;
+            auto pos = std::lower_bound(tails.begin(), tails.end(), partner[i],
+                [&](size_t t, size_t p) { return partner[t] < p; });
+            link[i] = pos == tails.begin() ? None : *(pos - 1);
+            if (pos == tails.end()) tails.push_back(i);
+            else *pos = i;
+        }
+        std::vector<size_t> anchors;
+        for (size_t i = tails.empty() ? None : tails.back(); i != None; i = link[i]) anchors.push_back(i);
+        std::reverse(anchors.begin(), anchors.end());
+        anchors.push_back(before.size()); // sentinel closing the last gap
+
+        CorpusDiff diff;
+        diff.kept = before.size() - static_cast<size_t>(std::count(partner.begin(), partner.end(), None));
+        size_t i = 0, j = 0;
+        for (size_t anchor : anchors) {
+            const size_t end_j = anchor < before.size() ? partner[anchor] : after.size();
+            std::vector<size_t> gone, added;
+            for (; i < anchor; ++i) if (partner[i] == None) gone.push_back(i);
+            for (; j < end_j; ++j) if (fresh[j]) added.push_back(j);
+            const size_t paired = std::min(gone.size(), added.size());
+            for (size_t k = 0; k < paired; ++k) diff.changed.push_back({ gone[k], added[k] });
+            diff.removed.insert(diff.removed.end(), gone.begin() + paired, gone.end());
+            diff.added.insert(diff.added.end(), added.begin() + paired, added.end());
+            ++i; ++j; // past the anchor
+        }
+        return diff;
+    }
+
+    /// Outcome of an incremental run
+    struct IncrementalReport {
+        CorpusDiff              diff;
+        std::vector<BatchError> errors;          ///< Selectors of the new corpus that failed, in input order
+        size_t                  selectors{ 0 };  ///< Non-empty lines of the new corpus
+        size_t                  converted{ 0 };  ///< Selectors run through the pipeline
+        size_t                  chunks{ 0 };     ///< Batches of at most IncrementalConverter::Chunk conversions
+        bool                    aligned{ true }; ///< False if the old output did not match the old corpus
+    };
+
+    /// Writes the output of a new corpus, reusing the output of an old one for unchanged selectors
+    ///
+    /// The result is byte for byte what BatchConverter writes for the new corpus: the pipeline
+    /// is deterministic, so a selector's block depends only on its XPath. Old blocks are found
+    /// by XPath text and copied in new-corpus order; only XPaths the old corpus lacks, or for
+    /// which it had no block, are converted. Old selectors that failed left no block, so when
+    /// the block count differs from the old line count, those failures are located again by
+    /// lexing and parsing the old corpus, which is much cheaper than converting it. If the
+    /// counts still disagree, the old output is ignored and every selector is converted. The
+    /// old output must come from the same pipeline: after a HeuristicQtClassifier::Version or
+    /// QtLocator::Version bump, run a full conversion.
+    template<typename Pipeline>
+    class IncrementalConverter {
+    public:
+        /// Selectors converted per batch, bounding the converted output held in memory
+        static constexpr size_t Chunk = 4096;
+
+        /// Each worker receives its own copy of `prototype`
+        explicit IncrementalConverter(const Pipeline& prototype,
+            unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+            : prototype_(prototype), pool_(threads), pipelines_(pool_.threads()) {}
+
+        IncrementalReport run(std::string_view old_corpus, std::string_view old_output,
+            std::string_view new_corpus, BufferedWriter& output)
+        {
+            IncrementalReport report;
+            const auto before = corpusLines(old_corpus);
+            const auto after = corpusLines(new_corpus);
+            report.selectors = after.size();
+            report.diff = diffCorpora(before, after);
+
+            // Old lines that produced a block, in order
+            const auto blocks = outputBlocks(old_output);
+            std::vector<size_t> producing;
+            for (size_t i = 0; i < before.size(); ++i)
+                if (blocks.size() == before.size() || parses(before[i].xpath)) producing.push_back(i);
+            report.aligned = producing.size() == blocks.size()
+                && (blocks.empty() || blockComplete(blocks.back()));
+
+            std::unordered_map<std::string_view, std::string_view> reusable;
+            if (report.aligned)
+                for (size_t b = 0; b < blocks.size(); ++b) reusable.try_emplace(before[producing[b]].xpath, blocks[b]);
+
+            // Convert what cannot be reused a chunk at a time, writing in new-corpus order
+            std::vector<size_t> todo;
+            for (size_t j = 0; j < after.size(); ++j)
+                if (!reusable.contains(after[j].xpath)) todo.push_back(j);
+            report.converted = todo.size();
+
+            std::vector<std::string> converted;
+            std::vector<std::optional<std::string>> failed;
+            size_t j = 0;
+            for (size_t first = 0; first < todo.size() || j < after.size(); ) {
+                const size_t last = std::min(todo.size(), first + Chunk);
+                converted.assign(last - first, {});
+                failed.assign(last - first, std::nullopt);
+                if (last > first) ++report.chunks;
+                pool_.run(last - first, [&](size_t k, unsigned w) {
+                    try { converted[k] = pipeline(w)(after[todo[first + k]].xpath); converted[k] += '\n'; }
+                    catch (const std::exception& e) { failed[k] = e.what(); }
+                });
+                for (size_t k = first, end = last < todo.size() ? todo[last] : after.size(); j < end; ++j) {
+                    if (k < last && todo[k] == j) {
+                        if (failed[k - first]) report.errors.push_back({ after[j].number, std::move(*failed[k - first]) });
+                        else output.write(converted[k - first]);
+                        ++k;
+                    }
+                    else output.write(reusable.find(after[j].xpath)->second);
+                }
+                first = last;
+            }
+            output.flush();
+            return report;
+        }
+
+    private:
+        Pipeline& pipeline(unsigned worker) {
+            if (!pipelines_[worker]) pipelines_[worker].emplace(prototype_);
+            return *pipelines_[worker];
+        }
+
+        /// Whether an old selector got past the cheap stages, and so produced a block
+        bool parses(std::string_view xpath) const {
+            try { prototype_.parse_(prototype_.tokenize_(xpath)); return true; }
+            catch (const std::exception&) { return false; }
+        }
+
+        Pipeline                             prototype_;
+        WorkStealingPool                     pool_;
+        std::vector<std::optional<Pipeline>> pipelines_; ///< One per worker, created on first use
+    };
+
+} // namespace hlat
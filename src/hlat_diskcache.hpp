@@ -0,0 +1,434 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Conversion Cache
+ |  ---------------------------------------------------------------------------
+ |  Persists emitted declarations across runs, so a batch run converts only the
+ |  selectors it has not seen before.
+ |  Features:
+ |      * Keyed on the XPath text and the classifier and emitter versions
+ |      * Memory-mapped lookups, validated per record
+ |      * Append-only writes under an advisory file lock, torn tails dropped
+ |      * Compaction of superseded, outdated and unused records
+ |  Requires a POSIX platform (mmap/flock).
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_batch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hlat {
+
+    /// Versions of the stages behind a cached declaration; a change misses every older record
+    struct ConversionVersions {
+        uint32_t classifier{ HeuristicQtClassifier::Version }; ///< Tag to widget type mapping
+        uint32_t emitter{ QtLocator::Version };                ///< Conversion and declaration text
+    };
+
+    /// Persistent map from XPath text to the declarations emitted for it
+    ///
+    /// The file is a header followed by append-only records, each holding one XPath, its
+    /// output, the versions that produced it and checks of the header and the output. Opening maps the
+    /// file and indexes the record headers; find() compares the stored XPath and checks the
+    /// output in place, so a hash collision or a damaged record is a miss, never a wrong
+    /// declaration. insert() buffers new records in memory until flush(), which appends them
+    /// under an exclusive flock(), after cutting off a record left torn by a crashed writer.
+    /// Several processes may share one file; each sees the records of the others from its
+    /// next open on.
+    ///
+    /// find(), insert() and flush() may be called from many threads; compact() may not run
+    /// concurrently with any of them.
+    class ConversionCache {
+    public:
+        /// Bumped whenever the file or record layout changes; older files start over
+        static constexpr uint32_t FileVersion = 1;
+
+        /// Opens or creates the cache at `path`; throws if it exists and is not a cache
+        explicit ConversionCache(std::string path, ConversionVersions versions = {})
+            : path_(std::move(path)), versions_(versions)
+        {
+            open();
+            std::optional<FileLock> lock;
+            lockCurrent(lock);
+            load();
+        }
+
+        ConversionCache(const ConversionCache&) = delete;
+        ConversionCache& operator=(const ConversionCache&) = delete;
+
+        ~ConversionCache() {
+            try { flush(); } catch (...) {}
+            if (fd_ >= 0) ::close(fd_);
+        }
+
+        /// Output cached for `xpath` under the current versions
+        ///
+        /// The view stays valid until compact() or destruction.
+        std::optional<std::string_view> find(std::string_view xpath) const {
+            const uint64_t key = digest(xpath);
+            if (auto it = index_.find(key); it != index_.end()) {
+                const std::string_view bytes = map_->bytes();
+                Record r;
+                std::memcpy(&r, bytes.data() + offsets_[it->second], sizeof(Record));
+                const std::string_view stored = bytes.substr(offsets_[it->second] + sizeof(Record), r.xpath_size);
+                const std::string_view output = bytes.substr(offsets_[it->second] + sizeof(Record) + r.xpath_size, r.output_size);
+                if (stored == xpath && digest(output) == r.output_check) {
+                    used_[it->second].store(true, std::memory_order_relaxed);
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    return output;
+                }
+            }
+            std::lock_guard lock(mutex_);
+            if (auto it = pending_index_.find(key); it != pending_index_.end() && pending_[it->second].xpath == xpath) {
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return pending_[it->second].output;
+            }
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        /// Marks the record of `xpath` as used without reading its output, so compact(true)
+        /// keeps it; for selectors whose output came from elsewhere, e.g. an IncrementalConverter
+        /// reusing an old block
+        void touch(std::string_view xpath) const {
+            if (auto it = index_.find(digest(xpath)); it != index_.end()) {
+                const std::string_view bytes = map_->bytes();
+                Record r;
+                std::memcpy(&r, bytes.data() + offsets_[it->second], sizeof(Record));
+                if (bytes.substr(offsets_[it->second] + sizeof(Record), r.xpath_size) == xpath)
+                    used_[it->second].store(true, std::memory_order_relaxed);
+            }
+        }
+
+        /// Records the output of `xpath`; written to the file by the next flush()
+        void insert(std::string_view xpath, std::string_view output) {
+            if (xpath.size() > UINT32_MAX || output.size() > UINT32_MAX) return;
+            const uint64_t key = digest(xpath);
+            std::lock_guard lock(mutex_);
+            auto [it, fresh] = pending_index_.try_emplace(key, pending_.size());
+            if (!fresh) {
+                if (pending_[it->second].xpath == xpath) return;
+                it->second = pending_.size(); // a colliding XPath: the later record wins on the next open
+            }
+            pending_.push_back({ std::string(xpath), std::string(output) });
+        }
+
+        /// Appends the records inserted since the last flush to the file
+        void flush() {
+            std::lock_guard guard(mutex_);
+            if (flushed_ == pending_.size()) return;
+            std::string out;
+            for (size_t i = flushed_; i < pending_.size(); ++i) encode(out, pending_[i].xpath, pending_[i].output);
+
+            std::optional<FileLock> lock;
+            lockCurrent(lock);
+            dropTornTail();
+            for (std::string_view rest = out; !rest.empty(); ) {
+                const ssize_t n = ::write(fd_, rest.data(), rest.size());
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    throw std::runtime_error("Cannot append to '" + path_ + "': " + std::strerror(errno));
+                }
+                rest.remove_prefix(static_cast<size_t>(n));
+            }
+            valid_end_ += out.size();
+            flushed_ = pending_.size();
+        }
+
+        /// Rewrites the file with only the latest record of each XPath under the current versions
+        ///
+        /// With `used_only`, records neither found nor inserted since the cache was opened or
+        /// last compacted are dropped as well, so selectors removed from a corpus stop taking
+        /// space. The new file is written next to the old one and renamed over it; other
+        /// processes switch to it on their next flush().
+        void compact(bool used_only = false) {
+            flush();
+            std::unordered_set<uint64_t> used;
+            if (used_only) {
+                for (auto const& [key, slot] : index_) if (used_[slot].load(std::memory_order_relaxed)) used.insert(key);
+                for (auto const& [key, slot] : pending_index_) used.insert(key);
+            }
+            {
+                std::optional<FileLock> lock;
+                lockCurrent(lock);
+                load(); // picks up records other processes appended since we opened
+                std::vector<uint64_t> live;
+                for (auto const& [key, slot] : index_)
+                    if (!used_only || used.contains(key)) live.push_back(offsets_[slot]);
+                std::sort(live.begin(), live.end());
+
+                const std::string temp = path_ + ".tmp";
+                {
+                    BufferedWriter out(temp);
+                    out.write(header());
+                    const std::string_view bytes = map_->bytes();
+                    for (uint64_t at : live) {
+                        Record r;
+                        std::memcpy(&r, bytes.data() + at, sizeof(Record));
+                        out.write(bytes.substr(at, stride(r)));
+                    }
+                    out.flush();
+                }
+                // Still holding the old file's lock, so nobody appends to it past this point
+                if (std::rename(temp.c_str(), path_.c_str()) != 0)
+                    throw std::runtime_error("Cannot replace '" + path_ + "': " + std::strerror(errno));
+            }
+            open();
+            std::optional<FileLock> lock;
+            lockCurrent(lock);
+            load();
+        }
+
+        /// Records usable under the current versions, flushed or not
+        size_t size() const {
+            std::lock_guard lock(mutex_);
+            return index_.size() + pending_.size();
+        }
+
+        /// File bytes held by superseded, outdated or damaged records; compact() reclaims them
+        size_t staleBytes() const { return stale_; }
+
+        /// File bytes as of the last open, flush or compaction
+        size_t fileBytes() const { return valid_end_; }
+
+        uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+        uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+    private:
+        static constexpr char     FileMagic[4] = { 'H', 'L', 'C', 'C' };
+        static constexpr uint32_t FileByteOrder = 0x01020304;
+
+        struct FileHeader {
+            char     magic[4];
+            uint32_t version;
+            uint32_t byte_order;
+            uint32_t reserved;
+        };
+
+        /// Precedes the XPath and output bytes; records are padded to 8 bytes
+        struct Record {
+            uint64_t key;          ///< digest() of the XPath
+            uint64_t output_check; ///< digest() of the output
+            uint32_t classifier;
+            uint32_t emitter;
+            uint32_t xpath_size;
+            uint32_t output_size;
+            uint64_t header_check; ///< digest() of the fields above
+        };
+
+        // Changing either of these changes the file layout: bump FileVersion
+        static_assert(sizeof(FileHeader) == 16 && sizeof(Record) == 40);
+
+        struct Pending {
+            std::string xpath;
+            std::string output;
+        };
+
+        /// Exclusive flock() held for one scope
+        class FileLock {
+        public:
+            explicit FileLock(int fd) : fd_(fd) {
+                while (::flock(fd_, LOCK_EX) != 0)
+                    if (errno != EINTR) throw std::runtime_error(std::string("Cannot lock cache: ") + std::strerror(errno));
+            }
+            ~FileLock() { ::flock(fd_, LOCK_UN); }
+            FileLock(const FileLock&) = delete;
+            FileLock& operator=(const FileLock&) = delete;
+        private:
+            int fd_;
+        };
+
+        /// FNV-1a over 8-byte words, then the remaining bytes; stable for one byte order
+        static uint64_t digest(std::string_view s) {
+            constexpr uint64_t prime = 0x100000001b3ULL;
+            uint64_t h = 0xcbf29ce484222325ULL ^ s.size();
+            size_t i = 0;
+            for (uint64_t w; i + 8 <= s.size(); i += 8) {
+                std::memcpy(&w, s.data() + i, 8);
+                h = (h ^ w) * prime;
+                h ^= h >> 29;
+            }
+            for (; i < s.size(); ++i) h = (h ^ static_cast<unsigned char>(s[i])) * prime;
+            return h;
+        }
+
+        static uint64_t headerCheck(const Record& r) {
+            return digest(std::string_view(reinterpret_cast<const char*>(&r), offsetof(Record, header_check)));
+        }
+
+        static size_t stride(const Record& r) {
+            return (sizeof(Record) + size_t{ r.xpath_size } + r.output_size + 7) / 8 * 8;
+        }
+
+        static std::string header() {
+            FileHeader h{};
+            std::memcpy(h.magic, FileMagic, 4);
+            h.version = FileVersion;
+            h.byte_order = FileByteOrder;
+            return std::string(reinterpret_cast<const char*>(&h), sizeof(h));
+        }
+
+        void encode(std::string& out, std::string_view xpath, std::string_view output) const {
+            Record r{};
+            r.key = digest(xpath);
+            r.output_check = digest(output);
+            r.classifier = versions_.classifier;
+            r.emitter = versions_.emitter;
+            r.xpath_size = static_cast<uint32_t>(xpath.size());
+            r.output_size = static_cast<uint32_t>(output.size());
+            r.header_check = headerCheck(r);
+            const size_t at = out.size();
+            out.append(reinterpret_cast<const char*>(&r), sizeof(r));
+            out += xpath;
+            out += output;
+            out.resize(at + stride(r), '\0');
+        }
+
+        /// True if `path_` no longer names the open file, e.g. after another process compacted it
+        bool replaced() const {
+            struct stat named {}, opened {};
+            if (::stat(path_.c_str(), &named) != 0 || ::fstat(fd_, &opened) != 0) return true;
+            return named.st_dev != opened.st_dev || named.st_ino != opened.st_ino;
+        }
+
+        /// Locks the file `path_` names, reopening it while another process replaces it
+        void lockCurrent(std::optional<FileLock>& lock) {
+            for (lock.emplace(fd_); replaced(); lock.emplace(fd_)) {
+                lock.reset();
+                open();
+            }
+        }
+
+        /// (Re)opens `path_`, writing a fresh header into an empty or outdated file
+        void open() {
+            const int fd = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) throw std::runtime_error("Cannot open '" + path_ + "': " + std::strerror(errno));
+            if (fd_ >= 0) ::close(fd_);
+            fd_ = fd;
+            valid_end_ = sizeof(FileHeader);
+
+            FileLock lock(fd_);
+            FileHeader h{};
+            const ssize_t n = ::pread(fd_, &h, sizeof(h), 0);
+            const size_t got = n > 0 ? static_cast<size_t>(n) : 0;
+            if (got > 0 && std::memcmp(h.magic, FileMagic, std::min<size_t>(got, 4)) != 0)
+                throw std::runtime_error("'" + path_ + "' is not a conversion cache");
+            if (got == sizeof(h) && h.version == FileVersion && h.byte_order == FileByteOrder) return;
+            if (::ftruncate(fd_, 0) != 0 || ::write(fd_, header().data(), sizeof(FileHeader)) != sizeof(FileHeader))
+                throw std::runtime_error("Cannot initialize '" + path_ + "': " + std::strerror(errno));
+        }
+
+        /// Maps the file and indexes the latest record of each XPath; the caller holds the lock
+        void load() {
+            map_ = std::make_unique<MappedFile>(path_, MADV_RANDOM);
+            index_.clear();
+            offsets_.clear();
+            pending_.clear();
+            pending_index_.clear();
+            flushed_ = 0;
+            stale_ = 0;
+
+            const std::string_view bytes = map_->bytes();
+            size_t at = sizeof(FileHeader);
+            for (Record r; at + sizeof(Record) <= bytes.size(); at += stride(r)) {
+                std::memcpy(&r, bytes.data() + at, sizeof(Record));
+                if (r.header_check != headerCheck(r) || stride(r) > bytes.size() - at) break;
+                if (r.classifier != versions_.classifier || r.emitter != versions_.emitter) {
+                    stale_ += stride(r);
+                    continue;
+                }
+                auto [it, fresh] = index_.try_emplace(r.key, offsets_.size());
+                if (fresh) offsets_.push_back(at);
+                else {
+                    Record old;
+                    std::memcpy(&old, bytes.data() + offsets_[it->second], sizeof(Record));
+                    stale_ += stride(old);
+                    offsets_[it->second] = at;
+                }
+            }
+            stale_ += bytes.size() - at; // a torn tail, cut off by the next flush
+            valid_end_ = at;
+            used_ = std::make_unique<std::atomic<bool>[]>(offsets_.size());
+        }
+
+        /// Cuts the file after its last whole record, reading headers past `valid_end_`
+        ///
+        /// Other processes may have appended whole records since we last looked; a record that
+        /// does not check out can only be the torn last write of a crashed one.
+        void dropTornTail() {
+            struct stat st {};
+            if (::fstat(fd_, &st) != 0)
+                throw std::runtime_error("Cannot stat '" + path_ + "': " + std::strerror(errno));
+            const size_t size = static_cast<size_t>(st.st_size);
+            Record r;
+            while (valid_end_ + sizeof(Record) <= size
+                && ::pread(fd_, &r, sizeof(Record), static_cast<off_t>(valid_end_)) == sizeof(Record)
+                && r.header_check == headerCheck(r) && stride(r) <= size - valid_end_)
+                valid_end_ += stride(r);
+            if (valid_end_ < size && ::ftruncate(fd_, static_cast<off_t>(valid_end_)) != 0)
+                throw std::runtime_error("Cannot truncate '" + path_ + "': " + std::strerror(errno));
+        }
+
+        std::string                                  path_;
+        ConversionVersions                           versions_;
+        int                                          fd_{ -1 };
+        size_t                                       valid_end_{ 0 }; ///< End of the last whole record known
+        std::unique_ptr<MappedFile>                  map_;
+        std::unordered_map<uint64_t, uint32_t>       index_;          ///< XPath hash -> slot; read-only between loads
+        std::vector<uint64_t>                        offsets_;        ///< Record offset per slot
+        std::unique_ptr<std::atomic<bool>[]>         used_;           ///< Found since the last load, per slot
+        size_t                                       stale_{ 0 };
+
+        mutable std::mutex                           mutex_;          ///< Guards the pending records
+        std::deque<Pending>                          pending_;        ///< Inserted since the last load, in order
+        std::unordered_map<uint64_t, size_t>         pending_index_;
+        size_t                                       flushed_{ 0 };   ///< Pending records already in the file
+
+        mutable std::atomic<uint64_t>                hits_{ 0 };
+        mutable std::atomic<uint64_t>                misses_{ 0 };
+    };
+
+    /// Pipeline answering from a ConversionCache and running its stages only on a miss
+    ///
+    /// Copies share the cache, so BatchConverter's per-worker copies all feed the same file,
+    /// and the pipeline's instrumentation policy stays reachable as `instrument_`. Selectors
+    /// that throw are not cached and are reported again on every run.
+    template<typename Pipeline>
+    class CachedDeclarations : public Pipeline {
+    public:
+        CachedDeclarations(Pipeline pipeline, ConversionCache& cache)
+            : Pipeline(std::move(pipeline)), cache_(&cache) {}
+
+        std::string operator()(std::string_view xpath) const {
+            if (auto hit = cache_->find(xpath)) return std::string(*hit);
+            std::string out = Pipeline::operator()(xpath);
+            cache_->insert(xpath, out);
+            return out;
+        }
+
+    private:
+        ConversionCache* cache_;
+    };
+
+} // namespace hlat
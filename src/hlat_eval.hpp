@@ -0,0 +1,637 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Selector Evaluation
+ |  ---------------------------------------------------------------------------
+ |  Evaluates parsed selectors (std::vector<XLocator>) against a WidgetTree.
+ |  Features:
+ |      * All XPath 1.0 element axes
+ |      * '//' steps answered from subtree intervals and per-tag node lists
+ |      * Equality predicates seeded from the inverted attribute index
+ |      * Cost-based plans: guard order and seeding from tree statistics
+ |      * Tag, wildcard and node() tests
+ |      * Attribute, name()/local-name() and position predicates
+ |      * Position limits pushed into traversal, first-match lookups
+ |      * Node tests interpreted from bound selector bytecode
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat.hpp"
+#include "hlat_bytecode.hpp"
+#include "hlat_planner.hpp"
+#include "hlat_tree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace hlat {
+
+    namespace eval {
+
+        /// One location step bound to a tree
+        struct Step {
+            Axis                  axis{ Axis::Child };
+            NodeTest              test{ NodeTest::Element };
+            StringId              tag{ NoString };
+            std::vector<uint32_t> guard;     ///< Attribute and name conditions as bytecode (all must hold)
+            std::vector<uint32_t> positions; ///< Position instructions, counted over guard survivors
+            size_t                limit{ SIZE_MAX };   ///< Highest position the position instructions admit
+            bool                  per_parent{ false }; ///< Fused '//' + child step: positions count per parent
+        };
+
+        /// A tree node as seen by runGuard()
+        ///
+        /// Other node sources (see SelectorStream) provide the same five members: the tag's
+        /// ID and local name, an attribute's value ID (NoString if absent) and numeric value
+        /// (NaN if absent or not a number), and the text of an ID.
+        struct TreeNode {
+            const WidgetTree& tree;
+            NodeId            n;
+
+            StringId tag() const { return tree.node(n).tag; }
+            std::string_view localName() const { return eval::localName(tree.tagName(n)); }
+            StringId attribute(StringId name) const { return tree.attribute(n, name); }
+            double number(StringId name) const {
+                const StringId v = tree.attribute(n, name);
+                return v == NoString ? std::numeric_limits<double>::quiet_NaN() : toNumber(tree.strings().view(v));
+            }
+            std::string_view text(StringId id) const { return tree.strings().view(id); }
+        };
+
+        /// Runs a bound guard on a node; stops at the first condition that fails
+        template<typename Node>
+        bool runGuard(const Node& node, const std::vector<uint32_t>& guard) {
+            using bc::Opcode;
+            const uint32_t* pc = guard.data();
+            const uint32_t* const end = pc + guard.size();
+            while (pc != end) {
+                const uint32_t word = *pc;
+                switch (bc::opcode(word)) {
+                case Opcode::AttrEq:
+                    if (node.attribute(pc[1]) != pc[2]) return false;
+                    break;
+                case Opcode::AttrNe:
+                {
+                    const StringId v = node.attribute(pc[1]);
+                    if (v == NoString || v == pc[2]) return false;
+                    break;
+                }
+                case Opcode::AttrCmp:
+                    if (!compare(node.number(pc[1]), static_cast<Op>(bc::argument(word)), bc::number(pc + 2))) return false;
+                    break;
+                case Opcode::NameEq: if (node.tag() != pc[1]) return false; break;
+                case Opcode::NameNe: if (node.tag() == pc[1]) return false; break;
+                case Opcode::LocalEq: if (node.localName() != node.text(pc[1])) return false; break;
+                case Opcode::LocalNe: if (node.localName() == node.text(pc[1])) return false; break;
+                case Opcode::TagIn:
+                case Opcode::TagNotIn:
+                {
+                    const uint32_t* const last = pc + 1 + bc::argument(word);
+                    const bool found = std::find(pc + 1, last, node.tag()) != last;
+                    if (found != (bc::opcode(word) == Opcode::TagIn)) return false;
+                    break;
+                }
+                default: return false; // Fail
+                }
+                pc += bc::length(word);
+            }
+            return true;
+        }
+
+        /// Node test plus attribute and name conditions of a step
+        inline bool matches(const WidgetTree& tree, const Step& step, NodeId n) {
+            switch (step.test) {
+            case NodeTest::Name:    if (tree.node(n).tag != step.tag) return false; break;
+            case NodeTest::Element: if (n == WidgetTree::Document) return false; break;
+            case NodeTest::Any:     break;
+            case NodeTest::None:    return false;
+            }
+            return step.guard.empty() || runGuard(TreeNode{ tree, n }, step.guard);
+        }
+
+        /// True for steps that only move down the tree with positions, if any, counted per parent
+        ///
+        /// Such a step is decided by the matched node's parent links alone: it can be
+        /// verified from the node upwards or matched during a single pre-order pass.
+        inline bool isDownward(const Step& step) {
+            switch (step.axis) {
+            case Axis::Self:
+            case Axis::Child:            return true;
+            case Axis::Descendant:       return step.per_parent || step.positions.empty();
+            case Axis::DescendantOrSelf: return step.positions.empty();
+            default:                     return false;
+            }
+        }
+
+        /// Position conditions of a step, given the candidate's one-based position
+        inline bool matchesPosition(const Step& step, size_t position) {
+            for (size_t pc = 0; pc < step.positions.size(); pc += bc::length(step.positions[pc]))
+                if (!compare(static_cast<double>(position), static_cast<Op>(bc::argument(step.positions[pc])),
+                    bc::number(&step.positions[pc + 1])))
+                    return false;
+            return true;
+        }
+
+        /// Highest one-based position that can pass all of `positions`, SIZE_MAX if unbounded
+        ///
+        /// Only '=', '<' and '<=' bound a position; 0 means no position passes. Walks may stop
+        /// counting candidates once they reach the limit.
+        inline size_t positionLimit(const std::vector<uint32_t>& positions) {
+            double limit = std::numeric_limits<double>::infinity();
+            for (size_t pc = 0; pc < positions.size(); pc += bc::length(positions[pc])) {
+                const double v = bc::number(&positions[pc + 1]);
+                if (v != v) return 0; // NaN compares false
+                switch (static_cast<Op>(bc::argument(positions[pc]))) {
+                case Op::Eq: limit = std::min(limit, v == std::floor(v) ? v : 0.0); break;
+                case Op::Lt: limit = std::min(limit, std::ceil(v) - 1); break;
+                case Op::Le: limit = std::min(limit, std::floor(v)); break;
+                default:     break;
+                }
+            }
+            if (limit < 1) return 0;
+            return limit >= 0x1p53 ? SIZE_MAX : static_cast<size_t>(limit);
+        }
+
+        /// True for axes that only reach nodes at or after the context in document order
+        inline bool isForward(Axis axis) {
+            switch (axis) {
+            case Axis::Self:
+            case Axis::Child:
+            case Axis::Descendant:
+            case Axis::DescendantOrSelf:
+            case Axis::FollowingSibling:
+            case Axis::Following: return true;
+            default:              return false;
+            }
+        }
+
+        /// Calls `fn(node)` for every node on `axis` from `context`, in axis order
+        ///
+        /// Forward axes run in document order, reverse axes (ancestor, preceding...) nearest
+        /// first. Stops early and returns false as soon as `fn` returns false. Descendant and
+        /// following nodes are ID ranges; with a `tag` the descendant axes read only that
+        /// tag's node list, and other axes may still report nodes with a different tag.
+        template<typename Fn>
+        bool walkAxis(const WidgetTree& tree, Axis axis, NodeId context, StringId tag, Fn&& fn) {
+            auto const& nodes = tree.nodes();
+            auto range = [&](NodeId first, NodeId last) {
+                if (tag != NoString) {
+                    for (NodeId n : tree.tagged(tag, first, last))
+                        if (!fn(n)) return false;
+                    return true;
+                }
+                for (NodeId n = first; n < last; ++n)
+                    if (!fn(n)) return false;
+                return true;
+            };
+
+            switch (axis) {
+            case Axis::Child:
+                for (NodeId n = nodes[context].first_child; n != NoNode; n = nodes[n].next_sibling)
+                    if (!fn(n)) return false;
+                return true;
+            case Axis::Descendant:       return range(context + 1, nodes[context].end);
+            case Axis::DescendantOrSelf: return range(context, nodes[context].end);
+            case Axis::Self:             return fn(context);
+            case Axis::Parent:
+                return nodes[context].parent == NoNode || fn(nodes[context].parent);
+            case Axis::Ancestor:
+            case Axis::AncestorOrSelf:
+                for (NodeId n = axis == Axis::Ancestor ? nodes[context].parent : context; n != NoNode; n = nodes[n].parent)
+                    if (!fn(n)) return false;
+                return true;
+            case Axis::FollowingSibling:
+                for (NodeId n = nodes[context].next_sibling; n != NoNode; n = nodes[n].next_sibling)
+                    if (!fn(n)) return false;
+                return true;
+            case Axis::PrecedingSibling:
+                for (NodeId n = nodes[context].prev_sibling; n != NoNode; n = nodes[n].prev_sibling)
+                    if (!fn(n)) return false;
+                return true;
+            case Axis::Following:
+                return range(nodes[context].end, static_cast<NodeId>(nodes.size()));
+            case Axis::Preceding:
+                // IDs are in document order: walk them downwards, skipping the ancestors
+                for (NodeId n = context; n-- > 0; )
+                    if (!tree.isAncestor(n, context) && !fn(n)) return false;
+                return true;
+            }
+            return true;
+        }
+
+    } // namespace eval
+
+    /// A selector lowered against one tree: axes resolved, names interned, predicates split
+    struct CompiledSelector {
+        /// `seed_step` value of selectors evaluated top-down
+        static constexpr size_t TopDown = SIZE_MAX;
+
+        std::vector<eval::Step> steps;
+        bool                    absolute{ false };      ///< Starts from the document node
+        bool                    unsatisfiable{ false }; ///< Some step can never match in this tree
+        size_t                  seed_step{ TopDown };   ///< Step whose equality predicate seeds evaluation
+        StringId                seed_name{ NoString };  ///< Seeding attribute name
+        StringId                seed_value{ NoString }; ///< Seeding attribute value
+    };
+
+    /// Evaluates parsed selectors against a WidgetTree
+    ///
+    /// Semantics follow XPath 1.0 with three HLAT conventions: conditions within one
+    /// predicate are a conjunction; position conditions count only the candidates that pass
+    /// the other conditions, like the converter's "occurrence" (`button[@name='ok' and 2]`
+    /// is the second ok button); and unprefixed comparisons (`price>35`) test attributes,
+    /// since widgets carry properties rather than text children.
+    ///
+    /// Results are node IDs in document order without duplicates. A step following '//'
+    /// becomes a lookup over subtree intervals and the tag's sorted node list (see
+    /// descendantsOf()); other steps walk their axis from every context node. An evaluator
+    /// keeps per-tree scratch space: use one per thread.
+    class SelectorEvaluator {
+    public:
+        explicit SelectorEvaluator(WidgetTree tree)
+            : tree_(std::move(tree)), stats_(tree_), seen_(tree_.size(), 0) {
+            for (StringId tag = 0; tag < tree_.strings().size(); ++tag)
+                if (!tree_.tagged(tag).empty()) local_tags_[eval::localName(tree_.strings().view(tag))].push_back(tag);
+        }
+
+        /// Compiles a parsed selector and binds it to the tree
+        CompiledSelector compile(const std::vector<XLocator>& steps) const {
+            return bind(SelectorCompiler(steps).compile());
+        }
+
+        /// Resolves a program's literals against the tree's strings
+        ///
+        /// Binding is O(code + literals); programs can be compiled once, cached in serialized
+        /// form and bound to every new snapshot. Throws if the program fails verification.
+        CompiledSelector bind(const SelectorProgram& program) const {
+            if (const char* error = program.verify())
+                throw std::runtime_error(std::string("Malformed selector program: ") + error);
+            std::vector<StringId> ids(program.strings.size());
+            for (size_t i = 0; i < ids.size(); ++i) ids[i] = tree_.strings().find(program.strings[i]);
+
+            CompiledSelector out;
+            out.absolute = program.absolute;
+            auto const& code = program.code;
+            for (size_t pc = 0; pc < code.size(); ) {
+                const size_t guard = code[pc + 2], positions = code[pc + 3];
+                const size_t body = pc + bc::StepHeader;
+                eval::Step step;
+                const uint32_t arg = bc::argument(code[pc]);
+                step.axis = static_cast<Axis>(arg & 0xff);
+                step.test = static_cast<eval::NodeTest>(arg >> 8 & 0xff);
+                step.per_parent = (arg >> 16) != 0;
+                if (step.test == eval::NodeTest::Name) {
+                    step.tag = ids[code[pc + 1]];
+                    if (step.tag == NoString) step.test = eval::NodeTest::None;
+                }
+                for (size_t i = body; i < body + guard; i += bc::length(code[i])) bindCondition(program, code.data() + i, ids, step);
+                step.positions.assign(code.begin() + body + guard, code.begin() + body + guard + positions);
+                step.limit = eval::positionLimit(step.positions);
+                if (step.limit == 0) step.test = eval::NodeTest::None;
+                out.unsatisfiable = out.unsatisfiable || step.test == eval::NodeTest::None;
+                out.steps.push_back(std::move(step));
+                pc = body + guard + positions;
+            }
+            if (!out.unsatisfiable) plan(out);
+            return out;
+        }
+
+        /// Evaluates a parsed selector; relative selectors start at `context`
+        std::vector<NodeId> evaluate(const std::vector<XLocator>& steps, NodeId context = WidgetTree::Document) {
+            return evaluate(compile(steps), context);
+        }
+
+        /// Evaluates a compiled selector; relative selectors start at `context`
+        std::vector<NodeId> evaluate(const CompiledSelector& selector, NodeId context = WidgetTree::Document) {
+            const NodeId start = selector.absolute ? WidgetTree::Document : context;
+            if (selector.unsatisfiable) return {};
+            if (selector.seed_step == CompiledSelector::TopDown) return run(selector, 0, { start });
+
+            // Bottom-up: verify each indexed node against the steps up to the seed, then go on top-down
+            std::vector<NodeId> seeds;
+            memo_.clear();
+            for (NodeId n : tree_.withAttribute(selector.seed_name, selector.seed_value))
+                if (reaches(selector, n, selector.seed_step + 1, start)) seeds.push_back(n);
+            return run(selector, selector.seed_step + 1, std::move(seeds));
+        }
+
+        /// True if evaluate(selector, context, first, last) divides the work between ID ranges
+        ///
+        /// That holds for top-down selectors starting with a '//' step without positions: a
+        /// range then expands only the first step's matches inside it.
+        static bool divisible(const CompiledSelector& selector) {
+            if (selector.unsatisfiable || selector.seed_step != CompiledSelector::TopDown || selector.steps.empty())
+                return false;
+            auto const& step = selector.steps.front();
+            return (step.axis == Axis::Descendant || step.axis == Axis::DescendantOrSelf) && step.positions.empty();
+        }
+
+        /// Part of a compiled selector's result reached through the nodes in [first, last)
+        ///
+        /// For divisible() selectors, the steps after the first run from the first step's
+        /// matches inside the range. Parts over a partition of the IDs are sorted, may overlap,
+        /// and their union is the whole result. Other selectors are evaluated whole by the
+        /// range holding their start node.
+        std::vector<NodeId> evaluate(const CompiledSelector& selector, NodeId context, NodeId first, NodeId last) {
+            const NodeId start = selector.absolute ? WidgetTree::Document : context;
+            if (!divisible(selector))
+                return first <= start && start < last ? evaluate(selector, context) : std::vector<NodeId>{};
+
+            auto const& step = selector.steps.front();
+            const NodeId lo = std::max(first, step.axis == Axis::Descendant ? start + 1 : start);
+            const NodeId hi = std::min(last, tree_.node(start).end);
+            std::vector<NodeId> current;
+            if (lo >= hi) return current;
+            if (const StringId tag = indexedTag(step); tag != NoString) {
+                for (NodeId n : tree_.tagged(tag, lo, hi))
+                    if (eval::matches(tree_, step, n)) current.push_back(n);
+            } else {
+                for (NodeId n = lo; n < hi; ++n)
+                    if (eval::matches(tree_, step, n)) current.push_back(n);
+            }
+            return run(selector, 1, std::move(current));
+        }
+
+        /// First result of a parsed selector in document order, NoNode if there is none
+        NodeId findFirst(const std::vector<XLocator>& steps, NodeId context = WidgetTree::Document) {
+            return findFirst(compile(steps), context);
+        }
+
+        /// First result of a compiled selector in document order, NoNode if there is none
+        ///
+        /// Searches depth-first, one context at a time, instead of expanding every step: once a
+        /// result is known, branches that can only lead past it are cut. A forward step (child,
+        /// descendant, following...) never leads before its context, so a walk stops at the first
+        /// candidate at or after the best result. `//button` returns after the first button.
+        NodeId findFirst(const CompiledSelector& selector, NodeId context = WidgetTree::Document) {
+            const NodeId start = selector.absolute ? WidgetTree::Document : context;
+            if (selector.unsatisfiable) return NoNode;
+            // Steps from `forward` on only move forward: their results are at or after their context
+            size_t forward = selector.steps.size();
+            while (forward > 0 && eval::isForward(selector.steps[forward - 1].axis)) --forward;
+
+            best_ = NoNode;
+            visited_.clear();
+            if (selector.seed_step == CompiledSelector::TopDown) {
+                search(selector, 0, start, forward);
+                return best_;
+            }
+            memo_.clear();
+            const size_t first = selector.seed_step + 1;
+            for (NodeId n : tree_.withAttribute(selector.seed_name, selector.seed_value)) {
+                if (first >= forward && n >= best_) break;
+                if (reaches(selector, n, first, start)) search(selector, first, n, forward);
+            }
+            return best_;
+        }
+
+        const WidgetTree& tree() const { return tree_; }
+
+    private:
+        /// Lowers best_ to the first result of steps [i, end) from `context` that precedes it
+        ///
+        /// A (step, context) pair is expanded once: a second visit could not find anything the
+        /// first did not, since best_ only decreases.
+        void search(const CompiledSelector& selector, size_t i, NodeId context, size_t forward) {
+            if (i == selector.steps.size()) { best_ = std::min(best_, context); return; }
+            if (!visited_.insert((uint64_t{ i } << 32) | context).second) return;
+
+            auto const& step = selector.steps[i];
+            const bool ordered = i + 1 >= forward; // candidates at or after best_ lead nowhere
+            const bool sorted = ordered && eval::isForward(step.axis);
+            size_t position = 0;
+            eval::walkAxis(tree_, step.axis, context, indexedTag(step), [&](NodeId n) {
+                if (sorted && n >= best_) return false;
+                if (!eval::matches(tree_, step, n)) return true;
+                // Fused '//' + child steps count per parent, so the walk itself is not limited
+                position = step.per_parent ? siblingPosition(step, n) : position + 1;
+                if (eval::matchesPosition(step, position) && !(ordered && n >= best_))
+                    search(selector, i + 1, n, forward);
+                return step.per_parent || position < step.limit;
+            });
+        }
+
+
+        /// Runs steps [first, end) top-down from `current`, which must be in document order
+        std::vector<NodeId> run(const CompiledSelector& selector, size_t first, std::vector<NodeId> current) {
+            std::vector<NodeId> next;
+            for (size_t i = first; i < selector.steps.size() && !current.empty(); ++i) {
+                auto const& step = selector.steps[i];
+                const uint32_t epoch = nextEpoch();
+                bool ordered = true;
+                next.clear();
+                if (step.per_parent) {
+                    descendantsOf(current, step, epoch, next);
+                    current.swap(next);
+                    continue;
+                }
+                for (NodeId c : current) {
+                    size_t position = 0;
+                    // Candidates arrive in axis order: past the position limit the rest of the axis is moot
+                    eval::walkAxis(tree_, step.axis, c, indexedTag(step), [&](NodeId n) {
+                        if (!eval::matches(tree_, step, n)) return true;
+                        ++position;
+                        if (eval::matchesPosition(step, position) && seen_[n] != epoch) {
+                            seen_[n] = epoch;
+                            ordered = ordered && (next.empty() || next.back() < n);
+                            next.push_back(n);
+                        }
+                        return position < step.limit;
+                    });
+                }
+                if (!ordered) std::sort(next.begin(), next.end());
+                current.swap(next);
+            }
+            return current;
+        }
+
+        /// Orders every guard, then picks top-down or index-seeded evaluation by estimated cost
+        ///
+        /// Both plans run the steps after the seed step top-down from the same nodes, so only
+        /// the prefix up to the seed step is compared: expanding it top-down from the document
+        /// (candidates visited and guards run, estimated from the tree's statistics) against
+        /// verifying every indexed node upward. Verifying a '//' step may climb each ancestor.
+        void plan(CompiledSelector& selector) const {
+            for (auto& step : selector.steps) stats_.order(step.guard);
+            constexpr double Verify = 32; // one memoized reaches() call (a hash insert), in attribute lookups
+            const double widgets = stats_.widgets();
+            double contexts = 1, topdown = 0, verify = 0, saving = 0;
+            for (size_t i = 0; i < selector.steps.size() && eval::isDownward(selector.steps[i]); ++i) {
+                auto const& step = selector.steps[i];
+                const bool deep = step.axis == Axis::Descendant || step.axis == Axis::DescendantOrSelf;
+                const double tagged = step.test == eval::NodeTest::Name ? stats_.tagged(step.tag) : widgets;
+                // '//' reads the tag's node list within the contexts' subtrees; other steps visit every child
+                double visited, candidates;
+                if (deep) {
+                    const double covered = i == 0 ? 1 : std::min(1.0, contexts * stats_.depth() / widgets);
+                    visited = candidates = covered * tagged;
+                } else {
+                    visited = step.axis == Axis::Self ? contexts : contexts * stats_.fanout();
+                    candidates = visited * tagged / widgets;
+                }
+                topdown += visited + candidates * stats_.cost(step.guard);
+                verify += deep && i > 0 ? stats_.depth() : 1;
+                double matches = candidates * stats_.selectivity(step.guard);
+                if (!step.per_parent && step.limit != SIZE_MAX) matches = std::min(matches, contexts * step.limit);
+                contexts = matches;
+
+                auto const& guard = step.guard;
+                for (size_t pc = 0; pc < guard.size(); pc += bc::length(guard[pc])) {
+                    if (bc::opcode(guard[pc]) != bc::Opcode::AttrEq) continue;
+                    const double seeded = Verify * verify * tree_.withAttribute(guard[pc + 1], guard[pc + 2]).size();
+                    if (topdown - seeded <= saving) continue;
+                    saving = topdown - seeded;
+                    selector.seed_step = i;
+                    selector.seed_name = guard[pc + 1];
+                    selector.seed_value = guard[pc + 2];
+                }
+            }
+        }
+
+        /// True if `n` is among the results of the first `k` steps evaluated from `start`
+        ///
+        /// Walks parent links (and, after '//', ancestors) instead of expanding contexts;
+        /// answers are memoized per (step, node) so shared ancestor chains are checked once.
+        bool reaches(const CompiledSelector& selector, NodeId n, size_t k, NodeId start) {
+            if (k == 0) return n == start;
+            const uint64_t key = (uint64_t{ k } << 32) | n;
+            if (auto it = memo_.find(key); it != memo_.end()) return it->second;
+
+            auto const& step = selector.steps[k - 1];
+            const NodeId parent = tree_.node(n).parent;
+            bool found = false;
+            if (eval::matches(tree_, step, n)) {
+                switch (step.axis) {
+                case Axis::Self:
+                    found = eval::matchesPosition(step, 1) && reaches(selector, n, k - 1, start);
+                    break;
+                case Axis::Child:
+                    found = parent != NoNode && eval::matchesPosition(step, siblingPosition(step, n))
+                        && reaches(selector, parent, k - 1, start);
+                    break;
+                default: // descendant(-or-self); positions, if any, count per parent
+                {
+                    if (!eval::matchesPosition(step, siblingPosition(step, n))) break;
+                    NodeId a = step.axis == Axis::DescendantOrSelf ? n : parent;
+                    if (k == 1) found = a != NoNode && (a == start || tree_.isAncestor(start, a));
+                    else for (; a != NoNode && !found; a = tree_.node(a).parent) found = reaches(selector, a, k - 1, start);
+                }
+                }
+            }
+            memo_[key] = found;
+            return found;
+        }
+
+        /// One-based position of `n` among its siblings that pass the step's test and filters
+        ///
+        /// Counting stops one past the step's position limit, which already fails the step.
+        size_t siblingPosition(const eval::Step& step, NodeId n) const {
+            if (step.positions.empty()) return 1;
+            size_t position = 1;
+            for (NodeId s = tree_.node(n).prev_sibling; s != NoNode && position <= step.limit; s = tree_.node(s).prev_sibling)
+                position += eval::matches(tree_, step, s);
+            return position;
+        }
+
+        /// Tag whose node list can stand in for walking the step's axis
+        static StringId indexedTag(const eval::Step& step) {
+            return step.test == eval::NodeTest::Name ? step.tag : NoString;
+        }
+
+        /// Evaluates a fused '//' + child step by merging subtree intervals
+        ///
+        /// Contexts arrive in document order, so a context inside the previous one's subtree
+        /// adds nothing and is skipped; the remaining intervals are disjoint and ascending,
+        /// which keeps the output sorted without deduplication. Named steps binary-search the
+        /// tag's node list, so the cost is O(contexts * log n + matches).
+        void descendantsOf(const std::vector<NodeId>& contexts, const eval::Step& step, uint32_t epoch,
+            std::vector<NodeId>& out)
+        {
+            if (!step.positions.empty() && count_.size() != tree_.size()) count_.resize(tree_.size());
+            NodeId covered = 0;
+            for (NodeId c : contexts) {
+                if (c < covered) continue;
+                covered = tree_.node(c).end;
+                eval::walkAxis(tree_, Axis::Descendant, c, indexedTag(step), [&](NodeId n) {
+                    if (step.positions.empty()) {
+                        if (eval::matches(tree_, step, n)) out.push_back(n);
+                        return true;
+                    }
+                    // Candidates arrive in document order, so siblings are counted in order; a
+                    // parent whose count reached the limit skips its remaining children's guards
+                    const NodeId p = tree_.node(n).parent;
+                    if (seen_[p] != epoch) { seen_[p] = epoch; count_[p] = 0; }
+                    if (count_[p] >= step.limit || !eval::matches(tree_, step, n)) return true;
+                    if (eval::matchesPosition(step, ++count_[p])) out.push_back(n);
+                    return true;
+                });
+            }
+        }
+
+        /// Appends one guard instruction to `step` with its literals replaced by tree strings
+        void bindCondition(const SelectorProgram& program, const uint32_t* in, const std::vector<StringId>& ids,
+            eval::Step& step) const
+        {
+            using bc::Opcode;
+            auto& guard = step.guard;
+            const uint32_t word = in[0];
+            switch (bc::opcode(word)) {
+            case Opcode::AttrEq:
+            case Opcode::AttrNe:
+            case Opcode::AttrCmp:
+            {
+                // An attribute the tree never carries fails every comparison; so does '=' with an unknown value
+                const StringId name = ids[in[1]];
+                const StringId value = bc::opcode(word) == Opcode::AttrCmp ? in[2] : ids[in[2]];
+                if (name == NoString || (bc::opcode(word) == Opcode::AttrEq && value == NoString))
+                    step.test = eval::NodeTest::None;
+                guard.insert(guard.end(), { word, name, value });
+                if (bc::opcode(word) == Opcode::AttrCmp) guard.push_back(in[3]);
+                return;
+            }
+            case Opcode::NameEq:
+            case Opcode::NameNe:
+                guard.insert(guard.end(), { word, ids[in[1]] });
+                return;
+            case Opcode::LocalEq:
+            case Opcode::LocalNe:
+            {
+                // local-name() becomes a test against every tag with that local part
+                const auto it = local_tags_.find(program.strings[in[1]]);
+                const size_t tags = it == local_tags_.end() ? 0 : it->second.size();
+                guard.push_back(bc::instr(bc::opcode(word) == Opcode::LocalEq ? Opcode::TagIn : Opcode::TagNotIn,
+                    static_cast<uint32_t>(tags)));
+                if (tags) guard.insert(guard.end(), it->second.begin(), it->second.end());
+                return;
+            }
+            default:
+                guard.push_back(word);
+                return;
+            }
+        }
+
+        /// Starts a fresh duplicate filter; clears the stamps once every 2^32 steps
+        uint32_t nextEpoch() {
+            if (++epoch_ == 0) { std::fill(seen_.begin(), seen_.end(), 0); epoch_ = 1; }
+            return epoch_;
+        }
+
+        WidgetTree            tree_;
+        TreeStatistics        stats_; ///< Frequencies the planner estimates costs from
+        std::vector<uint32_t> seen_;  ///< Epoch stamp per node, deduplicates a step's output
+        std::vector<uint32_t> count_; ///< Per-parent match counts of positional '//' steps
+        std::unordered_map<std::string_view, std::vector<StringId>> local_tags_; ///< Tags in use, by local name
+        uint32_t              epoch_{ 0 };
+        std::unordered_map<uint64_t, bool> memo_; ///< (step, node) answers of reaches()
+        std::unordered_set<uint64_t> visited_;    ///< (step, context) pairs expanded by findFirst()
+        NodeId                       best_{ NoNode }; ///< First result found so far by findFirst()
+    };
+
+} // namespace hlat
@@ -0,0 +1,346 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Incremental Evaluation
+ |  ---------------------------------------------------------------------------
+ |  Keeps the results of registered selectors current while the widget tree
+ |  changes between test steps.
+ |  Features:
+ |      * Subtree insertion, subtree removal and attribute deltas
+ |      * Per-selector dependencies on tags, attribute names and equality keys
+ |      * Only dependent selectors are re-evaluated; others are renumbered
+ |      * String pool compacted once dead strings outnumber live ones
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_eval.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hlat {
+
+    /// Tags and attributes a selector's result can depend on
+    ///
+    /// Deltas never change how existing nodes relate to each other; they only add or drop
+    /// nodes, or change attributes. A node can only affect a result (as a match, a context or
+    /// a counted position) if it passes some step's node test and attribute equalities, since
+    /// positions count only the nodes that pass the other conditions. So a subtree delta
+    /// matters only if one of its nodes carries one of `tags` or one of `keys`, or the
+    /// selector has an unguarded `*` or node() step. An attribute delta matters only if its
+    /// name is in `attributes`, on a node with one of `tags` or one of `keys` (before or after
+    /// the change), or the selector has an unguarded `*` or node() step.
+    struct SelectorDependencies {
+        bool                     any_tag{ false }; ///< Some '*' or node() step has no attribute equality
+        std::vector<std::string> tags;             ///< Tags named by its steps
+        std::vector<std::pair<std::string, std::string>> keys; ///< Equalities guarding its other '*' and node() steps
+        std::vector<std::string> attributes;       ///< Attribute names its predicates test
+
+        static SelectorDependencies of(const SelectorProgram& program) {
+            SelectorDependencies d;
+            auto add = [](auto& to, const auto& v) {
+                if (std::find(to.begin(), to.end(), v) == to.end()) to.push_back(v);
+            };
+            const auto& code = program.code;
+            for (size_t pc = 0; pc < code.size(); ) {
+                const uint32_t arg = bc::argument(code[pc]);
+                const size_t body = pc + bc::StepHeader, guard = code[pc + 2];
+                const uint32_t* key = nullptr;
+                for (size_t i = body; i < body + guard; i += bc::length(code[i])) {
+                    switch (bc::opcode(code[i])) {
+                    case bc::Opcode::AttrEq:  if (!key) key = &code[i + 1]; [[fallthrough]];
+                    case bc::Opcode::AttrNe:
+                    case bc::Opcode::AttrCmp: add(d.attributes, program.strings[code[i + 1]]); break;
+                    default: break;
+                    }
+                }
+                switch (static_cast<eval::NodeTest>(arg >> 8 & 0xff)) {
+                case eval::NodeTest::Name:    add(d.tags, program.strings[code[pc + 1]]); break;
+                case eval::NodeTest::Element:
+                case eval::NodeTest::Any:
+                    if (key) add(d.keys, std::pair{ program.strings[key[0]], program.strings[key[1]] });
+                    else d.any_tag = true;
+                    break;
+                case eval::NodeTest::None:    break;
+                }
+                pc = body + guard + code[pc + 3];
+            }
+            return d;
+        }
+    };
+
+    /// Keeps the results of registered selectors current across tree deltas
+    ///
+    /// Each delta produces the next tree and returns the selectors whose results were
+    /// re-evaluated: those whose SelectorDependencies the delta touches. Every other result
+    /// is carried over, with its node IDs shifted past an inserted or removed subtree. Node
+    /// IDs passed to a delta refer to the current tree(). The new tree is rebuilt in one
+    /// linear pass, which is cheap next to evaluating every selector again.
+    class IncrementalEvaluator {
+    public:
+        explicit IncrementalEvaluator(WidgetTree tree) : tree_(std::move(tree)), evaluator_(tree_) {}
+
+        /// Registers a selector, evaluates it and returns its index
+        size_t add(const std::vector<XLocator>& steps) {
+            SelectorProgram program = SelectorCompiler(steps).compile();
+            const auto selector = static_cast<uint32_t>(programs_.size());
+            SelectorDependencies deps = SelectorDependencies::of(program);
+            if (deps.any_tag) any_tag_.push_back(selector);
+            for (auto const& tag : deps.tags) dependents(by_tag_, tag).push_back(selector);
+            for (auto const& name : deps.attributes) dependents(by_attribute_, name).push_back(selector);
+            for (auto const& [name, value] : deps.keys) {
+                const StringId name_id = names_.intern(name), value_id = names_.intern(value);
+                by_key_[uint64_t{ name_id } << 32 | value_id].push_back(selector);
+            }
+            by_tag_.resize(names_.size());
+            by_attribute_.resize(names_.size());
+            results_.push_back(evaluator_.evaluate(evaluator_.bind(program)));
+            programs_.push_back(std::move(program));
+            dependencies_.push_back(std::move(deps));
+            stamps_.push_back(0);
+            return selector;
+        }
+
+        /// Current results of selector `i`, in document order
+        std::span<const NodeId> results(size_t i) const { return results_[i]; }
+
+        /// Number of registered selectors
+        size_t size() const { return programs_.size(); }
+
+        const WidgetTree& tree() const { return tree_; }
+
+        /// Inserts the top-level widgets of `fragment` as children of `parent`, before its
+        /// child `before` (NoNode: after the last child)
+        std::vector<size_t> insert(NodeId parent, NodeId before, const WidgetTree& fragment) {
+            checkNode(parent, "parent");
+            if (before != NoNode && (before >= tree_.size() || tree_.node(before).parent != parent))
+                throw std::runtime_error("Node " + std::to_string(before) + " is not a child of node " + std::to_string(parent));
+            if (fragment.size() < 2) return {};
+
+            ++stamp_;
+            touchSubtree(fragment, 1, static_cast<NodeId>(fragment.size()));
+            Edit edit;
+            edit.parent = parent;
+            edit.before = before;
+            edit.fragment = &fragment;
+            const NodeId at = before != NoNode ? before : tree_.node(parent).end;
+            const auto inserted = static_cast<int64_t>(fragment.size() - 1);
+            return apply(edit, [&](NodeId n) { return n < at ? int64_t{ n } : n + inserted; });
+        }
+
+        /// Removes `node` and its subtree
+        std::vector<size_t> remove(NodeId node) {
+            checkNode(node, "node");
+            if (node == WidgetTree::Document) throw std::runtime_error("The document node cannot be removed");
+
+            ++stamp_;
+            const NodeId end = tree_.node(node).end;
+            touchSubtree(tree_, node, end);
+            Edit edit;
+            edit.removed = node;
+            const auto removed = static_cast<int64_t>(end - node);
+            return apply(edit, [&](NodeId n) { return n < node ? int64_t{ n } : n < end ? int64_t{ -1 } : n - removed; });
+        }
+
+        /// Sets attribute `name` of `node` to `value`, or removes it if `value` is nullopt
+        std::vector<size_t> setAttribute(NodeId node, std::string_view name, std::optional<std::string_view> value) {
+            checkNode(node, "node");
+            if (node == WidgetTree::Document) throw std::runtime_error("The document node has no attributes");
+            const StringId name_id = tree_.strings().find(name);
+            const StringId current = name_id == NoString ? NoString : tree_.attribute(node, name_id);
+            if (current == NoString ? !value : value && tree_.strings().view(current) == *value) return {};
+
+            ++stamp_;
+            if (const StringId a = names_.table().find(name); a != NoString) {
+                const std::string_view tag = tree_.tagName(node);
+                // A guarded '*' step sees the node if it carries the key before or after the change
+                auto carries = [&](const std::pair<std::string, std::string>& key) {
+                    if (key.first == name)
+                        return (current != NoString && tree_.strings().view(current) == key.second) || (value && *value == key.second);
+                    const StringId k = tree_.strings().find(key.first);
+                    const StringId v = k == NoString ? NoString : tree_.attribute(node, k);
+                    return v != NoString && tree_.strings().view(v) == key.second;
+                };
+                for (const uint32_t s : by_attribute_[a]) {
+                    const auto& deps = dependencies_[s];
+                    if (deps.any_tag || std::find(deps.tags.begin(), deps.tags.end(), tag) != deps.tags.end()
+                        || std::any_of(deps.keys.begin(), deps.keys.end(), carries))
+                        stamps_[s] = stamp_;
+                }
+            }
+            Edit edit;
+            edit.attribute_node = node;
+            edit.name = name;
+            edit.value = value;
+            return apply(edit, [](NodeId n) { return int64_t{ n }; });
+        }
+
+    private:
+        /// One delta, as applied while replaying the current tree
+        struct Edit {
+            NodeId                          parent{ NoNode };         ///< Insertion parent
+            NodeId                          before{ NoNode };         ///< Insertion point among its children
+            const WidgetTree*               fragment{ nullptr };      ///< Inserted widgets
+            NodeId                          removed{ NoNode };        ///< Root of the removed subtree
+            NodeId                          attribute_node{ NoNode }; ///< Node whose attribute changes
+            std::string_view                name;
+            std::optional<std::string_view> value;
+        };
+
+        void checkNode(NodeId n, const char* what) const {
+            if (n >= tree_.size())
+                throw std::runtime_error(std::string("No ") + what + " " + std::to_string(n) + " in the tree");
+        }
+
+        std::vector<uint32_t>& dependents(std::vector<std::vector<uint32_t>>& index, std::string_view name) {
+            const StringId id = names_.intern(name);
+            by_tag_.resize(names_.size());
+            by_attribute_.resize(names_.size());
+            return index[id];
+        }
+
+        /// Marks the selectors that inserting or removing nodes [begin, end) of `tree` affects
+        void touchSubtree(const WidgetTree& tree, NodeId begin, NodeId end) {
+            const StringTable names = names_.table();
+            for (NodeId n = begin; n < end; ++n) {
+                if (const StringId tag = names.find(tree.tagName(n)); tag != NoString)
+                    for (const uint32_t s : by_tag_[tag]) stamps_[s] = stamp_;
+                if (by_key_.empty()) continue;
+                for (auto const& a : tree.attributes(n)) {
+                    const StringId name = names.find(tree.strings().view(a.name));
+                    const StringId value = names.find(tree.strings().view(a.value));
+                    if (name == NoString || value == NoString) continue;
+                    if (auto it = by_key_.find(uint64_t{ name } << 32 | value); it != by_key_.end())
+                        for (const uint32_t s : it->second) stamps_[s] = stamp_;
+                }
+            }
+        }
+
+        /// Rebuilds the tree with `edit`, re-evaluates the marked selectors and renumbers the
+        /// others through `renumber` (old ID to new ID, or -1 for removed nodes)
+        template<typename Renumber>
+        std::vector<size_t> apply(const Edit& edit, Renumber renumber) {
+            for (const uint32_t s : any_tag_) stamps_[s] = stamp_;
+            tree_ = rebuild(edit, mostlyDead());
+            evaluator_ = SelectorEvaluator(tree_);
+
+            std::vector<size_t> recomputed;
+            for (size_t s = 0; s < programs_.size(); ++s) {
+                if (stamps_[s] == stamp_) {
+                    results_[s] = evaluator_.evaluate(evaluator_.bind(programs_[s]));
+                    recomputed.push_back(s);
+                    continue;
+                }
+                // Renumbering is monotone, so the results stay in document order
+                auto& r = results_[s];
+                size_t kept = 0;
+                for (const NodeId n : r)
+                    if (const int64_t m = renumber(n); m >= 0) r[kept++] = static_cast<NodeId>(m);
+                r.resize(kept);
+            }
+            return recomputed;
+        }
+
+        /// True if most of the tree's string pool is dead: tags and values no node uses any more
+        ///
+        /// Live strings are only counted once the pool has doubled since the last count, so the
+        /// check costs amortized O(1) per interned string.
+        bool mostlyDead() {
+            const StringTable& strings = tree_.strings();
+            if (strings.size() < 2 * live_strings_ + 64) return false;
+            std::vector<bool> live(strings.size());
+            for (NodeId n = 0; n < tree_.size(); ++n) {
+                live[tree_.node(n).tag] = true;
+                for (auto const& a : tree_.attributes(n)) live[a.name] = live[a.value] = true;
+            }
+            live_strings_ = static_cast<size_t>(std::count(live.begin(), live.end(), true));
+            return 2 * live_strings_ < strings.size();
+        }
+
+        /// Replays the current tree with `edit` applied
+        ///
+        /// Strings normally keep their IDs, so only the fragment and the edited attribute are
+        /// interned and the pool only grows: removed widgets and replaced values leave their
+        /// strings behind. With `compact`, every string is interned again into a fresh pool,
+        /// which drops them; IDs then change, but none are kept across deltas.
+        WidgetTree rebuild(const Edit& edit, bool compact) const {
+            WidgetTreeBuilder builder = compact ? WidgetTreeBuilder() : WidgetTreeBuilder(tree_.strings());
+            auto copy = [&](const WidgetAttribute& a) {
+                if (compact) builder.attribute(tree_.strings().view(a.name), tree_.strings().view(a.value));
+                else builder.attribute(a.name, a.value);
+            };
+            auto emit = [&](NodeId n) {
+                if (compact) builder.open(tree_.tagName(n));
+                else builder.open(tree_.node(n).tag);
+                if (n != edit.attribute_node) {
+                    for (auto const& a : tree_.attributes(n)) copy(a);
+                    return;
+                }
+                bool found = false;
+                for (auto const& a : tree_.attributes(n)) {
+                    if (tree_.strings().view(a.name) != edit.name) {
+                        copy(a);
+                        continue;
+                    }
+                    found = true;
+                    if (edit.value) builder.attribute(edit.name, *edit.value);
+                }
+                if (!found && edit.value) builder.attribute(edit.name, *edit.value);
+            };
+            auto emitFragment = [&] {
+                const WidgetTree& f = *edit.fragment;
+                std::vector<NodeId> open;
+                for (NodeId n = 1; n < f.size(); ++n) {
+                    for (; !open.empty() && f.node(open.back()).end <= n; open.pop_back()) builder.close();
+                    builder.open(f.tagName(n));
+                    for (auto const& a : f.attributes(n))
+                        builder.attribute(f.strings().view(a.name), f.strings().view(a.value));
+                    open.push_back(n);
+                }
+                for (; !open.empty(); open.pop_back()) builder.close();
+            };
+            const bool appending = edit.fragment && edit.before == NoNode;
+
+            // Replay in document order; an element closes once the next ID leaves its subtree
+            std::vector<NodeId> open;
+            auto closeInnermost = [&] {
+                if (appending && open.back() == edit.parent) emitFragment();
+                builder.close();
+                open.pop_back();
+            };
+            for (NodeId n = 1; n < tree_.size(); ) {
+                while (!open.empty() && tree_.node(open.back()).end <= n) closeInnermost();
+                if (n == edit.removed) { n = tree_.node(n).end; continue; }
+                if (edit.fragment && n == edit.before) emitFragment();
+                emit(n);
+                open.push_back(n++);
+            }
+            while (!open.empty()) closeInnermost();
+            if (appending && edit.parent == WidgetTree::Document) emitFragment();
+            return std::move(builder).build();
+        }
+
+        WidgetTree                            tree_;
+        SelectorEvaluator                     evaluator_;
+        std::vector<SelectorProgram>          programs_;
+        std::vector<SelectorDependencies>     dependencies_;
+        std::vector<std::vector<NodeId>>      results_;
+        StringPool                            names_;        ///< Tags, attribute names and key values selectors depend on
+        std::vector<std::vector<uint32_t>>    by_tag_;       ///< Per name ID, selectors naming it as a tag
+        std::vector<std::vector<uint32_t>>    by_attribute_; ///< Per name ID, selectors testing it as an attribute
+        std::unordered_map<uint64_t, std::vector<uint32_t>> by_key_; ///< Per (name, value) ID pair, selectors keyed on it
+        std::vector<uint32_t>                 any_tag_;      ///< Selectors with an unguarded '*' or node() step
+        std::vector<uint32_t>                 stamps_;       ///< Per selector, the delta that last marked it
+        uint32_t                              stamp_{ 0 };
+        size_t                                live_strings_{ 0 }; ///< Live strings of the tree at the last count
+    };
+
+} // namespace hlat
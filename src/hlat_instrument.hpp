@@ -0,0 +1,525 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Instrumentation
+ |  ---------------------------------------------------------------------------
+ |  Companion header with per-stage latency and allocation instrumentation.
+ |  Features:
+ |      * StageHistograms policy for QtPythonDeclarationsFrom
+ |      * Per-thread, lock-free HDR-style histograms merged on demand
+ |      * Text and JSON reports
+ |      * ChromeTracer policy writing Chrome/Perfetto trace-event JSON
+ |      * Optional allocation counting (see HLAT_COUNT_ALLOCATIONS below)
+ |
+ |  Allocation counting replaces the global operator new/delete. Define
+ |  HLAT_COUNT_ALLOCATIONS in exactly one translation unit before including
+ |  this header; elsewhere allocation counts read as zero.
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat.hpp"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hlat {
+
+    // -----------------------------------------------------------------------------
+    // Allocation Counters
+    // -----------------------------------------------------------------------------
+
+    namespace instrument {
+        /// Per-thread allocation counters, maintained by the counting operator new
+        struct AllocationCounters {
+            uint64_t count{ 0 }; ///< Number of allocations made by this thread
+            uint64_t bytes{ 0 }; ///< Number of bytes requested by this thread
+        };
+
+        /// Returns the calling thread's allocation counters
+        inline AllocationCounters& threadAllocations() {
+            static thread_local AllocationCounters counters;
+            return counters;
+        }
+
+        /// Allocations made by the calling thread during one measured region
+        struct AllocationDelta {
+            uint64_t count{ 0 }; ///< Number of allocations
+            uint64_t bytes{ 0 }; ///< Number of bytes requested
+        };
+
+        /// Runs `fn` and returns the allocations it made on the calling thread
+        template<typename Fn>
+        AllocationDelta countAllocations(Fn&& fn) {
+            const AllocationCounters before = threadAllocations();
+            std::forward<Fn>(fn)();
+            const AllocationCounters& after = threadAllocations();
+            return { after.count - before.count, after.bytes - before.bytes };
+        }
+
+        /// Owns one T per recording thread; lookups after the first are lock-free
+        template<typename T>
+        class ThreadLocalRegistry {
+        public:
+            /// Returns the calling thread's T, creating it on first use
+            ///
+            /// T is constructed from its registration ordinal when it accepts one.
+            T& local() {
+                struct Slot { uint64_t registry; void* value; };
+                static thread_local std::vector<Slot> slots;
+                for (auto const& s : slots)
+                    if (s.registry == id_) return *static_cast<T*>(s.value);
+                std::lock_guard lock(mutex_);
+                T* value = nullptr;
+                if constexpr (std::is_constructible_v<T, size_t>)
+                    value = threads_.emplace_back(std::make_unique<T>(threads_.size())).get();
+                else
+                    value = threads_.emplace_back(std::make_unique<T>()).get();
+                slots.push_back({ id_, value });
+                return *value;
+            }
+
+            /// Invokes `fn` on every registered thread's T
+            template<typename Fn>
+            void forEach(Fn&& fn) {
+                std::lock_guard lock(mutex_);
+                for (auto const& t : threads_) fn(*t);
+            }
+
+        private:
+            static uint64_t nextId() {
+                static std::atomic<uint64_t> ids{ 0 };
+                return ++ids;
+            }
+
+            std::mutex                      mutex_;
+            std::vector<std::unique_ptr<T>> threads_;
+            uint64_t                        id_{ nextId() };
+        };
+    } // namespace instrument
+
+    // -----------------------------------------------------------------------------
+    // HDR-Style Histogram
+    // -----------------------------------------------------------------------------
+
+    /// Log-linear histogram of non-negative integers with ~3% relative precision
+    ///
+    /// Recording is a handful of relaxed atomic operations and is meant to be done by a single
+    /// owning thread; any thread may read or merge concurrently.
+    class Histogram {
+    public:
+        static constexpr unsigned SubBucketBits = 5;
+        static constexpr size_t   SubBuckets = size_t{ 1 } << SubBucketBits;
+        static constexpr size_t   Buckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+        Histogram() = default;
+        Histogram(const Histogram& other) { merge(other); }
+        Histogram& operator=(const Histogram& other) {
+            if (this != &other) { reset(); merge(other); }
+            return *this;
+        }
+
+        /// Records one value
+        void record(uint64_t value) {
+            bump(counts_[bucketOf(value)], 1);
+            bump(count_, 1);
+            bump(sum_, value);
+            if (value > max_.load(std::memory_order_relaxed)) max_.store(value, std::memory_order_relaxed);
+        }
+
+        /// Adds all values recorded in `other`
+        void merge(const Histogram& other) {
+            for (size_t i = 0; i < Buckets; ++i) {
+                uint64_t c = other.counts_[i].load(std::memory_order_relaxed);
+                if (c) counts_[i].fetch_add(c, std::memory_order_relaxed);
+            }
+            count_.fetch_add(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            uint64_t m = other.max_.load(std::memory_order_relaxed);
+            if (m > max_.load(std::memory_order_relaxed)) max_.store(m, std::memory_order_relaxed);
+        }
+
+        /// Clears all recorded values
+        void reset() {
+            for (auto& c : counts_) c.store(0, std::memory_order_relaxed);
+            count_.store(0, std::memory_order_relaxed);
+            sum_.store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+        uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+        uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+        double   mean() const { return count() ? static_cast<double>(sum()) / count() : 0.0; }
+
+        /// Returns the value at quantile `q` in [0, 1] (bucket lower bound)
+        uint64_t percentile(double q) const {
+            const uint64_t total = count();
+            if (total == 0) return 0;
+            const auto rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < Buckets; ++i) {
+                seen += counts_[i].load(std::memory_order_relaxed);
+                if (seen >= rank) return std::min(lowerBound(i), max());
+            }
+            return max();
+        }
+
+        /// Maps a value to its bucket index
+        static size_t bucketOf(uint64_t value) {
+            if (value < SubBuckets) return static_cast<size_t>(value);
+            const unsigned shift = static_cast<unsigned>(std::bit_width(value)) - 1 - SubBucketBits;
+            return ((shift + 1) << SubBucketBits) + static_cast<size_t>((value >> shift) - SubBuckets);
+        }
+
+        /// Smallest value mapped to bucket `index`
+        static uint64_t lowerBound(size_t index) {
+            if (index < SubBuckets) return index;
+            const size_t shift = (index >> SubBucketBits) - 1;
+            return static_cast<uint64_t>((index & (SubBuckets - 1)) + SubBuckets) << shift;
+        }
+
+    private:
+        static void bump(std::atomic<uint64_t>& a, uint64_t by) {
+            a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+
+        std::array<std::atomic<uint64_t>, Buckets> counts_{};
+        std::atomic<uint64_t>                      count_{ 0 };
+        std::atomic<uint64_t>                      sum_{ 0 };
+        std::atomic<uint64_t>                      max_{ 0 };
+    };
+
+    // -----------------------------------------------------------------------------
+    // Stage Histograms
+    // -----------------------------------------------------------------------------
+
+    /// Latency and allocation histograms for each pipeline stage
+    struct StageReport {
+        std::array<Histogram, PipelineStageCount> nanoseconds; ///< Wall time per stage call
+        std::array<Histogram, PipelineStageCount> allocations; ///< Allocations per stage call
+
+        /// Adds every histogram of `other`
+        void merge(const StageReport& other) {
+            for (size_t i = 0; i < PipelineStageCount; ++i) {
+                nanoseconds[i].merge(other.nanoseconds[i]);
+                allocations[i].merge(other.allocations[i]);
+            }
+        }
+
+        /// Formats one line per stage
+        std::string text() const {
+            std::ostringstream out;
+            out << "stage       calls        mean ns   p50 ns    p90 ns    p99 ns    max ns    allocs/call\n";
+            for (size_t i = 0; i < PipelineStageCount; ++i) {
+                auto const& h = nanoseconds[i];
+                char line[160];
+                std::snprintf(line, sizeof(line), "%-10s %7llu %14.1f %8llu %9llu %9llu %9llu %14.2f\n",
+                    std::string(stageName(static_cast<PipelineStage>(i))).c_str(),
+                    static_cast<unsigned long long>(h.count()), h.mean(),
+                    static_cast<unsigned long long>(h.percentile(0.50)),
+                    static_cast<unsigned long long>(h.percentile(0.90)),
+                    static_cast<unsigned long long>(h.percentile(0.99)),
+                    static_cast<unsigned long long>(h.max()),
+                    allocations[i].mean());
+                out << line;
+            }
+            return out.str();
+        }
+
+        /// Formats the report as a JSON object keyed by stage name
+        json toJson() const {
+            json out = json::object();
+            for (size_t i = 0; i < PipelineStageCount; ++i) {
+                auto const& h = nanoseconds[i];
+                auto const& a = allocations[i];
+                out[std::string(stageName(static_cast<PipelineStage>(i)))] = {
+                    { "calls", h.count() },
+                    { "ns", { { "mean", h.mean() }, { "p50", h.percentile(0.50) }, { "p90", h.percentile(0.90) },
+                              { "p99", h.percentile(0.99) }, { "max", h.max() } } },
+                    { "allocations", { { "mean", a.mean() }, { "p99", a.percentile(0.99) }, { "max", a.max() } } }
+                };
+            }
+            return out;
+        }
+    };
+
+    /// Instrumentation policy recording per-stage latency and allocation histograms
+    ///
+    /// Copies share one registry, so per-worker pipeline copies report into the same place.
+    /// Each recording thread owns a private StageReport; report() merges them on demand.
+    class StageHistograms {
+    public:
+        StageHistograms() : registry_(std::make_shared<instrument::ThreadLocalRegistry<StageReport>>()) {}
+
+        /// RAII measurement of one stage call
+        class Scope {
+        public:
+            Scope(StageReport& report, PipelineStage stage)
+                : report_(report)
+                , stage_(static_cast<size_t>(stage))
+                , allocs_(instrument::threadAllocations().count)
+                , start_(std::chrono::steady_clock::now()) {}
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            ~Scope() {
+                auto elapsed = std::chrono::steady_clock::now() - start_;
+                report_.nanoseconds[stage_].record(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+                report_.allocations[stage_].record(instrument::threadAllocations().count - allocs_);
+            }
+
+        private:
+            StageReport&                          report_;
+            size_t                                stage_;
+            uint64_t                              allocs_;
+            std::chrono::steady_clock::time_point start_;
+        };
+
+        /// Opens a measurement scope for `stage` on the calling thread
+        Scope scope(PipelineStage stage) const { return Scope(local(), stage); }
+
+        /// Merges the histograms of every thread recorded so far
+        StageReport report() const {
+            StageReport merged;
+            registry_->forEach([&](const StageReport& r) { merged.merge(r); });
+            return merged;
+        }
+
+    private:
+        /// Returns the calling thread's report, registering it on first use
+        StageReport& local() const { return registry_->local(); }
+
+        std::shared_ptr<instrument::ThreadLocalRegistry<StageReport>> registry_;
+    };
+
+    // -----------------------------------------------------------------------------
+    // Chrome Trace Export
+    // -----------------------------------------------------------------------------
+
+    /// Instrumentation policy writing Chrome/Perfetto trace-event JSON
+    ///
+    /// Every stage call becomes a complete ("X") event tagged with the recording thread and the
+    /// selector index last announced through beginSelector(). Events are buffered per thread in
+    /// fixed-size blocks; full blocks are handed to a background thread that formats and writes
+    /// them, so recording costs two clock reads (start and end) and one vector append per span.
+    /// Copies share one trace file, which is completed when the last copy is destroyed.
+    class ChromeTracer {
+        class Sink;
+
+    public:
+        /// Opens `path` for writing; `block_events` spans are buffered per thread before handing off
+        explicit ChromeTracer(const std::string& path, size_t block_events = 4096)
+            : sink_(std::make_shared<Sink>(path, std::max<size_t>(1, block_events))) {}
+
+        /// RAII span of one stage call
+        class Scope {
+        public:
+            Scope(Sink& sink, PipelineStage stage)
+                : sink_(sink)
+                , stage_(stage)
+                , start_(std::chrono::steady_clock::now()) {}
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            ~Scope() { sink_.record(stage_, start_, std::chrono::steady_clock::now()); }
+
+        private:
+            Sink&                                 sink_;
+            PipelineStage                         stage_;
+            std::chrono::steady_clock::time_point start_;
+        };
+
+        /// Opens a span for `stage` on the calling thread
+        Scope scope(PipelineStage stage) const { return Scope(*sink_, stage); }
+
+        /// Tags the calling thread's subsequent spans with input index `index`
+        void beginSelector(uint64_t index) const { sink_->buffers.local().selector = index; }
+
+    private:
+        struct Event {
+            uint64_t      start_ns;
+            uint64_t      duration_ns;
+            uint64_t      selector;
+            PipelineStage stage;
+        };
+
+        struct ThreadBuffer {
+            explicit ThreadBuffer(size_t ordinal) : tid(ordinal + 1) {}
+            size_t             tid;
+            uint64_t           selector{ UINT64_MAX };
+            std::vector<Event> events;
+        };
+
+        struct Block {
+            size_t             tid;
+            std::vector<Event> events;
+        };
+
+        class Sink {
+        public:
+            Sink(const std::string& path, size_t block_events)
+                : file_(std::fopen(path.c_str(), "wb"))
+                , block_events_(block_events)
+                , epoch_(std::chrono::steady_clock::now())
+            {
+                if (!file_) throw std::runtime_error("Cannot open trace file '" + path + "'");
+                std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file_);
+                flusher_ = std::thread([this] { flushLoop(); });
+            }
+
+            Sink(const Sink&) = delete;
+            Sink& operator=(const Sink&) = delete;
+
+            ~Sink() {
+                std::vector<size_t> tids;
+                buffers.forEach([&](ThreadBuffer& b) {
+                    tids.push_back(b.tid);
+                    if (!b.events.empty()) handOff(b);
+                });
+                {
+                    std::lock_guard lock(mutex_);
+                    stop_ = true;
+                }
+                ready_.notify_one();
+                flusher_.join();
+                for (size_t tid : tids) {
+                    std::fprintf(file_, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,"
+                        "\"args\":{\"name\":\"hlat worker %zu\"}}", written_++ ? ",\n" : "\n", tid, tid);
+                }
+                std::fputs("\n]}\n", file_);
+                std::fclose(file_);
+            }
+
+            /// Appends one span to the calling thread's buffer
+            void record(PipelineStage stage,
+                std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end)
+            {
+                ThreadBuffer& b = buffers.local();
+                if (b.events.capacity() == 0) b.events.reserve(block_events_);
+                b.events.push_back({
+                    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch_).count()),
+                    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()),
+                    b.selector, stage });
+                if (b.events.size() >= block_events_) handOff(b);
+            }
+
+            instrument::ThreadLocalRegistry<ThreadBuffer> buffers;
+
+        private:
+            /// Queues a thread's full buffer for the flusher and swaps in a recycled one
+            void handOff(ThreadBuffer& b) {
+                {
+                    std::lock_guard lock(mutex_);
+                    queue_.push_back({ b.tid, std::move(b.events) });
+                    if (!spare_.empty()) {
+                        b.events = std::move(spare_.back());
+                        spare_.pop_back();
+                    }
+                    else b.events = {};
+                }
+                ready_.notify_one();
+            }
+
+            void flushLoop() {
+                std::unique_lock lock(mutex_);
+                while (true) {
+                    ready_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+                    if (queue_.empty()) return;
+                    Block block = std::move(queue_.front());
+                    queue_.pop_front();
+                    lock.unlock();
+                    write(block);
+                    block.events.clear();
+                    lock.lock();
+                    spare_.push_back(std::move(block.events));
+                }
+            }
+
+            void write(const Block& block) {
+                for (auto const& e : block.events) {
+                    std::fprintf(file_, "%s{\"name\":\"%s\",\"cat\":\"hlat\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,"
+                        "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu",
+                        written_++ ? ",\n" : "\n",
+                        stageName(e.stage).data(), block.tid,
+                        static_cast<unsigned long long>(e.start_ns / 1000),
+                        static_cast<unsigned long long>(e.start_ns % 1000),
+                        static_cast<unsigned long long>(e.duration_ns / 1000),
+                        static_cast<unsigned long long>(e.duration_ns % 1000));
+                    if (e.selector != UINT64_MAX)
+                        std::fprintf(file_, ",\"args\":{\"selector\":%llu}", static_cast<unsigned long long>(e.selector));
+                    std::fputc('}', file_);
+                }
+            }
+
+            std::FILE*                            file_;
+            size_t                                block_events_;
+            std::chrono::steady_clock::time_point epoch_;
+            std::mutex                            mutex_;
+            std::condition_variable               ready_;
+            std::deque<Block>                     queue_;
+            std::vector<std::vector<Event>>       spare_;
+            bool                                  stop_{ false };
+            size_t                                written_{ 0 };
+            std::thread                           flusher_;
+        };
+
+        std::shared_ptr<Sink> sink_;
+    };
+
+} // namespace hlat
+
+// -----------------------------------------------------------------------------
+// Counting Global Allocator (opt-in, one translation unit)
+// -----------------------------------------------------------------------------
+
+#if defined(HLAT_COUNT_ALLOCATIONS) && !defined(HLAT_COUNT_ALLOCATIONS_DEFINED)
+#define HLAT_COUNT_ALLOCATIONS_DEFINED
+
+#include <cstdlib>
+#include <new>
+
+// GCC flags malloc/free inside replacement new/delete as mismatched once they are inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+    auto& c = hlat::instrument::threadAllocations();
+    ++c.count; c.bytes += size;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return ::operator new(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return ::operator new(size); } catch (...) { return nullptr; }
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { ::operator delete(p); }
+void operator delete(void* p, std::size_t) noexcept { ::operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { ::operator delete(p); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
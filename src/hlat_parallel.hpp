@@ -0,0 +1,238 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Parallel Evaluation
+ |  ---------------------------------------------------------------------------
+ |  Evaluates parsed selectors (std::vector<XLocator>) against a WidgetTree on
+ |  every core.
+ |  Features:
+ |      * Work-stealing thread pool with per-worker task queues
+ |      * Independent selectors evaluated concurrently, one evaluator per worker
+ |      * Leading '//' steps split into ID-range chunks, merged in document order
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_eval.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hlat {
+
+    /// Fixed set of threads running batches of indexed tasks
+    ///
+    /// run() deals the tasks to per-worker queues in contiguous blocks. A worker takes tasks
+    /// from the back of its own queue and, once that is empty, steals from the front of the
+    /// others', so uneven tasks (one selector walking the whole tree, the next a single
+    /// node) still keep every thread busy. The calling thread works as worker 0.
+    class WorkStealingPool {
+    public:
+        explicit WorkStealingPool(unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+            : queues_(std::max(1u, threads))
+        {
+            for (unsigned w = 1; w < queues_.size(); ++w) workers_.emplace_back([this, w] { loop(w); });
+        }
+
+        ~WorkStealingPool() {
+            { std::lock_guard lock(mutex_); stop_ = true; }
+            wake_.notify_all();
+        }
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        /// Number of workers, the calling thread included
+        unsigned threads() const { return static_cast<unsigned>(queues_.size()); }
+
+        /// Calls `fn(task, worker)` for every task in [0, tasks); returns once all have run
+        ///
+        /// `worker` is in [0, threads()), and no two concurrent calls share one, so it can
+        /// index per-worker scratch space. Rethrows the first exception a task threw. Not
+        /// reentrant: tasks must not call run() on the same pool.
+        template<typename Fn>
+        void run(size_t tasks, Fn&& fn) {
+            if (tasks == 0) return;
+            const size_t n = queues_.size();
+            for (size_t w = 0; w < n; ++w) {
+                std::lock_guard lock(queues_[w].mutex);
+                for (size_t t = tasks * w / n; t < tasks * (w + 1) / n; ++t) queues_[w].tasks.push_back(t);
+            }
+            std::function<void(size_t, unsigned)> job = std::forward<Fn>(fn);
+            {
+                std::lock_guard lock(mutex_);
+                job_ = &job;
+                error_ = nullptr;
+                finished_ = 0;
+                ++generation_;
+            }
+            wake_.notify_all();
+            drain(0);
+
+            std::unique_lock lock(mutex_);
+            done_.wait(lock, [&] { return finished_ == n - 1; });
+            job_ = nullptr;
+            if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+
+    private:
+        struct alignas(64) Queue {
+            std::mutex         mutex;
+            std::deque<size_t> tasks;
+        };
+
+        void loop(unsigned w) {
+            uint64_t seen = 0;
+            for (;;) {
+                {
+                    std::unique_lock lock(mutex_);
+                    wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                    if (stop_) return;
+                    seen = generation_;
+                }
+                drain(w);
+                { std::lock_guard lock(mutex_); ++finished_; }
+                done_.notify_one();
+            }
+        }
+
+        /// Runs tasks until every queue is empty; all tasks are queued before a batch starts
+        void drain(unsigned w) {
+            for (size_t task; take(w, task); ) {
+                try { (*job_)(task, w); }
+                catch (...) {
+                    std::lock_guard lock(mutex_);
+                    if (!error_) error_ = std::current_exception();
+                }
+            }
+        }
+
+        bool take(unsigned w, size_t& task) {
+            const size_t n = queues_.size();
+            for (size_t i = 0; i < n; ++i) {
+                auto& q = queues_[(w + i) % n];
+                std::lock_guard lock(q.mutex);
+                if (q.tasks.empty()) continue;
+                if (i == 0) { task = q.tasks.back(); q.tasks.pop_back(); }
+                else        { task = q.tasks.front(); q.tasks.pop_front(); }
+                return true;
+            }
+            return false;
+        }
+
+        std::vector<Queue>                      queues_;
+        std::mutex                              mutex_;
+        std::condition_variable                 wake_;     ///< A batch started, or the pool stops
+        std::condition_variable                 done_;     ///< A worker finished its part of a batch
+        std::function<void(size_t, unsigned)>*  job_{ nullptr };
+        std::exception_ptr                      error_;
+        uint64_t                                generation_{ 0 }; ///< Batches started
+        size_t                                  finished_{ 0 };   ///< Workers done with the current batch
+        bool                                    stop_{ false };
+        std::vector<std::jthread>               workers_;
+    };
+
+    /// Evaluates selectors against one tree on a WorkStealingPool
+    ///
+    /// Results are the same as SelectorEvaluator's. A batch compiles and evaluates its
+    /// selectors concurrently, each worker with its own SelectorEvaluator (created on first
+    /// use, so idle workers cost no scratch space). When a batch has fewer selectors than
+    /// the pool can keep busy, selectors that begin with a '//' step (see
+    /// SelectorEvaluator::divisible()) are split into ID ranges of their start node's
+    /// subtree; the parts are merged back into document order.
+    class ParallelEvaluator {
+    public:
+        /// Smallest ID range worth a task of its own
+        static constexpr size_t MinChunk = 4096;
+
+        explicit ParallelEvaluator(WidgetTree tree, unsigned threads = std::max(1u, std::thread::hardware_concurrency()))
+            : tree_(std::move(tree)), pool_(threads), evaluators_(pool_.threads()) {}
+
+        /// Evaluates one parsed selector; relative selectors start at `context`
+        std::vector<NodeId> evaluate(const std::vector<XLocator>& steps, NodeId context = WidgetTree::Document) {
+            return std::move(evaluate(std::span(&steps, 1), context).front());
+        }
+
+        /// Evaluates independent parsed selectors; result `i` belongs to `selectors[i]`
+        std::vector<std::vector<NodeId>> evaluate(std::span<const std::vector<XLocator>> selectors,
+            NodeId context = WidgetTree::Document)
+        {
+            if (selectors.empty()) return {};
+            std::vector<CompiledSelector> compiled(selectors.size());
+            if (selectors.size() == 1) compiled[0] = evaluator(0).compile(selectors[0]);
+            else pool_.run(selectors.size(), [&](size_t i, unsigned w) { compiled[i] = evaluator(w).compile(selectors[i]); });
+
+            // Task `first[i] + k` evaluates part k of selector i
+            struct Task { size_t selector; NodeId first, last; };
+            std::vector<Task> tasks;
+            std::vector<size_t> first(selectors.size() + 1, 0);
+            const size_t wanted = threads() == 1 ? 1 : (4 * size_t{ threads() } + selectors.size() - 1) / selectors.size();
+            for (size_t i = 0; i < selectors.size(); ++i) {
+                first[i] = tasks.size();
+                const NodeId start = compiled[i].absolute ? WidgetTree::Document : context;
+                const NodeId begin = start, end = tree_.node(start).end;
+                const size_t parts = SelectorEvaluator::divisible(compiled[i])
+                    ? std::clamp<size_t>((end - begin) / MinChunk, 1, wanted) : 1;
+                for (size_t k = 0; k < parts; ++k)
+                    tasks.push_back({ i, static_cast<NodeId>(begin + (end - begin) * k / parts),
+                        static_cast<NodeId>(begin + (end - begin) * (k + 1) / parts) });
+            }
+            first.back() = tasks.size();
+
+            std::vector<std::vector<NodeId>> parts(tasks.size());
+            pool_.run(tasks.size(), [&](size_t t, unsigned w) {
+                auto const& task = tasks[t];
+                parts[t] = evaluator(w).evaluate(compiled[task.selector], context, task.first, task.last);
+            });
+            std::vector<std::vector<NodeId>> out(selectors.size());
+            for (size_t i = 0; i < selectors.size(); ++i)
+                out[i] = merge(std::span(parts).subspan(first[i], first[i + 1] - first[i]));
+            return out;
+        }
+
+        /// Number of workers, the calling thread included
+        unsigned threads() const { return pool_.threads(); }
+
+        const WidgetTree& tree() const { return tree_; }
+
+    private:
+        SelectorEvaluator& evaluator(unsigned worker) {
+            if (!evaluators_[worker]) evaluators_[worker].emplace(tree_);
+            return *evaluators_[worker];
+        }
+
+        /// Concatenates the sorted parts of one result; sorts and deduplicates if they overlap
+        static std::vector<NodeId> merge(std::span<std::vector<NodeId>> parts) {
+            if (parts.size() == 1) return std::move(parts.front());
+            size_t total = 0;
+            for (auto const& p : parts) total += p.size();
+            std::vector<NodeId> out;
+            out.reserve(total);
+            bool ordered = true;
+            for (auto const& p : parts) {
+                if (p.empty()) continue;
+                ordered = ordered && (out.empty() || out.back() < p.front());
+                out.insert(out.end(), p.begin(), p.end());
+            }
+            if (!ordered) {
+                std::sort(out.begin(), out.end());
+                out.erase(std::unique(out.begin(), out.end()), out.end());
+            }
+            return out;
+        }
+
+        WidgetTree                                    tree_;
+        WorkStealingPool                              pool_;
+        std::vector<std::optional<SelectorEvaluator>> evaluators_; ///< One per worker, created on first use
+    };
+
+} // namespace hlat
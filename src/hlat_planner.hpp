@@ -0,0 +1,165 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Query Planning
+ |  ---------------------------------------------------------------------------
+ |  Per-tree statistics the evaluator uses to plan bound selectors.
+ |  Features:
+ |      * Tag and (attribute, value) frequencies, distinct values per attribute
+ |      * Average fan-out and depth for traversal estimates
+ |      * Selectivity and cost per guard instruction
+ |      * Guard reordering: cheap, selective conditions run first
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_bytecode.hpp"
+#include "hlat_tree.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace hlat {
+
+    /// Frequencies of one tree's tags and attributes, gathered once per evaluator
+    ///
+    /// Selectivities are fractions of the tree's widgets (the document node excluded) and
+    /// treat conditions as independent. Costs are in units of one attribute lookup on a
+    /// candidate node. Building is O(nodes + attribute keys); the (attribute, value) and tag
+    /// counts come straight from the tree's indexes, which the statistics share.
+    class TreeStatistics {
+    public:
+        TreeStatistics() = default;
+
+        explicit TreeStatistics(const WidgetTree& tree)
+            : tree_(tree), carriers_(tree.strings().size(), 0), distinct_(tree.strings().size(), 0)
+        {
+            auto const& runs = tree.arrays().attribute_runs;
+            for (size_t r = 0; r + 1 < runs.size(); ++r) {
+                carriers_[runs[r].name] += runs[r + 1].begin - runs[r].begin;
+                ++distinct_[runs[r].name];
+            }
+            // Every node is counted once per ancestor: the sum of proper subtree sizes
+            size_t parents = 0;
+            double ancestors = 0;
+            for (NodeId n = 1; n < tree.size(); ++n) {
+                auto const& node = tree.node(n);
+                parents += node.first_child != NoNode;
+                ancestors += node.end - n - 1;
+            }
+            widgets_ = std::max<double>(1, static_cast<double>(tree.size()) - 1);
+            fanout_ = widgets_ / (parents + 1); // the document node is a parent too
+            depth_ = ancestors / widgets_ + 1;
+        }
+
+        /// Number of widgets, at least 1
+        double widgets() const { return widgets_; }
+
+        /// Average number of children of a node that has any
+        double fanout() const { return fanout_; }
+
+        /// Average number of ancestors of a widget, the document node included
+        double depth() const { return depth_; }
+
+        /// Widgets with tag `tag`
+        double tagged(StringId tag) const { return static_cast<double>(tree_.tagged(tag).size()); }
+
+        /// Widgets carrying attribute `name`, with any value
+        double carrying(StringId name) const { return name < carriers_.size() ? carriers_[name] : 0; }
+
+        /// Distinct values of attribute `name`
+        double distinct(StringId name) const { return name < distinct_.size() ? distinct_[name] : 0; }
+
+        /// Fraction of widgets passing one bound guard instruction
+        double selectivity(const uint32_t* instr) const {
+            using bc::Opcode;
+            switch (bc::opcode(instr[0])) {
+            case Opcode::AttrEq: return tree_.withAttribute(instr[1], instr[2]).size() / widgets_;
+            case Opcode::AttrNe: return (carrying(instr[1]) - tree_.withAttribute(instr[1], instr[2]).size()) / widgets_;
+            case Opcode::AttrCmp:
+            {
+                // Values are unknown numbers: '=' picks one distinct value, '!=' the others, ranges half
+                const double carriers = carrying(instr[1]) / widgets_, values = std::max(1.0, distinct(instr[1]));
+                switch (static_cast<eval::Op>(bc::argument(instr[0]))) {
+                case eval::Op::Eq: return carriers / values;
+                case eval::Op::Ne: return carriers * (1 - 1 / values);
+                default:           return carriers / 2;
+                }
+            }
+            case Opcode::NameEq: return tagged(instr[1]) / widgets_;
+            case Opcode::NameNe: return 1 - tagged(instr[1]) / widgets_;
+            case Opcode::TagIn:
+            case Opcode::TagNotIn:
+            {
+                double hits = 0;
+                for (uint32_t i = 1; i <= bc::argument(instr[0]); ++i) hits += tagged(instr[i]);
+                return bc::opcode(instr[0]) == Opcode::TagIn ? hits / widgets_ : 1 - hits / widgets_;
+            }
+            default: return 0; // Fail
+            }
+        }
+
+        /// Cost of checking one bound guard instruction on a candidate
+        static double cost(const uint32_t* instr) {
+            using bc::Opcode;
+            switch (bc::opcode(instr[0])) {
+            case Opcode::AttrEq:
+            case Opcode::AttrNe:   return 1;
+            case Opcode::AttrCmp:  return 3; // lookup plus number parsing
+            case Opcode::NameEq:
+            case Opcode::NameNe:   return 0.5;
+            case Opcode::TagIn:
+            case Opcode::TagNotIn: return 0.5 + bc::argument(instr[0]) / 8.0;
+            default:               return 0;
+            }
+        }
+
+        /// Fraction of widgets passing a whole bound guard
+        double selectivity(const std::vector<uint32_t>& guard) const {
+            double s = 1;
+            for (size_t pc = 0; pc < guard.size(); pc += bc::length(guard[pc])) s *= selectivity(&guard[pc]);
+            return std::clamp(s, 0.0, 1.0);
+        }
+
+        /// Expected cost of running a bound guard on one candidate, in its current order
+        double cost(const std::vector<uint32_t>& guard) const {
+            double total = 0, reached = 1;
+            for (size_t pc = 0; pc < guard.size(); pc += bc::length(guard[pc])) {
+                total += reached * cost(&guard[pc]);
+                reached *= std::clamp(selectivity(&guard[pc]), 0.0, 1.0);
+            }
+            return total;
+        }
+
+        /// Reorders a bound guard so the expected cost of a check is minimal
+        ///
+        /// Conditions of a guard are a conjunction without side effects, so any order gives the
+        /// same answer. For independent conditions, ascending cost / (1 - selectivity) is the
+        /// optimal order: an `@objectName` equality runs before a numeric range test.
+        void order(std::vector<uint32_t>& guard) const {
+            if (guard.empty() || bc::length(guard[0]) == guard.size()) return;
+            struct Entry { double rank; size_t begin, length; };
+            std::vector<Entry> entries;
+            for (size_t pc = 0; pc < guard.size(); pc += bc::length(guard[pc])) {
+                const double pass = std::clamp(selectivity(&guard[pc]), 0.0, 1.0);
+                entries.push_back({ pass >= 1 ? std::numeric_limits<double>::infinity() : cost(&guard[pc]) / (1 - pass),
+                    pc, bc::length(guard[pc]) });
+            }
+            std::stable_sort(entries.begin(), entries.end(), [](auto const& a, auto const& b) { return a.rank < b.rank; });
+            std::vector<uint32_t> sorted;
+            sorted.reserve(guard.size());
+            for (auto const& e : entries) sorted.insert(sorted.end(), guard.begin() + e.begin, guard.begin() + e.begin + e.length);
+            guard.swap(sorted);
+        }
+
+    private:
+        WidgetTree            tree_;
+        std::vector<uint32_t> carriers_; ///< Widgets carrying each attribute name, by StringId
+        std::vector<uint32_t> distinct_; ///< Distinct values of each attribute name, by StringId
+        double                widgets_{ 1 };
+        double                fanout_{ 0 };
+        double                depth_{ 1 };
+    };
+
+} // namespace hlat
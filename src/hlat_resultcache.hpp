@@ -0,0 +1,216 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Result Cache
+ |  ---------------------------------------------------------------------------
+ |  Caches evaluated node-ID lists in front of SelectorEvaluator.
+ |  Features:
+ |      * Keyed on the parsed selector's structural hash, context and tree epoch
+ |      * Dropped automatically once a newer tree epoch is seen
+ |      * Bounded size with least-recently-used eviction
+ |      * Sharded, mutex-per-shard variant for multi-threaded runners
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_eval.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace hlat {
+
+    namespace detail {
+
+        /// Bounded LRU map from (selector, context) to results of one tree epoch
+        ///
+        /// Entries are found by structural hash and confirmed by comparing the steps, so a hash
+        /// collision is a miss, never a wrong result. Not synchronized.
+        class ResultLru {
+        public:
+            using Result = std::shared_ptr<const std::vector<NodeId>>;
+
+            explicit ResultLru(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+            /// Adopts `epoch` if it is newer, dropping older results; false if it is older
+            bool advance(uint64_t epoch) {
+                if (epoch < epoch_) return false;
+                if (epoch > epoch_) { clear(); epoch_ = epoch; }
+                return true;
+            }
+
+            Result find(size_t hash, const std::vector<XLocator>& steps, NodeId context) {
+                auto it = index_.find(hash);
+                if (it == index_.end() || it->second->context != context || it->second->steps != steps) return nullptr;
+                order_.splice(order_.begin(), order_, it->second);
+                return it->second->result;
+            }
+
+            /// Stores a result, replacing a colliding entry and evicting the least recent one
+            void insert(size_t hash, const std::vector<XLocator>& steps, NodeId context, Result result) {
+                if (auto it = index_.find(hash); it != index_.end()) {
+                    order_.erase(it->second);
+                    index_.erase(it);
+                }
+                if (index_.size() == capacity_) {
+                    index_.erase(order_.back().hash);
+                    order_.pop_back();
+                }
+                order_.push_front({ hash, steps, context, std::move(result) });
+                index_.emplace(hash, order_.begin());
+            }
+
+            void clear() {
+                index_.clear();
+                order_.clear();
+            }
+
+            size_t size() const { return index_.size(); }
+
+        private:
+            struct Entry {
+                size_t                hash;
+                std::vector<XLocator> steps;
+                NodeId                context;
+                Result                result;
+            };
+
+            size_t                                                  capacity_;
+            uint64_t                                                epoch_{ 0 };
+            std::list<Entry>                                        order_; ///< Most recently used first
+            std::unordered_map<size_t, std::list<Entry>::iterator>  index_;
+        };
+
+        /// Key hash of a parsed selector evaluated from `context`
+        inline size_t resultKey(const std::vector<XLocator>& steps, NodeId context) {
+            return util::hashCombine(util::structuralHash(steps), context);
+        }
+
+    } // namespace detail
+
+    /// Caches the results of parsed selectors against an evaluator's tree
+    ///
+    /// A test harness resolving the same selector many times against one snapshot pays
+    /// for the evaluation once; later calls cost a structural hash and a comparison of the
+    /// steps. Results belong to one tree epoch (WidgetTree::epoch()): the first call with a
+    /// newer tree drops every cached result, and calls with an older tree bypass the cache.
+    /// Not synchronized; see ConcurrentResultCache.
+    class ResultCache {
+    public:
+        explicit ResultCache(size_t capacity = 4096) : lru_(capacity) {}
+
+        /// Result of `steps` from `context`, evaluated by `evaluator` on a miss
+        ///
+        /// The reference stays valid until the next call.
+        const std::vector<NodeId>& evaluate(SelectorEvaluator& evaluator, const std::vector<XLocator>& steps,
+            NodeId context = WidgetTree::Document)
+        {
+            if (!lru_.advance(evaluator.tree().epoch())) {
+                ++misses_;
+                return bypass_ = evaluator.evaluate(steps, context);
+            }
+            const size_t hash = detail::resultKey(steps, context);
+            if (auto hit = lru_.find(hash, steps, context)) {
+                ++hits_;
+                last_ = std::move(hit);
+                return *last_;
+            }
+            ++misses_;
+            last_ = std::make_shared<const std::vector<NodeId>>(evaluator.evaluate(steps, context));
+            lru_.insert(hash, steps, context, last_);
+            return *last_;
+        }
+
+        void clear() { lru_.clear(); }
+
+        size_t size() const { return lru_.size(); }
+        uint64_t hits() const { return hits_; }
+        uint64_t misses() const { return misses_; }
+
+    private:
+        detail::ResultLru         lru_;
+        detail::ResultLru::Result last_;   ///< Keeps the returned result alive past its eviction
+        std::vector<NodeId>       bypass_; ///< Result for a tree older than the cached epoch
+        uint64_t                  hits_{ 0 };
+        uint64_t                  misses_{ 0 };
+    };
+
+    /// ResultCache for many threads, each evaluating with its own SelectorEvaluator
+    ///
+    /// Selectors hash to one of `Shards` independently locked LRU maps, so threads rarely
+    /// contend. Evaluation never holds a lock: on a miss, or for a tree older than the shard's
+    /// epoch, the result is computed unlocked; when two threads miss on the same key at once,
+    /// both evaluate and the later insert wins. Results are shared: they stay valid
+    /// after eviction for as long as a caller holds them.
+    class ConcurrentResultCache {
+    public:
+        static constexpr size_t Shards = 16;
+
+        using Result = detail::ResultLru::Result;
+
+        explicit ConcurrentResultCache(size_t capacity = 4096) {
+            for (auto& shard : shards_) shard = std::make_unique<Shard>((capacity + Shards - 1) / Shards);
+        }
+
+        /// Result of `steps` from `context`, evaluated by `evaluator` on a miss
+        Result evaluate(SelectorEvaluator& evaluator, const std::vector<XLocator>& steps,
+            NodeId context = WidgetTree::Document)
+        {
+            const uint64_t epoch = evaluator.tree().epoch();
+            const size_t hash = detail::resultKey(steps, context);
+            auto& shard = *shards_[hash % Shards];
+            {
+                // A tree older than the shard's epoch bypasses the cache, still outside the lock
+                std::lock_guard lock(shard.mutex);
+                if (shard.lru.advance(epoch)) {
+                    if (auto hit = shard.lru.find(hash, steps, context)) {
+                        hits_.fetch_add(1, std::memory_order_relaxed);
+                        return hit;
+                    }
+                }
+            }
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            auto result = std::make_shared<const std::vector<NodeId>>(evaluator.evaluate(steps, context));
+            std::lock_guard lock(shard.mutex);
+            if (shard.lru.advance(epoch)) shard.lru.insert(hash, steps, context, result);
+            return result;
+        }
+
+        void clear() {
+            for (auto& shard : shards_) {
+                std::lock_guard lock(shard->mutex);
+                shard->lru.clear();
+            }
+        }
+
+        size_t size() const {
+            size_t total = 0;
+            for (auto& shard : shards_) {
+                std::lock_guard lock(shard->mutex);
+                total += shard->lru.size();
+            }
+            return total;
+        }
+
+        uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+        uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+    private:
+        struct alignas(64) Shard {
+            explicit Shard(size_t capacity) : lru(capacity) {}
+            mutable std::mutex mutex;
+            detail::ResultLru  lru;
+        };
+
+        std::array<std::unique_ptr<Shard>, Shards> shards_;
+        std::atomic<uint64_t>                      hits_{ 0 };
+        std::atomic<uint64_t>                      misses_{ 0 };
+    };
+
+} // namespace hlat
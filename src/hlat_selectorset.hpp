@@ -0,0 +1,304 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Selector Sets
+ |  ---------------------------------------------------------------------------
+ |  Matches many parsed selectors against a WidgetTree in one pre-order pass.
+ |  Features:
+ |      * One trie of compiled steps shared by every selector in the set
+ |      * Per-state tag dispatch of child, descendant and self transitions
+ |      * Subtrees no selector can reach are skipped wholesale
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_eval.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace hlat {
+
+    namespace eval {
+
+        /// Structural equality of compiled steps
+        inline bool equivalent(const Step& a, const Step& b) {
+            return a.axis == b.axis && a.test == b.test && a.tag == b.tag && a.per_parent == b.per_parent
+                && a.guard == b.guard && a.positions == b.positions;
+        }
+
+    } // namespace eval
+
+    /// Trie of compiled steps shared by the selectors of a set
+    ///
+    /// Each selector is a path from the start state; equivalent steps out of one state share
+    /// an edge. Edges are grouped by how they move from the node that holds the source state
+    /// (to a child, a descendant, the node itself or a following sibling) and indexed by tag,
+    /// so a node only tries the edges its tag can take. Drivers such as SelectorSet and
+    /// SelectorStream own the traversal and the per-node state.
+    class StepAutomaton {
+    public:
+        enum class Move : uint8_t { Child, Descendant, Self, FollowingSibling };
+
+        struct Edge {
+            eval::Step step;
+            uint32_t   target;
+        };
+
+        /// Outgoing edges of one kind: named tests sorted by tag, the rest listed apart
+        struct Transitions {
+            std::vector<std::pair<StringId, uint32_t>> named; ///< (tag, edge), sorted by tag
+            std::vector<uint32_t>                      other; ///< '*' and node() edges
+
+            bool empty() const { return named.empty() && other.empty(); }
+
+            template<typename Fn>
+            void forTag(StringId tag, Fn&& fn) const {
+                auto lo = std::lower_bound(named.begin(), named.end(), std::pair{ tag, uint32_t{ 0 } });
+                for (; lo != named.end() && lo->first == tag; ++lo) fn(lo->second);
+                for (uint32_t e : other) fn(e);
+            }
+
+            void insert(const eval::Step& step, uint32_t edge) {
+                if (step.test != eval::NodeTest::Name) { other.push_back(edge); return; }
+                named.insert(std::upper_bound(named.begin(), named.end(), std::pair{ step.tag, edge }), { step.tag, edge });
+            }
+        };
+
+        struct State {
+            Transitions           child, descendant, self, following_sibling;
+            std::vector<uint32_t> accepts; ///< Selectors ending in this state
+        };
+
+        StepAutomaton() : states_(1) {}
+
+        /// True for steps the automaton can follow: downward steps and following siblings
+        static bool supports(const eval::Step& step) {
+            return eval::isDownward(step) || step.axis == Axis::FollowingSibling;
+        }
+
+        /// Adds the path of `steps`, which must all be supported, accepting `selector` at its end
+        void add(const std::vector<eval::Step>& steps, uint32_t selector) {
+            uint32_t state = 0;
+            for (auto& step : steps) {
+                switch (step.axis) {
+                case Axis::Child:            state = transition(state, Move::Child, step); break;
+                case Axis::Descendant:       state = transition(state, Move::Descendant, step); break;
+                case Axis::Self:             state = transition(state, Move::Self, step); break;
+                case Axis::FollowingSibling: state = transition(state, Move::FollowingSibling, step); break;
+                default: // descendant-or-self: the node itself or any node below it
+                {
+                    const uint32_t target = transition(state, Move::Self, step);
+                    link(state, Move::Descendant, step, target);
+                    state = target;
+                }
+                }
+            }
+            states_[state].accepts.push_back(selector);
+        }
+
+        size_t size() const { return states_.size(); }
+        const State& state(uint32_t s) const { return states_[s]; }
+        const Edge& edge(uint32_t e) const { return edges_[e]; }
+        size_t edges() const { return edges_.size(); }
+
+    private:
+        Transitions& transitions(uint32_t state, Move move) {
+            auto& s = states_[state];
+            switch (move) {
+            case Move::Child:      return s.child;
+            case Move::Descendant: return s.descendant;
+            case Move::Self:       return s.self;
+            default:               return s.following_sibling;
+            }
+        }
+
+        /// Follows the edge for `step` out of `state`, adding it on first sight
+        uint32_t transition(uint32_t state, Move move, const eval::Step& step) {
+            uint32_t found = UINT32_MAX;
+            transitions(state, move).forTag(step.tag, [&](uint32_t e) {
+                if (found == UINT32_MAX && eval::equivalent(edges_[e].step, step)) found = edges_[e].target;
+            });
+            if (found != UINT32_MAX) return found;
+            const auto target = static_cast<uint32_t>(states_.size());
+            states_.emplace_back();
+            link(state, move, step, target);
+            return target;
+        }
+
+        /// Adds an edge from `state` to `target` unless an equivalent one exists
+        void link(uint32_t state, Move move, const eval::Step& step, uint32_t target) {
+            bool exists = false;
+            transitions(state, move).forTag(step.tag, [&](uint32_t e) {
+                exists = exists || (edges_[e].target == target && eval::equivalent(edges_[e].step, step));
+            });
+            if (exists) return;
+            edges_.push_back({ step, target });
+            transitions(state, move).insert(step, static_cast<uint32_t>(edges_.size() - 1));
+        }
+
+        std::vector<State> states_;
+        std::vector<Edge>  edges_;
+    };
+
+    /// A set of selectors compiled into one automaton over a WidgetTree
+    ///
+    /// Selectors become paths in a trie whose edges are compiled steps, so common prefixes
+    /// such as `//form[@objectName='login']` are tested once for the whole set. match()
+    /// runs the automaton during a single pre-order pass: every node is visited at most
+    /// once, and the cost is O(nodes * active states) rather than O(nodes * selectors).
+    ///
+    /// Downward steps (self, child, '//' and descendant) are matched by the automaton.
+    /// Selectors using other axes are evaluated one by one with a SelectorEvaluator.
+    class SelectorSet {
+    public:
+        explicit SelectorSet(WidgetTree tree)
+            : evaluator_(std::move(tree)) {}
+
+        /// Adds a parsed selector; returns its index into match()'s results
+        size_t add(const std::vector<XLocator>& steps) {
+            CompiledSelector compiled = evaluator_.compile(steps);
+            const size_t index = selectors_++;
+            if (compiled.unsatisfiable) return index;
+            if (std::all_of(compiled.steps.begin(), compiled.steps.end(), eval::isDownward))
+                automaton_.add(compiled.steps, static_cast<uint32_t>(index));
+            else fallback_.push_back({ index, std::move(compiled) });
+            return index;
+        }
+
+        /// Number of selectors added
+        size_t size() const { return selectors_; }
+
+        /// Number of automaton states, including the start state
+        size_t states() const { return automaton_.size(); }
+
+        /// Number of selectors evaluated outside the automaton
+        size_t fallbacks() const { return fallback_.size(); }
+
+        const WidgetTree& tree() const { return evaluator_.tree(); }
+
+        /// Matches every selector; result i holds selector i's nodes in document order
+        std::vector<std::vector<NodeId>> match() {
+            std::vector<std::vector<NodeId>> results(selectors_);
+            auto const& tree = evaluator_.tree();
+            stamp_.assign(automaton_.size(), 0);
+            pending_stamp_.assign(automaton_.size(), 0);
+            epoch_ = 0;
+            frames_.clear(); active_.clear(); pending_.clear(); counters_.clear();
+
+            for (NodeId n = WidgetTree::Document; n < tree.size(); ) {
+                while (!frames_.empty() && frames_.back().end <= n) pop();
+                n = visit(n, results);
+            }
+            while (!frames_.empty()) pop();
+
+            for (auto& [index, compiled] : fallback_) results[index] = evaluator_.evaluate(compiled);
+            return results;
+        }
+
+    private:
+        /// Per open node of the pass: its active states and the descendant-pending states
+        struct Frame {
+            NodeId   end;             ///< One past the node's last descendant
+            uint32_t active_begin;    ///< States the node is in: active_[active_begin, active_end)
+            uint32_t active_end;
+            uint32_t pending_begin;   ///< States whose descendant edges apply to its children
+            uint32_t pending_end;
+            uint32_t counters_begin;  ///< Per-edge sibling counts of its children
+        };
+
+        /// Computes node `n`'s states, records its matches and returns the next node to visit
+        NodeId visit(NodeId n, std::vector<std::vector<NodeId>>& results) {
+            auto const& tree = evaluator_.tree();
+            auto const& node = tree.node(n);
+            const auto begin = static_cast<uint32_t>(active_.size());
+            if (++epoch_ == 0) {
+                std::fill(stamp_.begin(), stamp_.end(), 0);
+                std::fill(pending_stamp_.begin(), pending_stamp_.end(), 0);
+                epoch_ = 1;
+            }
+
+            if (n == WidgetTree::Document) enter(0);
+            else {
+                const Frame& parent = frames_.back(); // the root frame never closes before its subtree
+                for (uint32_t i = parent.active_begin; i < parent.active_end; ++i)
+                    automaton_.state(active_[i]).child.forTag(node.tag, [&](uint32_t e) { follow(e, n, true); });
+                for (uint32_t i = parent.pending_begin; i < parent.pending_end; ++i)
+                    automaton_.state(pending_[i]).descendant.forTag(node.tag, [&](uint32_t e) { follow(e, n, true); });
+            }
+            for (size_t i = begin; i < active_.size(); ++i) // self edges may chain
+                automaton_.state(active_[i]).self.forTag(node.tag, [&](uint32_t e) { follow(e, n, false); });
+            for (size_t i = begin; i < active_.size(); ++i)
+                for (uint32_t selector : automaton_.state(active_[i]).accepts) results[selector].push_back(n);
+
+            if (node.end == n + 1) { active_.resize(begin); return n + 1; } // leaf
+
+            // Children see the parent's pending states plus this node's states with descendant edges
+            const auto pending_begin = static_cast<uint32_t>(pending_.size());
+            if (!frames_.empty())
+                for (uint32_t i = frames_.back().pending_begin; i < frames_.back().pending_end; ++i) addPending(pending_[i]);
+            for (size_t i = begin; i < active_.size(); ++i)
+                if (!automaton_.state(active_[i]).descendant.empty())
+                    addPending(active_[i]);
+
+            // Nothing below this node can match: skip its subtree
+            if (active_.size() == begin && pending_.size() == pending_begin) return node.end;
+            frames_.push_back({ node.end, begin, static_cast<uint32_t>(active_.size()),
+                pending_begin, static_cast<uint32_t>(pending_.size()), static_cast<uint32_t>(counters_.size()) });
+            return n + 1;
+        }
+
+        /// Takes edge `e` into node `n` if its guard holds; sibling positions count per parent
+        void follow(uint32_t e, NodeId n, bool counted) {
+            auto const& edge = automaton_.edge(e);
+            if (!eval::matches(evaluator_.tree(), edge.step, n)) return;
+            if (!edge.step.positions.empty()) {
+                size_t position = 1;
+                if (counted) {
+                    auto it = std::find_if(counters_.begin() + frames_.back().counters_begin, counters_.end(),
+                        [&](auto const& c) { return c.first == e; });
+                    if (it == counters_.end()) { counters_.push_back({ e, 0 }); it = counters_.end() - 1; }
+                    position = ++it->second;
+                }
+                if (!eval::matchesPosition(edge.step, position)) return;
+            }
+            enter(edge.target);
+        }
+
+        void enter(uint32_t state) {
+            if (stamp_[state] == epoch_) return;
+            stamp_[state] = epoch_;
+            active_.push_back(state);
+        }
+
+        void addPending(uint32_t state) {
+            if (pending_stamp_[state] == epoch_) return;
+            pending_stamp_[state] = epoch_;
+            pending_.push_back(state);
+        }
+
+        void pop() {
+            const Frame& f = frames_.back();
+            active_.resize(f.active_begin);
+            pending_.resize(f.pending_begin);
+            counters_.resize(f.counters_begin);
+            frames_.pop_back();
+        }
+
+        SelectorEvaluator                               evaluator_;
+        StepAutomaton                                   automaton_;
+        std::vector<std::pair<size_t, CompiledSelector>> fallback_;
+        size_t                                          selectors_{ 0 };
+
+        // Scratch space of match()
+        std::vector<uint32_t>                   stamp_;         ///< Epoch per state, deduplicates a node's states
+        std::vector<uint32_t>                   pending_stamp_; ///< Same for its pending states
+        uint32_t                                epoch_{ 0 };
+        std::vector<Frame>                      frames_;
+        std::vector<uint32_t>                   active_;
+        std::vector<uint32_t>                   pending_;
+        std::vector<std::pair<uint32_t, uint32_t>> counters_; ///< (edge, count) per open frame
+    };
+
+} // namespace hlat
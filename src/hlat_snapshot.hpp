@@ -0,0 +1,583 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Snapshot Loading
+ |  ---------------------------------------------------------------------------
+ |  Reads XML or JSON dumps of a Qt object tree into a WidgetTree, or feeds
+ |  them as events to any open / attribute / close sink (SelectorStream).
+ |  Saves and maps binary tree images for fast reuse across processes.
+ |  Features:
+ |      * Single forward pass over a memory-mapped dump, no DOM
+ |      * Structural characters located 16 bytes at a time (SSE2)
+ |      * Names and values passed as views; copies only to decode escapes
+ |      * Binary tree images saved atomically and mapped for use in place
+ |  Requires a POSIX platform (mmap/madvise) for the file functions.
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_batch.hpp"
+#include "hlat_tree.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace hlat {
+
+    namespace util {
+
+        /// First byte in [p, end) equal to one of `Cs`, or `end`
+        ///
+        /// With SSE2 the bytes are compared 16 at a time; the tail is scanned bytewise.
+        template<char... Cs>
+        const char* findAny(const char* p, const char* end) {
+#if defined(__SSE2__)
+            while (end - p >= 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                __m128i hits = _mm_setzero_si128();
+                ((hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8(Cs)))), ...);
+                if (const int mask = _mm_movemask_epi8(hits)) return p + std::countr_zero(static_cast<unsigned>(mask));
+                p += 16;
+            }
+#endif
+            while (p != end && ((*p != Cs) && ...)) ++p;
+            return p;
+        }
+
+        constexpr bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+        /// First byte in [p, end) that is not XML/JSON whitespace, or `end`
+        inline const char* skipSpace(const char* p, const char* end) {
+            // Short runs are the norm; long indentation runs take the vector path
+            for (int i = 0; i < 4; ++i, ++p)
+                if (p == end || !isSpace(*p)) return p;
+#if defined(__SSE2__)
+            while (end - p >= 16) {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                const __m128i space = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))),
+                    _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))));
+                if (const int mask = ~_mm_movemask_epi8(space) & 0xffff)
+                    return p + std::countr_zero(static_cast<unsigned>(mask));
+                p += 16;
+            }
+#endif
+            while (p != end && isSpace(*p)) ++p;
+            return p;
+        }
+
+        /// Appends code point `cp` to `out` as UTF-8
+        inline void appendUtf8(std::string& out, uint32_t cp) {
+            if (cp < 0x80) out += static_cast<char>(cp);
+            else if (cp < 0x800) {
+                out += static_cast<char>(0xc0 | cp >> 6);
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+            else if (cp < 0x10000) {
+                out += static_cast<char>(0xe0 | cp >> 12);
+                out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+            else {
+                out += static_cast<char>(0xf0 | cp >> 18);
+                out += static_cast<char>(0x80 | (cp >> 12 & 0x3f));
+                out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+        }
+
+    } // namespace util
+
+    /// Dump formats understood by SnapshotReader
+    enum class SnapshotFormat : uint8_t {
+        Auto, ///< XML if the first significant byte is '<', JSON otherwise
+        Xml,  ///< Elements are widgets, attributes are properties; text, comments and PIs are skipped
+        Json  ///< Objects are widgets: a tag member, a children array, scalar members as properties
+    };
+
+    /// How SnapshotReader interprets a dump
+    struct SnapshotOptions {
+        SnapshotFormat format{ SnapshotFormat::Auto };
+        std::string    tag_key{ "class" };         ///< JSON member holding a widget's tag
+        std::string    children_key{ "children" }; ///< JSON member holding a widget's child objects
+    };
+
+    /// Parses a widget tree dump in one forward pass
+    ///
+    /// read() reports every widget to a sink with WidgetTreeBuilder's interface, so a dump
+    /// can be loaded (load()) or evaluated without building the tree (SelectorStream).
+    /// Names and values are passed as views into the input, or into a scratch buffer when
+    /// escapes had to be decoded; sinks must copy what they keep. Malformed input throws
+    /// std::runtime_error with the byte offset.
+    ///
+    /// XML: every element is a widget and its attributes are its properties. Character
+    /// data, comments, CDATA, processing instructions and DOCTYPE are skipped; the five
+    /// predefined entities and character references are decoded.
+    ///
+    /// JSON: the top level is a widget object or an array of them. A widget's `tag_key`
+    /// member names it, `children_key` lists its children, and every other string, number
+    /// or boolean member is a property (numbers and booleans keep their literal text).
+    /// Nested objects and arrays under other keys are skipped. Since properties must
+    /// reach the sink before any child, they must precede `children_key`.
+    class SnapshotReader {
+    public:
+        explicit SnapshotReader(std::string_view input, SnapshotOptions options = {})
+            : begin_(input.data()), end_(input.data() + input.size()), options_(std::move(options))
+        {
+            // UTF-8 byte order mark
+            if (input.starts_with("\xEF\xBB\xBF")) begin_ += 3;
+        }
+
+        /// Reports every widget to `sink` in document order
+        template<typename Sink>
+        void read(Sink& sink) {
+            SnapshotFormat format = options_.format;
+            if (format == SnapshotFormat::Auto) {
+                const char* p = util::skipSpace(begin_, end_);
+                format = p != end_ && *p == '<' ? SnapshotFormat::Xml : SnapshotFormat::Json;
+            }
+            if (format == SnapshotFormat::Xml) readXml(sink);
+            else readJson(sink);
+        }
+
+        /// Builds a WidgetTree from the dump
+        WidgetTree load() {
+            WidgetTreeBuilder builder;
+            read(builder);
+            return std::move(builder).build();
+        }
+
+    private:
+        // ---------------------------------------------------------------- XML
+
+        template<typename Sink>
+        void readXml(Sink& sink) {
+            std::vector<std::string_view> open; // tag names, views into the input
+            const char* p = begin_;
+            while ((p = static_cast<const char*>(std::memchr(p, '<', static_cast<size_t>(end_ - p))))) {
+                if (++p == end_) fail(p, "unexpected end after '<'");
+                switch (*p) {
+                case '?': p = skipPast(p, "?>"); break;
+                case '!':
+                    if (startsWith(p, "!--")) p = skipPast(p + 3, "-->");
+                    else if (startsWith(p, "![CDATA[")) p = skipPast(p + 8, "]]>");
+                    else p = skipDeclaration(p);
+                    break;
+                case '/':
+                {
+                    const std::string_view name = xmlName(++p);
+                    p = util::skipSpace(p, end_);
+                    if (p == end_ || *p != '>') fail(p, "expected '>' after end tag name");
+                    if (open.empty() || open.back() != name)
+                        fail(p, "end tag '" + std::string(name) + "' does not match the open element");
+                    open.pop_back();
+                    sink.close();
+                    ++p;
+                    break;
+                }
+                default:
+                {
+                    const std::string_view name = xmlName(p);
+                    sink.open(name);
+                    if (xmlAttributes(p, sink)) sink.close(); // "/>"
+                    else open.push_back(name);
+                }
+                }
+            }
+            if (!open.empty()) fail(end_, "element '" + std::string(open.back()) + "' left open");
+        }
+
+        /// Reads attributes up to the end of a start tag; true if it was self-closing
+        template<typename Sink>
+        bool xmlAttributes(const char*& p, Sink& sink) {
+            for (;;) {
+                p = util::skipSpace(p, end_);
+                if (p == end_) fail(p, "unexpected end inside a start tag");
+                if (*p == '>') { ++p; return false; }
+                if (*p == '/') {
+                    if (end_ - p < 2 || p[1] != '>') fail(p, "expected '/>'");
+                    p += 2;
+                    return true;
+                }
+                const std::string_view name = xmlName(p);
+                p = util::skipSpace(p, end_);
+                if (p == end_ || *p != '=') fail(p, "expected '=' after attribute name");
+                p = util::skipSpace(p + 1, end_);
+                if (p == end_ || (*p != '"' && *p != '\'')) fail(p, "expected a quoted attribute value");
+                const char quote = *p++;
+                const char* e = quote == '"' ? util::findAny<'"', '&'>(p, end_) : util::findAny<'\'', '&'>(p, end_);
+                if (e != end_ && *e == quote) {
+                    sink.attribute(name, std::string_view(p, static_cast<size_t>(e - p)));
+                    p = e + 1;
+                    continue;
+                }
+                // Entities: decode the rest of the value into the scratch buffer
+                scratch_.assign(p, e);
+                for (p = e; p != end_ && *p != quote; ) {
+                    if (*p == '&') { p = xmlEntity(p); continue; }
+                    e = quote == '"' ? util::findAny<'"', '&'>(p, end_) : util::findAny<'\'', '&'>(p, end_);
+                    scratch_.append(p, e);
+                    p = e;
+                }
+                if (p == end_) fail(p, "unterminated attribute value");
+                ++p;
+                sink.attribute(name, scratch_);
+            }
+        }
+
+        /// Decodes the entity or character reference at `p` into the scratch buffer
+        const char* xmlEntity(const char* p) {
+            const char* semi = static_cast<const char*>(std::memchr(p, ';', std::min<size_t>(static_cast<size_t>(end_ - p), 12)));
+            if (!semi) fail(p, "unterminated entity");
+            const std::string_view entity(p + 1, static_cast<size_t>(semi - p - 1));
+            if (entity == "lt") scratch_ += '<';
+            else if (entity == "gt") scratch_ += '>';
+            else if (entity == "amp") scratch_ += '&';
+            else if (entity == "quot") scratch_ += '"';
+            else if (entity == "apos") scratch_ += '\'';
+            else if (entity.size() > 1 && entity[0] == '#') {
+                const bool hex = entity[1] == 'x' || entity[1] == 'X';
+                uint32_t cp = 0;
+                const std::string_view digits = entity.substr(hex ? 2 : 1);
+                auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), cp, hex ? 16 : 10);
+                if (digits.empty() || ec != std::errc{} || end != digits.data() + digits.size() || cp > 0x10ffff)
+                    fail(p, "bad character reference");
+                util::appendUtf8(scratch_, cp);
+            }
+            else fail(p, "unknown entity '&" + std::string(entity) + ";'");
+            return semi + 1;
+        }
+
+        /// Reads an element or attribute name at `p`
+        std::string_view xmlName(const char*& p) {
+            const char* start = p;
+            while (p != end_ && !util::isSpace(*p) && *p != '>' && *p != '/' && *p != '=') ++p;
+            if (p == start) fail(p, "expected a name");
+            return { start, static_cast<size_t>(p - start) };
+        }
+
+        /// Skips a DOCTYPE or other declaration, including an internal subset in brackets
+        const char* skipDeclaration(const char* p) {
+            int brackets = 0;
+            for (; p != end_; ++p) {
+                if (*p == '[') ++brackets;
+                else if (*p == ']') --brackets;
+                else if (*p == '>' && brackets <= 0) return p + 1;
+            }
+            fail(p, "unterminated declaration");
+        }
+
+        // --------------------------------------------------------------- JSON
+
+        /// A decoded string: a view into the input, or a slice of the scratch buffer
+        struct Text {
+            const char* data{ nullptr }; ///< Null: scratch_[offset, offset + size)
+            size_t      offset{ 0 };
+            size_t      size{ 0 };
+        };
+
+        /// A widget object being read; unopened until its tag and properties are known
+        struct Level {
+            bool   opened{ false };
+            bool   has_tag{ false };
+            Text   tag;
+            size_t properties{ 0 }; ///< Its first buffered property in pending_
+        };
+
+        std::string_view view(const Text& t) const {
+            return t.data ? std::string_view(t.data, t.size) : std::string_view(scratch_).substr(t.offset, t.size);
+        }
+
+        template<typename Sink>
+        void readJson(Sink& sink) {
+            // Only the innermost level can be unopened, so the scratch buffer is reset on every open
+            std::vector<Level> stack;
+            pending_.clear();
+            scratch_.clear();
+            const char* p = util::skipSpace(begin_, end_);
+            const bool top_array = p != end_ && *p == '[';
+            if (top_array) {
+                p = util::skipSpace(p + 1, end_);
+                if (p != end_ && *p == ']') { expectEnd(p + 1); return; }
+            }
+            if (p == end_ || *p != '{') fail(p, "expected a widget object");
+            stack.push_back({ false, false, {}, pending_.size() });
+            ++p;
+            bool first = true;
+
+            for (;;) {
+                // Inside the members of stack.back()
+                p = util::skipSpace(p, end_);
+                if (p == end_) fail(p, "unexpected end inside a widget object");
+                if (!(first && *p == '}')) {
+                    if (*p != '"') fail(p, "expected a member name");
+                    const Text key = jsonString(p);
+                    p = util::skipSpace(p, end_);
+                    if (p == end_ || *p != ':') fail(p, "expected ':'");
+                    p = util::skipSpace(p + 1, end_);
+                    if (p == end_) fail(p, "unexpected end before a value");
+                    Level& w = stack.back();
+                    const std::string_view name = view(key);
+
+                    if (name == options_.children_key) {
+                        if (*p != '[') fail(p, "'" + options_.children_key + "' must be an array");
+                        openLevel(w, sink, p);
+                        p = util::skipSpace(p + 1, end_);
+                        if (p != end_ && *p == '{') {
+                            stack.push_back({ false, false, {}, pending_.size() });
+                            ++p;
+                            first = true;
+                            continue;
+                        }
+                        if (p == end_ || *p != ']') fail(p, "expected a widget object");
+                        ++p;
+                    }
+                    else if (name == options_.tag_key) {
+                        if (*p != '"') fail(p, "'" + options_.tag_key + "' must be a string");
+                        if (w.opened) fail(p, "'" + options_.tag_key + "' must precede '" + options_.children_key + "'");
+                        w.tag = jsonString(p);
+                        w.has_tag = true;
+                    }
+                    else if (*p == '{' || *p == '[') p = skipJsonValue(p);
+                    else {
+                        if (w.opened) fail(p, "properties must precede '" + options_.children_key + "'");
+                        if (*p == '"') pending_.push_back({ key, jsonString(p) });
+                        else if (startsWith(p, "null")) p += 4;
+                        else pending_.push_back({ key, jsonScalar(p) });
+                    }
+                }
+
+                // After a member (or at '}' of an empty object): more members, or the object ends
+                first = false;
+                p = util::skipSpace(p, end_);
+                if (p != end_ && *p == ',') { ++p; continue; }
+                if (p == end_ || *p != '}') fail(p, "expected ',' or '}'");
+                ++p;
+
+                // Close widgets, and the children arrays they end, until another member or child follows
+                for (;;) {
+                    openLevel(stack.back(), sink, p);
+                    sink.close();
+                    stack.pop_back();
+                    p = util::skipSpace(p, end_);
+                    if (p != end_ && *p == ',') {
+                        p = util::skipSpace(p + 1, end_);
+                        if (stack.empty() && !top_array) fail(p, "trailing data after the widget object");
+                        if (p == end_ || *p != '{') fail(p, "expected a widget object");
+                        stack.push_back({ false, false, {}, pending_.size() });
+                        ++p;
+                        first = true;
+                        break;
+                    }
+                    if (stack.empty()) {
+                        if (top_array) {
+                            if (p == end_ || *p != ']') fail(p, "expected ',' or ']'");
+                            ++p;
+                        }
+                        expectEnd(p);
+                        return;
+                    }
+                    if (p == end_ || *p != ']') fail(p, "expected ',' or ']'");
+                    p = util::skipSpace(p + 1, end_);
+                    // Back among the parent's members
+                    if (p != end_ && *p == ',') { ++p; break; }
+                    if (p == end_ || *p != '}') fail(p, "expected ',' or '}'");
+                    ++p;
+                }
+            }
+        }
+
+        /// Opens a widget with its buffered properties, once
+        template<typename Sink>
+        void openLevel(Level& w, Sink& sink, const char* p) {
+            if (w.opened) return;
+            if (!w.has_tag) fail(p, "widget object without '" + options_.tag_key + "'");
+            sink.open(view(w.tag));
+            for (size_t i = w.properties; i < pending_.size(); ++i)
+                sink.attribute(view(pending_[i].name), view(pending_[i].value));
+            pending_.resize(w.properties);
+            scratch_.clear();
+            w.opened = true;
+        }
+
+        /// Reads the string starting at the quote `p`; decodes escapes into the scratch buffer
+        Text jsonString(const char*& p) {
+            const char* start = ++p;
+            const char* e = util::findAny<'"', '\\'>(p, end_);
+            if (e == end_) fail(start, "unterminated string");
+            if (*e == '"') {
+                p = e + 1;
+                return { start, 0, static_cast<size_t>(e - start) };
+            }
+            Text t{ nullptr, scratch_.size(), 0 };
+            scratch_.append(start, e);
+            for (p = e; ; ) {
+                if (p == end_) fail(start, "unterminated string");
+                if (*p == '"') break;
+                if (*p == '\\') { p = jsonEscape(p); continue; }
+                e = util::findAny<'"', '\\'>(p, end_);
+                scratch_.append(p, e);
+                p = e;
+            }
+            ++p;
+            t.size = scratch_.size() - t.offset;
+            return t;
+        }
+
+        /// Decodes the escape sequence at `p` into the scratch buffer
+        const char* jsonEscape(const char* p) {
+            if (end_ - p < 2) fail(p, "unterminated escape");
+            switch (p[1]) {
+            case '"':  scratch_ += '"';  return p + 2;
+            case '\\': scratch_ += '\\'; return p + 2;
+            case '/':  scratch_ += '/';  return p + 2;
+            case 'b':  scratch_ += '\b'; return p + 2;
+            case 'f':  scratch_ += '\f'; return p + 2;
+            case 'n':  scratch_ += '\n'; return p + 2;
+            case 'r':  scratch_ += '\r'; return p + 2;
+            case 't':  scratch_ += '\t'; return p + 2;
+            case 'u':
+            {
+                uint32_t cp = hex4(p + 2);
+                p += 6;
+                // Surrogate pair
+                if (cp >= 0xd800 && cp < 0xdc00 && end_ - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    const uint32_t low = hex4(p + 2);
+                    if (low >= 0xdc00 && low < 0xe000) {
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                        p += 6;
+                    }
+                }
+                util::appendUtf8(scratch_, cp);
+                return p;
+            }
+            default: fail(p, "bad escape");
+            }
+        }
+
+        uint32_t hex4(const char* p) const {
+            uint32_t v = 0;
+            if (end_ - p < 4) fail(p, "bad \\u escape");
+            auto [end, ec] = std::from_chars(p, p + 4, v, 16);
+            if (ec != std::errc{} || end != p + 4) fail(p, "bad \\u escape");
+            return v;
+        }
+
+        /// Reads a number, true or false as its literal text
+        Text jsonScalar(const char*& p) {
+            const char* start = p;
+            while (p != end_ && !util::isSpace(*p) && *p != ',' && *p != '}' && *p != ']') ++p;
+            const std::string_view text(start, static_cast<size_t>(p - start));
+            const bool number = text.find_first_not_of("0123456789+-.eE") == std::string_view::npos && !text.empty();
+            if (!number && text != "true" && text != "false") fail(start, "expected a value");
+            return { start, 0, text.size() };
+        }
+
+        /// Skips a nested object or array, strings included
+        const char* skipJsonValue(const char* p) {
+            size_t depth = 0;
+            for (; ; ++p) {
+                p = util::findAny<'"', '{', '}', '[', ']'>(p, end_);
+                if (p == end_) fail(p, "unterminated object or array");
+                switch (*p) {
+                case '"':
+                    for (++p; ; p += 2) {
+                        p = util::findAny<'"', '\\'>(p, end_);
+                        if (end_ - p < 2) fail(p, "unterminated string");
+                        if (*p == '"') break;
+                    }
+                    break;
+                case '{':
+                case '[': ++depth; break;
+                default:
+                    if (--depth == 0) return p + 1;
+                }
+            }
+        }
+
+        void expectEnd(const char* p) const {
+            if (util::skipSpace(p, end_) != end_) fail(p, "trailing data after the snapshot");
+        }
+
+        // ------------------------------------------------------------- Common
+
+        bool startsWith(const char* p, std::string_view s) const {
+            return static_cast<size_t>(end_ - p) >= s.size() && std::string_view(p, s.size()) == s;
+        }
+
+        const char* skipPast(const char* p, std::string_view terminator) const {
+            const size_t at = std::string_view(p, static_cast<size_t>(end_ - p)).find(terminator);
+            if (at == std::string_view::npos) fail(p, "missing '" + std::string(terminator) + "'");
+            return p + at + terminator.size();
+        }
+
+        [[noreturn]] void fail(const char* p, const std::string& what) const {
+            throw std::runtime_error("Snapshot error at byte " + std::to_string(p - begin_) + ": " + what);
+        }
+
+        struct Property {
+            Text name;
+            Text value;
+        };
+
+        const char*           begin_;
+        const char*           end_;
+        SnapshotOptions       options_;
+        std::string           scratch_;  ///< Decoded escapes of the current value or widget
+        std::vector<Property> pending_;  ///< JSON properties of the widget not opened yet
+    };
+
+    /// Loads a snapshot file through a read-only memory mapping
+    inline WidgetTree loadSnapshot(const std::string& path, SnapshotOptions options = {}) {
+        MappedFile file(path);
+        return SnapshotReader(file.bytes(), std::move(options)).load();
+    }
+
+    /// Writes a tree image (WidgetTree::serialize) for mapWidgetTree()
+    ///
+    /// The image is written under a temporary name and renamed into place, so processes
+    /// mapping `path` concurrently never see a partial file.
+    inline void saveWidgetTree(const WidgetTree& tree, const std::string& path) {
+        const std::string image = tree.serialize();
+        const std::string temporary = path + ".tmp" + std::to_string(::getpid());
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(image.data(), static_cast<std::streamsize>(image.size()));
+            if (!out.flush()) throw std::runtime_error("Cannot write '" + temporary + "'");
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("Cannot rename '" + temporary + "' to '" + path + "': " + std::strerror(errno));
+        }
+    }
+
+    /// Maps a tree image and uses it in place; pages load on first touch and are shared
+    /// through the page cache by every process mapping the same file
+    ///
+    /// Opening checks the header and section bounds in O(1) and touches no array page. With
+    /// `verify`, the arrays are also checked in one linear pass (WidgetTree::verify), which
+    /// reads the whole file: use it for images from storage that may have damaged them, such
+    /// as a download or a shared cache, rather than on every open. Throws on a malformed image.
+    inline WidgetTree mapWidgetTree(const std::string& path, bool verify = false) {
+        auto file = std::make_shared<const MappedFile>(path, MADV_NORMAL);
+        const std::string_view image = file->bytes();
+        WidgetTree tree = WidgetTree::view(image, std::move(file));
+        if (const char* error = verify ? tree.verify() : nullptr)
+            throw std::runtime_error("Malformed tree image '" + path + "': " + error);
+        return tree;
+    }
+
+} // namespace hlat
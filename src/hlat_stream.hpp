@@ -0,0 +1,402 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Streaming Evaluation
+ |  ---------------------------------------------------------------------------
+ |  Matches a set of parsed selectors against start-element / attribute /
+ |  end-element events of a widget tree dump, without building the tree.
+ |  Features:
+ |      * Child, descendant, descendant-or-self, self and following-sibling steps
+ |      * Matches reported as soon as an element's attributes are complete
+ |      * Memory proportional to tree depth and set size, not tree size
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat_bytecode.hpp"
+#include "hlat_eval.hpp"
+#include "hlat_selectorset.hpp"
+#include "hlat_tree.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hlat {
+
+    /// Evaluates a set of selectors over a stream of tree events
+    ///
+    /// Events mirror WidgetTreeBuilder: open(), attribute() right after it, close(), and
+    /// finish() at the end. Nodes are numbered like the builder would number them (the
+    /// document is 0, then elements in start order), so matches line up with a WidgetTree
+    /// built from the same events. Each element is matched once its attributes are
+    /// complete, at the next open() or close(), and `on_match(selector, node)` is called
+    /// in document order.
+    ///
+    /// Selectors share a StepAutomaton. The stream keeps one frame per open element: its
+    /// active and descendant-pending states, per-edge sibling counters and the sources of
+    /// following-sibling steps. Subtrees no state can reach are only counted. Memory is
+    /// O(depth * states) with one exception: a following-sibling step whose positions have
+    /// no upper bound (`following-sibling::a[position()>2]`) keeps one source per matching
+    /// earlier sibling.
+    class SelectorStream {
+    public:
+        using MatchFn = std::function<void(size_t selector, NodeId node)>;
+
+        explicit SelectorStream(MatchFn on_match)
+            : on_match_(std::move(on_match)) {}
+
+        /// Adds a parsed selector; returns the index passed to `on_match`
+        size_t add(const std::vector<XLocator>& steps) { return add(SelectorCompiler(steps).compile()); }
+
+        /// Adds a compiled selector; throws if it uses an axis the stream cannot follow
+        size_t add(const SelectorProgram& program) {
+            if (started_) throw std::runtime_error("Selectors must be added before the first event");
+            std::vector<eval::Step> steps = bind(program);
+            for (auto const& step : steps)
+                if (!StepAutomaton::supports(step))
+                    throw std::runtime_error("Selector is not streamable: only child, descendant(-or-self), self and "
+                        "following-sibling steps are supported, with positions counted among siblings");
+            automaton_.add(steps, static_cast<uint32_t>(selectors_));
+            return selectors_++;
+        }
+
+        /// Starts an element
+        void open(std::string_view tag) {
+            begin();
+            if (element_open_) commit();
+            if (next_ == NoNode) throw std::runtime_error("Widget tree exceeds 2^32-1 nodes");
+            current_ = next_++;
+            attributes_allowed_ = true;
+            if (skipped_ > 0) { ++skipped_; return; }
+            element_open_ = true;
+            tag_name_.assign(tag);
+            tag_ = lookup(tag);
+            attribute_count_ = 0;
+        }
+
+        /// Adds an attribute to the element opened last
+        void attribute(std::string_view name, std::string_view value) {
+            if (!attributes_allowed_) throw std::runtime_error("Attribute must directly follow its element's start");
+            if (!element_open_) return; // inside a skipped subtree
+            const StringId id = pool_.table().find(name);
+            if (id == NoString) return;   // no selector tests it
+            if (attribute_count_ == attributes_.size()) attributes_.emplace_back();
+            auto& a = attributes_[attribute_count_++];
+            a.name = id;
+            a.value = lookup(value);
+            a.text.assign(value);
+        }
+
+        /// Ends the element opened last
+        void close() {
+            if (element_open_) commit();
+            attributes_allowed_ = false;
+            if (skipped_ > 0) { --skipped_; return; }
+            if (frames_.size() < 2) throw std::runtime_error("Unbalanced end of element");
+            pop();
+        }
+
+        /// Ends the stream; every element must have been closed
+        void finish() {
+            begin();
+            if (element_open_) commit();
+            if (frames_.size() + skipped_ != 1)
+                throw std::runtime_error(std::to_string(frames_.size() + skipped_ - 1) + " element(s) left open");
+        }
+
+        /// Number of selectors added
+        size_t size() const { return selectors_; }
+
+        /// Nodes seen so far, including the document node
+        NodeId nodes() const { return next_; }
+
+        /// Depth of the element currently open (0 at document level)
+        size_t depth() const { return frames_.size() + skipped_ - (started_ ? 1 : 0); }
+
+    private:
+        /// Value and tag IDs the stream's pool does not know; no literal compares equal
+        static constexpr StringId Unknown = NoString - 1;
+
+        struct Attribute {
+            StringId    name{ NoString };
+            StringId    value{ Unknown };
+            std::string text;
+        };
+
+        /// The element being matched, as seen by eval::runGuard()
+        struct Element {
+            const SelectorStream& s;
+
+            StringId tag() const { return s.tag_; }
+            std::string_view localName() const { return eval::localName(s.tag_name_); }
+            StringId attribute(StringId name) const {
+                const Attribute* a = s.find(name);
+                return a ? a->value : NoString;
+            }
+            double number(StringId name) const {
+                const Attribute* a = s.find(name);
+                return a ? eval::toNumber(a->text) : std::numeric_limits<double>::quiet_NaN();
+            }
+            std::string_view text(StringId id) const { return s.pool_.table().view(id); }
+        };
+
+        /// Where a following-sibling step may start: an earlier sibling in the edge's source state
+        struct Source {
+            uint32_t edge;
+            uint32_t base;  ///< The edge's sibling count when the source was seen
+            uint32_t limit; ///< Highest position the edge can still accept (UINT32_MAX: none)
+        };
+
+        /// Per open element whose subtree can still match
+        struct Frame {
+            uint32_t active_begin;   ///< States the element is in: active_[active_begin, active_end)
+            uint32_t active_end;
+            uint32_t pending_begin;  ///< States whose descendant edges apply to its children
+            uint32_t pending_end;
+            uint32_t counters_begin; ///< Per-edge sibling counts of its children
+            uint32_t sources_begin;  ///< Following-sibling sources among its children
+        };
+
+        /// Resolves a program's literals against the stream's pool, interning them
+        std::vector<eval::Step> bind(const SelectorProgram& program) {
+            if (const char* error = program.verify())
+                throw std::runtime_error(std::string("Malformed selector program: ") + error);
+            std::vector<StringId> ids(program.strings.size());
+            for (size_t i = 0; i < ids.size(); ++i) ids[i] = pool_.intern(program.strings[i]);
+
+            std::vector<eval::Step> steps;
+            auto const& code = program.code;
+            for (size_t pc = 0; pc < code.size(); ) {
+                const size_t guard = code[pc + 2], positions = code[pc + 3];
+                const size_t body = pc + bc::StepHeader;
+                eval::Step step;
+                const uint32_t arg = bc::argument(code[pc]);
+                step.axis = static_cast<Axis>(arg & 0xff);
+                step.test = static_cast<eval::NodeTest>(arg >> 8 & 0xff);
+                step.per_parent = (arg >> 16) != 0;
+                if (step.test == eval::NodeTest::Name) step.tag = ids[code[pc + 1]];
+
+                step.guard.assign(code.begin() + body, code.begin() + body + guard);
+                for (size_t i = 0; i < step.guard.size(); i += bc::length(step.guard[i])) {
+                    switch (bc::opcode(step.guard[i])) {
+                    case bc::Opcode::AttrEq:
+                    case bc::Opcode::AttrNe:  step.guard[i + 2] = ids[step.guard[i + 2]]; [[fallthrough]];
+                    case bc::Opcode::AttrCmp:
+                    case bc::Opcode::NameEq:
+                    case bc::Opcode::NameNe:
+                    case bc::Opcode::LocalEq:
+                    case bc::Opcode::LocalNe: step.guard[i + 1] = ids[step.guard[i + 1]]; break;
+                    default:                  break;
+                    }
+                }
+                step.positions.assign(code.begin() + body + guard, code.begin() + body + guard + positions);
+                steps.push_back(std::move(step));
+                pc = body + guard + positions;
+            }
+            return steps;
+        }
+
+        StringId lookup(std::string_view s) const {
+            const StringId id = pool_.table().find(s);
+            return id == NoString ? Unknown : id;
+        }
+
+        const Attribute* find(StringId name) const {
+            for (size_t i = 0; i < attribute_count_; ++i)
+                if (attributes_[i].name == name) return &attributes_[i];
+            return nullptr;
+        }
+
+        /// Matches the document node on the first event
+        void begin() {
+            if (started_) return;
+            started_ = true;
+            stamp_.assign(automaton_.size(), 0);
+            pending_stamp_.assign(automaton_.size(), 0);
+            tag_name_.clear();
+            tag_ = lookup("");
+            attribute_count_ = 0;
+            current_ = WidgetTree::Document;
+            next_ = WidgetTree::Document + 1;
+            commit();
+        }
+
+        /// Computes the current element's states, reports its matches and opens its frame
+        void commit() {
+            element_open_ = false;
+            attributes_allowed_ = false;
+            const NodeId n = current_;
+            const auto begin = static_cast<uint32_t>(active_.size());
+            if (++epoch_ == 0) {
+                std::fill(stamp_.begin(), stamp_.end(), 0);
+                std::fill(pending_stamp_.begin(), pending_stamp_.end(), 0);
+                epoch_ = 1;
+            }
+
+            if (n == WidgetTree::Document) enter(0);
+            else {
+                const Frame& parent = frames_.back();
+                for (uint32_t i = parent.active_begin; i < parent.active_end; ++i)
+                    automaton_.state(active_[i]).child.forTag(tag_, [&](uint32_t e) { follow(e, n, true); });
+                for (uint32_t i = parent.pending_begin; i < parent.pending_end; ++i)
+                    automaton_.state(pending_[i]).descendant.forTag(tag_, [&](uint32_t e) { follow(e, n, true); });
+                followSiblings(n);
+            }
+            for (size_t i = begin; i < active_.size(); ++i) // self edges may chain
+                automaton_.state(active_[i]).self.forTag(tag_, [&](uint32_t e) { follow(e, n, false); });
+            for (size_t i = begin; i < active_.size(); ++i)
+                for (uint32_t selector : automaton_.state(active_[i]).accepts) on_match_(selector, n);
+
+            // Later siblings may continue from this element's following-sibling edges
+            if (n != WidgetTree::Document)
+                for (size_t i = begin; i < active_.size(); ++i) {
+                    auto const& t = automaton_.state(active_[i]).following_sibling;
+                    for (auto const& [tag, e] : t.named) addSource(e);
+                    for (uint32_t e : t.other) addSource(e);
+                }
+
+            // Children see the parent's pending states plus this element's states with descendant edges
+            const auto pending_begin = static_cast<uint32_t>(pending_.size());
+            if (!frames_.empty())
+                for (uint32_t i = frames_.back().pending_begin; i < frames_.back().pending_end; ++i) addPending(pending_[i]);
+            for (size_t i = begin; i < active_.size(); ++i)
+                if (!automaton_.state(active_[i]).descendant.empty()) addPending(active_[i]);
+
+            // Nothing below this element can match: only count its subtree
+            if (n != WidgetTree::Document && active_.size() == begin && pending_.size() == pending_begin) {
+                skipped_ = 1;
+                return;
+            }
+            frames_.push_back({ begin, static_cast<uint32_t>(active_.size()), pending_begin,
+                static_cast<uint32_t>(pending_.size()), static_cast<uint32_t>(counters_.size()),
+                static_cast<uint32_t>(sources_.size()) });
+        }
+
+        /// Takes edge `e` into node `n` if its guard holds; sibling positions count per parent
+        void follow(uint32_t e, NodeId n, bool counted) {
+            auto const& edge = automaton_.edge(e);
+            if (!matches(edge.step, n)) return;
+            if (!edge.step.positions.empty() && !eval::matchesPosition(edge.step, counted ? ++counter(e) : 1)) return;
+            enter(edge.target);
+        }
+
+        /// Takes the following-sibling edges whose sources precede node `n` under the same parent
+        void followSiblings(NodeId n) {
+            const uint32_t first = frames_.back().sources_begin;
+            for (uint32_t i = first; i < sources_.size(); ++i) {
+                const Source& src = sources_[i];
+                auto const& edge = automaton_.edge(src.edge);
+                // Test and count each edge once per node, however many sources share it
+                if (sibling_stamp_[src.edge] != epoch_) {
+                    sibling_stamp_[src.edge] = epoch_;
+                    sibling_hit_[src.edge] = matches(edge.step, n);
+                    if (sibling_hit_[src.edge] && !edge.step.positions.empty()) ++counter(src.edge);
+                }
+                if (!sibling_hit_[src.edge]) continue;
+                if (edge.step.positions.empty() || eval::matchesPosition(edge.step, counter(src.edge) - src.base))
+                    enter(edge.target);
+            }
+            // Drop sources past their last acceptable position
+            sources_.erase(std::remove_if(sources_.begin() + first, sources_.end(), [&](const Source& src) {
+                return src.limit != UINT32_MAX && counter(src.edge) - src.base >= src.limit;
+            }), sources_.end());
+        }
+
+        /// Registers the current element as a following-sibling source of edge `e`
+        void addSource(uint32_t e) {
+            auto const& step = automaton_.edge(e).step;
+            const uint32_t base = step.positions.empty() ? 0 : counter(e);
+            for (uint32_t i = frames_.back().sources_begin; i < sources_.size(); ++i)
+                if (sources_[i].edge == e && (step.positions.empty() || sources_[i].base == base)) return;
+            if (sibling_stamp_.size() <= e) {
+                sibling_stamp_.resize(automaton_.edges(), 0);
+                sibling_hit_.resize(automaton_.edges(), false);
+            }
+            sources_.push_back({ e, base, positionLimit(step) });
+        }
+
+        /// Highest position a step's position conditions accept; UINT32_MAX if unbounded
+        static uint32_t positionLimit(const eval::Step& step) {
+            double limit = std::numeric_limits<double>::infinity();
+            for (size_t pc = 0; pc < step.positions.size(); pc += bc::length(step.positions[pc])) {
+                const auto op = static_cast<eval::Op>(bc::argument(step.positions[pc]));
+                if (op == eval::Op::Eq || op == eval::Op::Le || op == eval::Op::Lt)
+                    limit = std::min(limit, bc::number(&step.positions[pc + 1]));
+            }
+            return limit < 0 ? 0 : limit < UINT32_MAX ? static_cast<uint32_t>(limit) : UINT32_MAX;
+        }
+
+        /// Sibling count of edge `e` among the children of the innermost frame
+        uint32_t& counter(uint32_t e) {
+            auto it = std::find_if(counters_.begin() + frames_.back().counters_begin, counters_.end(),
+                [&](auto const& c) { return c.first == e; });
+            if (it == counters_.end()) { counters_.push_back({ e, 0 }); it = counters_.end() - 1; }
+            return it->second;
+        }
+
+        bool matches(const eval::Step& step, NodeId n) const {
+            switch (step.test) {
+            case eval::NodeTest::Name:    if (tag_ != step.tag) return false; break;
+            case eval::NodeTest::Element: if (n == WidgetTree::Document) return false; break;
+            case eval::NodeTest::Any:     break;
+            case eval::NodeTest::None:    return false;
+            }
+            return step.guard.empty() || eval::runGuard(Element{ *this }, step.guard);
+        }
+
+        void enter(uint32_t state) {
+            if (stamp_[state] == epoch_) return;
+            stamp_[state] = epoch_;
+            active_.push_back(state);
+        }
+
+        void addPending(uint32_t state) {
+            if (pending_stamp_[state] == epoch_) return;
+            pending_stamp_[state] = epoch_;
+            pending_.push_back(state);
+        }
+
+        void pop() {
+            const Frame& f = frames_.back();
+            active_.resize(f.active_begin);
+            pending_.resize(f.pending_begin);
+            counters_.resize(f.counters_begin);
+            sources_.resize(f.sources_begin);
+            frames_.pop_back();
+        }
+
+        MatchFn       on_match_;
+        StepAutomaton automaton_;
+        StringPool    pool_;  ///< Selector literals; event strings are only looked up
+        size_t        selectors_{ 0 };
+
+        // Element being streamed
+        bool                   started_{ false };
+        bool                   element_open_{ false };       ///< Opened, attributes may still arrive
+        bool                   attributes_allowed_{ false };
+        NodeId                 current_{ WidgetTree::Document };
+        NodeId                 next_{ WidgetTree::Document };
+        size_t                 skipped_{ 0 };                ///< Open elements inside a subtree nothing can match
+        StringId               tag_{ Unknown };
+        std::string            tag_name_;
+        std::vector<Attribute> attributes_;                  ///< Reused; the first attribute_count_ are current
+        size_t                 attribute_count_{ 0 };
+
+        // Automaton state per open element
+        std::vector<uint32_t>                      stamp_;         ///< Epoch per state, deduplicates an element's states
+        std::vector<uint32_t>                      pending_stamp_; ///< Same for its pending states
+        std::vector<uint32_t>                      sibling_stamp_; ///< Epoch per edge of its following-sibling tests
+        std::vector<bool>                          sibling_hit_;
+        uint32_t                                   epoch_{ 0 };
+        std::vector<Frame>                         frames_;
+        std::vector<uint32_t>                      active_;
+        std::vector<uint32_t>                      pending_;
+        std::vector<std::pair<uint32_t, uint32_t>> counters_; ///< (edge, count) per open frame
+        std::vector<Source>                        sources_;
+    };
+
+} // namespace hlat
@@ -0,0 +1,608 @@
+/*=============================================================================
+ |  Heuristic Layer Abstraction Transformer (HLAT) - Widget Tree Model
+ |  ---------------------------------------------------------------------------
+ |  Compact in-memory model of a Qt object tree for evaluating parsed selectors.
+ |  Features:
+ |      * One contiguous node array numbered in document order
+ |      * Parent / first-child / sibling links as 32-bit node indices
+ |      * Pre-order subtree intervals and per-tag sorted node lists
+ |      * Inverted (attribute, value) index of sorted node lists
+ |      * Interned tag, attribute name and attribute value strings
+ |      * Versioned binary image, used in place from a memory mapping
+ |      * Linear-time verification of images from untrusted storage
+ |      * Process-wide epochs identifying tree contents for caches
+ |  Contact: https://github.com/alexandertoepfer
+ *============================================================================*/
+
+#pragma once
+
+#include "hlat.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hlat {
+
+    /// Index of a node in a widget tree; node 0 is the document node
+    using NodeId = uint32_t;
+
+    /// Marks a missing link (no parent, child or sibling)
+    inline constexpr NodeId NoNode = UINT32_MAX;
+
+    /// Index of an interned string in a widget tree's string pool
+    using StringId = uint32_t;
+
+    /// Marks a string that is not in the pool
+    inline constexpr StringId NoString = UINT32_MAX;
+
+    // -----------------------------------------------------------------------------
+    // String Pool
+    // -----------------------------------------------------------------------------
+
+    namespace util {
+        /// 64-bit FNV-1a; stable across platforms and runs
+        constexpr uint64_t fnv1a(std::string_view s) {
+            uint64_t h = 0xcbf29ce484222325ULL;
+            for (char c : s) { h ^= static_cast<unsigned char>(c); h *= 0x100000001b3ULL; }
+            return h;
+        }
+    } // namespace util
+
+    /// Read-only view of interned strings: one character blob, offsets and a hash table
+    ///
+    /// `offsets` holds size()+1 entries; string i spans [offsets[i], offsets[i+1]).
+    /// `slots` is an open-addressing table (power-of-two size) of string IDs.
+    class StringTable {
+    public:
+        StringTable() = default;
+        StringTable(std::string_view blob, std::span<const uint32_t> offsets, std::span<const StringId> slots)
+            : blob_(blob), offsets_(offsets), slots_(slots) {}
+
+        /// Number of interned strings
+        size_t size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+
+        /// Returns the text of an interned string
+        std::string_view view(StringId id) const {
+            return blob_.substr(offsets_[id], offsets_[id + 1] - offsets_[id]);
+        }
+
+        /// Looks up a string; NoString if it was never interned. Expected O(|s|).
+        StringId find(std::string_view s) const {
+            if (slots_.empty()) return NoString;
+            const size_t mask = slots_.size() - 1;
+            for (size_t i = util::fnv1a(s) & mask; ; i = (i + 1) & mask) {
+                const StringId id = slots_[i];
+                if (id == NoString || view(id) == s) return id;
+            }
+        }
+
+        /// The underlying arrays, as written to a tree image
+        std::string_view          blob() const { return blob_; }
+        std::span<const uint32_t> offsets() const { return offsets_; }
+        std::span<const StringId> slots() const { return slots_; }
+
+    private:
+        std::string_view          blob_;
+        std::span<const uint32_t> offsets_;
+        std::span<const StringId> slots_;
+    };
+
+    /// Growable string interner backing a StringTable
+    class StringPool {
+    public:
+        StringPool() { offsets_.push_back(0); }
+
+        /// Starts as a copy of `strings`, keeping their IDs
+        explicit StringPool(const StringTable& strings)
+            : blob_(strings.blob()), offsets_(strings.offsets().begin(), strings.offsets().end()),
+              slots_(strings.slots().begin(), strings.slots().end()) {
+            if (offsets_.empty()) offsets_.push_back(0);
+        }
+
+        /// Returns the ID of `s`, adding it on first sight
+        StringId intern(std::string_view s) {
+            // One hash and one probe sequence: a miss ends on the slot the new ID takes
+            const uint64_t hash = util::fnv1a(s);
+            const size_t mask = slots_.size() - 1;
+            size_t i = hash & mask;
+            if (!slots_.empty()) {
+                const StringTable strings = table();
+                for (; slots_[i] != NoString; i = (i + 1) & mask)
+                    if (strings.view(slots_[i]) == s) return slots_[i];
+            }
+            if (blob_.size() + s.size() > UINT32_MAX)
+                throw std::runtime_error("String pool exceeds 4 GiB");
+            const auto id = static_cast<StringId>(offsets_.size() - 1);
+            blob_.append(s);
+            offsets_.push_back(static_cast<uint32_t>(blob_.size()));
+            if (2 * (id + 1) > slots_.size()) rehash(std::max<size_t>(16, 2 * slots_.size()));
+            else slots_[i] = id;
+            return id;
+        }
+
+        /// Read-only view; invalidated by the next intern()
+        StringTable table() const { return { blob_, offsets_, slots_ }; }
+
+        size_t size() const { return offsets_.size() - 1; }
+
+    private:
+        void place(StringId id) {
+            const size_t mask = slots_.size() - 1;
+            size_t i = util::fnv1a(table().view(id)) & mask;
+            while (slots_[i] != NoString) i = (i + 1) & mask;
+            slots_[i] = id;
+        }
+
+        void rehash(size_t slots) {
+            slots_.assign(slots, NoString);
+            for (StringId id = 0; id < size(); ++id) place(id);
+        }
+
+        std::string           blob_;
+        std::vector<uint32_t> offsets_;
+        std::vector<StringId> slots_;
+    };
+
+    // -----------------------------------------------------------------------------
+    // Widget Tree
+    // -----------------------------------------------------------------------------
+
+    /// One widget; links are node indices and names are string pool IDs
+    struct WidgetNode {
+        NodeId   parent;       ///< Enclosing node (NoNode for the document node)
+        NodeId   first_child;  ///< First child in document order
+        NodeId   next_sibling; ///< Following sibling
+        NodeId   prev_sibling; ///< Preceding sibling
+        StringId tag;          ///< Tag name (the empty string for the document node)
+        uint32_t attr_begin;   ///< First entry of this node in the attribute array
+        uint32_t attr_count;   ///< Number of attributes
+        NodeId   end;          ///< One past the last descendant: the subtree is [id, end)
+    };
+
+    /// One name/value property of a widget
+    struct WidgetAttribute {
+        StringId name;  ///< Attribute name
+        StringId value; ///< Attribute value
+    };
+
+    /// One key of the inverted attribute index and where its node list starts
+    struct AttributeRun {
+        StringId name;  ///< Attribute name
+        StringId value; ///< Attribute value
+        uint32_t begin; ///< First entry in the attribute node array; the next run's begin ends it
+    };
+
+    /// The flat arrays a WidgetTree views; built in memory or mapped from a snapshot
+    struct WidgetTreeArrays {
+        std::span<const WidgetNode>      nodes;
+        std::span<const WidgetAttribute> attributes;
+        StringTable                      strings;
+        std::span<const uint32_t>        tag_offsets;     ///< Per tag ID, start of its run in tag_nodes (+1 sentinel)
+        std::span<const NodeId>          tag_nodes;       ///< Node IDs grouped by tag, sorted within
+        std::span<const AttributeRun>    attribute_runs;  ///< Sorted by (name, value), plus a sentinel run
+        std::span<const NodeId>          attribute_nodes; ///< Node IDs grouped by run, sorted within
+    };
+
+    /// Immutable widget tree: flat node and attribute arrays plus their string pool
+    ///
+    /// Node IDs follow document order (pre-order), so sorting by ID sorts by document
+    /// position. Node 0 is the document node, the parent of the top-level widgets.
+    /// Each node's subtree is the ID interval [id, end), which carries the same information
+    /// as pre/post-order numbering: `a` is an ancestor of `d` iff a < d < end(a). Nodes are
+    /// also indexed by tag and by (attribute, value), each list sorted by ID. Copies share
+    /// the underlying storage.
+    class WidgetTree {
+    public:
+        /// The document node every absolute selector starts from
+        static constexpr NodeId Document = 0;
+
+        WidgetTree() = default;
+
+        /// Views arrays kept alive by `storage`
+        WidgetTree(std::shared_ptr<const void> storage, WidgetTreeArrays arrays)
+            : storage_(std::move(storage)), a_(arrays), epoch_(nextEpoch()) {}
+
+        /// Number of nodes, including the document node
+        size_t size() const { return a_.nodes.size(); }
+
+        std::span<const WidgetNode> nodes() const { return a_.nodes; }
+        const WidgetNode& node(NodeId id) const { return a_.nodes[id]; }
+
+        /// Attributes of one node
+        std::span<const WidgetAttribute> attributes(NodeId id) const {
+            return a_.attributes.subspan(a_.nodes[id].attr_begin, a_.nodes[id].attr_count);
+        }
+
+        /// Value ID of attribute `name` on node `id`, or NoString
+        StringId attribute(NodeId id, StringId name) const {
+            for (auto const& a : attributes(id))
+                if (a.name == name) return a.value;
+            return NoString;
+        }
+
+        /// Tag name of a node
+        std::string_view tagName(NodeId id) const { return a_.strings.view(a_.nodes[id].tag); }
+
+        /// True if `ancestor` is a proper ancestor of `id`; O(1) via the subtree interval
+        bool isAncestor(NodeId ancestor, NodeId id) const {
+            return ancestor < id && id < a_.nodes[ancestor].end;
+        }
+
+        /// All nodes with tag `tag`, in document order
+        std::span<const NodeId> tagged(StringId tag) const {
+            if (tag == NoString || tag + 1 >= a_.tag_offsets.size()) return {};
+            return a_.tag_nodes.subspan(a_.tag_offsets[tag], a_.tag_offsets[tag + 1] - a_.tag_offsets[tag]);
+        }
+
+        /// Nodes with tag `tag` inside the ID interval [first, last), in document order
+        std::span<const NodeId> tagged(StringId tag, NodeId first, NodeId last) const {
+            auto all = tagged(tag);
+            auto lo = std::lower_bound(all.begin(), all.end(), first);
+            auto hi = std::lower_bound(lo, all.end(), last);
+            return { lo, hi };
+        }
+
+        /// All nodes carrying attribute `name` with value `value`, in document order; O(log keys)
+        std::span<const NodeId> withAttribute(StringId name, StringId value) const {
+            if (a_.attribute_runs.empty()) return {};
+            auto keys = a_.attribute_runs.first(a_.attribute_runs.size() - 1);
+            auto it = std::lower_bound(keys.begin(), keys.end(), std::pair{ name, value },
+                [](AttributeRun const& r, std::pair<StringId, StringId> k) { return std::pair{ r.name, r.value } < k; });
+            if (it == keys.end() || it->name != name || it->value != value) return {};
+            return a_.attribute_nodes.subspan(it->begin, (it + 1)->begin - it->begin);
+        }
+
+        const StringTable& strings() const { return a_.strings; }
+
+        /// Version of the tree's contents, for caches of derived data
+        ///
+        /// Every built or viewed tree gets a larger epoch than all trees before it in this
+        /// process; copies keep theirs. A changed tree is a new tree, so its epoch advances.
+        uint64_t epoch() const { return epoch_; }
+
+        /// The underlying flat arrays
+        const WidgetTreeArrays& arrays() const { return a_; }
+
+        /// Bumped whenever the image layout or an array's element type changes
+        static constexpr uint32_t ImageVersion = 1;
+
+        /// Writes every array into one image that view() can use in place
+        ///
+        /// Layout: magic, version, a byte-order mark and the section count, then an
+        /// (offset, count) pair per array, then the arrays in native byte order, each
+        /// aligned to 8 bytes. Images are only portable between machines of the same
+        /// byte order; view() rejects the others.
+        std::string serialize() const {
+            const auto& strings = a_.strings;
+            const std::span<const std::byte> sections[] = {
+                std::as_bytes(a_.nodes), std::as_bytes(a_.attributes), std::as_bytes(std::span(strings.blob())),
+                std::as_bytes(strings.offsets()), std::as_bytes(strings.slots()), std::as_bytes(a_.tag_offsets),
+                std::as_bytes(a_.tag_nodes), std::as_bytes(a_.attribute_runs), std::as_bytes(a_.attribute_nodes)
+            };
+            const size_t counts[] = {
+                a_.nodes.size(), a_.attributes.size(), strings.blob().size(), strings.offsets().size(),
+                strings.slots().size(), a_.tag_offsets.size(), a_.tag_nodes.size(), a_.attribute_runs.size(),
+                a_.attribute_nodes.size()
+            };
+            Image header{};
+            std::memcpy(header.magic, ImageMagic, 4);
+            header.version = ImageVersion;
+            header.byte_order = ImageByteOrder;
+            header.section_count = ImageSections;
+            uint64_t at = sizeof(Image);
+            for (size_t i = 0; i < ImageSections; ++i) {
+                header.sections[i] = { at, counts[i] };
+                at = (at + sections[i].size() + 7) / 8 * 8;
+            }
+            std::string out(at, '\0');
+            std::memcpy(out.data(), &header, sizeof(Image));
+            for (size_t i = 0; i < ImageSections; ++i)
+                if (!sections[i].empty())
+                    std::memcpy(out.data() + header.sections[i].offset, sections[i].data(), sections[i].size());
+            return out;
+        }
+
+        /// Uses a serialized image in place, without copying or decoding it
+        ///
+        /// `owner` keeps the bytes alive (a mapped file, or the string holding them). The
+        /// header, section bounds and array sizes are checked in O(1); the array contents
+        /// are not, so call verify() before using an image that may be damaged. Throws on
+        /// malformed or foreign images.
+        static WidgetTree view(std::string_view image, std::shared_ptr<const void> owner) {
+            auto fail = [](const char* what) -> void { throw std::runtime_error(std::string("Malformed tree image: ") + what); };
+            if (image.size() < sizeof(Image)) fail("truncated");
+            if (reinterpret_cast<uintptr_t>(image.data()) % alignof(Image) != 0) fail("misaligned");
+            const auto& header = *reinterpret_cast<const Image*>(image.data());
+            if (std::memcmp(header.magic, ImageMagic, 4) != 0) fail("bad magic");
+            if (header.version != ImageVersion) fail("unsupported version");
+            if (header.byte_order != ImageByteOrder) fail("foreign byte order");
+            if (header.section_count != ImageSections) fail("bad section count");
+
+            auto section = [&]<typename T>(size_t i, std::type_identity<T>) {
+                const auto [offset, count] = header.sections[i];
+                if (offset % 8 != 0 || offset > image.size() || count > (image.size() - offset) / sizeof(T))
+                    fail("section out of bounds");
+                return std::span<const T>(reinterpret_cast<const T*>(image.data() + offset), count);
+            };
+            WidgetTreeArrays a;
+            a.nodes = section(0, std::type_identity<WidgetNode>{});
+            a.attributes = section(1, std::type_identity<WidgetAttribute>{});
+            const auto blob = section(2, std::type_identity<char>{});
+            const auto offsets = section(3, std::type_identity<uint32_t>{});
+            const auto slots = section(4, std::type_identity<StringId>{});
+            a.tag_offsets = section(5, std::type_identity<uint32_t>{});
+            a.tag_nodes = section(6, std::type_identity<NodeId>{});
+            a.attribute_runs = section(7, std::type_identity<AttributeRun>{});
+            a.attribute_nodes = section(8, std::type_identity<NodeId>{});
+
+            // The invariants every accessor relies on for its bounds
+            if (a.nodes.empty() || a.nodes[Document].end != a.nodes.size()) fail("bad node array");
+            if (offsets.empty() || offsets.front() != 0 || offsets.back() != blob.size()) fail("bad string offsets");
+            if (slots.size() < offsets.size() || !std::has_single_bit(slots.size())) fail("bad string table");
+            if (a.tag_offsets.size() != offsets.size() || a.tag_offsets.back() != a.tag_nodes.size()
+                || a.tag_nodes.size() != a.nodes.size() - 1) fail("bad tag index");
+            if (a.attribute_runs.empty() || a.attribute_runs.back().begin != a.attribute_nodes.size())
+                fail("bad attribute index");
+            a.strings = StringTable(std::string_view(blob.data(), blob.size()), offsets, slots);
+            return WidgetTree(std::move(owner), a);
+        }
+
+        /// Checks every array against the invariants the accessors and evaluators rely on;
+        /// returns a description of the first defect, or nullptr. O(nodes + attributes + strings).
+        ///
+        /// A tree that passes cannot make any accessor read out of bounds, and every link walk
+        /// terminates: children and following siblings have larger IDs, parents and preceding
+        /// siblings smaller ones.
+        const char* verify() const {
+            const auto& nodes = a_.nodes;
+            const auto offsets = a_.strings.offsets(), slots = a_.strings.slots();
+            if (nodes.empty() || nodes[Document].end != nodes.size()) return "bad node array";
+            if (offsets.empty() || offsets.front() != 0 || offsets.back() != a_.strings.blob().size())
+                return "bad string offsets";
+            const size_t strings = a_.strings.size(), n = nodes.size();
+            auto string = [&](StringId id) { return id < strings; };
+
+            // Strings: ordered offsets, and a hash table holding each ID exactly once, which
+            // leaves at least one empty slot to end every probe sequence
+            for (size_t i = 1; i < offsets.size(); ++i)
+                if (offsets[i] < offsets[i - 1]) return "bad string offsets";
+            if (slots.size() <= strings || !std::has_single_bit(slots.size())) return "bad string table";
+            std::vector<bool> placed(strings);
+            for (const StringId id : slots) {
+                if (id == NoString) continue;
+                if (!string(id) || placed[id]) return "bad string table";
+                placed[id] = true;
+            }
+            if (std::find(placed.begin(), placed.end(), false) != placed.end()) return "bad string table";
+
+            // Nodes: pre-order intervals nested in their parent's, and links that agree with them
+            const WidgetNode& document = nodes[Document];
+            if (document.parent != NoNode || document.next_sibling != NoNode || document.prev_sibling != NoNode
+                || document.first_child != (n > 1 ? 1 : NoNode)) return "bad node links";
+            for (size_t i = 0; i < n; ++i) {
+                const WidgetNode& node = nodes[i];
+                if (!string(node.tag) || node.attr_begin > a_.attributes.size()
+                    || node.attr_count > a_.attributes.size() - node.attr_begin) return "bad node";
+                if (node.end <= i || node.end > n) return "bad subtree interval";
+                const NodeId first = i + 1 < node.end ? static_cast<NodeId>(i + 1) : NoNode;
+                if (node.first_child != first || (first != NoNode && nodes[first].parent != i)) return "bad node links";
+                if (i == Document) continue;
+                if (node.parent >= i) return "bad node links";
+                const WidgetNode& parent = nodes[node.parent];
+                if (node.end > parent.end) return "bad subtree interval";
+                const NodeId next = node.end < parent.end ? node.end : NoNode;
+                if (node.next_sibling != next || (next != NoNode && nodes[next].parent != node.parent))
+                    return "bad node links";
+                if (node.prev_sibling == NoNode ? parent.first_child != i
+                    : node.prev_sibling >= i || nodes[node.prev_sibling].next_sibling != i) return "bad node links";
+            }
+            for (auto const& a : a_.attributes)
+                if (!string(a.name) || !string(a.value)) return "bad attribute";
+
+            // Tag index: one sorted run per tag, holding exactly the nodes with that tag
+            if (a_.tag_offsets.size() != offsets.size() || a_.tag_offsets.front() != 0
+                || a_.tag_offsets.back() != a_.tag_nodes.size() || a_.tag_nodes.size() != n - 1) return "bad tag index";
+            for (StringId tag = 0; tag < strings; ++tag) {
+                if (a_.tag_offsets[tag + 1] < a_.tag_offsets[tag]) return "bad tag index";
+                for (uint32_t k = a_.tag_offsets[tag]; k < a_.tag_offsets[tag + 1]; ++k) {
+                    const NodeId id = a_.tag_nodes[k];
+                    if (id == Document || id >= n || nodes[id].tag != tag
+                        || (k > a_.tag_offsets[tag] && id <= a_.tag_nodes[k - 1])) return "bad tag index";
+                }
+            }
+
+            // Attribute index: keys sorted, runs non-empty and in order, node lists sorted
+            const auto& runs = a_.attribute_runs;
+            if (runs.empty() || runs.front().begin != 0 || runs.back().begin != a_.attribute_nodes.size())
+                return "bad attribute index";
+            for (size_t r = 0; r + 1 < runs.size(); ++r) {
+                if (!string(runs[r].name) || !string(runs[r].value) || runs[r + 1].begin <= runs[r].begin
+                    || (r + 2 < runs.size() && std::pair{ runs[r].name, runs[r].value } >= std::pair{ runs[r + 1].name, runs[r + 1].value }))
+                    return "bad attribute index";
+                for (uint32_t k = runs[r].begin; k < runs[r + 1].begin; ++k) {
+                    const NodeId id = a_.attribute_nodes[k];
+                    if (id == Document || id >= n || (k > runs[r].begin && id <= a_.attribute_nodes[k - 1]))
+                        return "bad attribute index";
+                }
+            }
+            return nullptr;
+        }
+
+    private:
+        static constexpr char     ImageMagic[4] = { 'H', 'L', 'W', 'T' };
+        static constexpr uint32_t ImageByteOrder = 0x01020304;
+        static constexpr size_t   ImageSections = 9;
+
+        struct Image {
+            char     magic[4];
+            uint32_t version;
+            uint32_t byte_order;
+            uint32_t section_count;
+            struct {
+                uint64_t offset; ///< From the start of the image
+                uint64_t count;  ///< Elements, not bytes
+            } sections[ImageSections];
+        };
+
+        // Changing any of these changes the image layout: bump ImageVersion
+        static_assert(sizeof(WidgetNode) == 32 && sizeof(WidgetAttribute) == 8 && sizeof(AttributeRun) == 12);
+        static_assert(std::is_trivially_copyable_v<WidgetNode> && std::is_trivially_copyable_v<AttributeRun>);
+
+        static uint64_t nextEpoch() {
+            static std::atomic<uint64_t> last{ 0 };
+            return last.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        std::shared_ptr<const void> storage_;
+        WidgetTreeArrays            a_;
+        uint64_t                    epoch_{ 0 }; ///< 0 for the empty default tree
+    };
+
+    /// Builds a WidgetTree from start-element / attribute / end-element events
+    ///
+    /// Attributes belong to the most recently opened element and must precede its children.
+    class WidgetTreeBuilder {
+    public:
+        WidgetTreeBuilder() : storage_(std::make_shared<Storage>()) {
+            storage_->nodes.push_back({ NoNode, NoNode, NoNode, NoNode, intern(""), 0, 0, NoNode });
+            open_.push_back({ WidgetTree::Document, NoNode });
+        }
+
+        /// Starts with a copy of `strings` as the string pool, so their IDs can be passed to
+        /// the ID overloads of open() and attribute() and stay valid in the built tree. The
+        /// built tree keeps all of them, used or not.
+        explicit WidgetTreeBuilder(const StringTable& strings) : storage_(std::make_shared<Storage>()) {
+            storage_->strings = StringPool(strings);
+            storage_->nodes.push_back({ NoNode, NoNode, NoNode, NoNode, intern(""), 0, 0, NoNode });
+            open_.push_back({ WidgetTree::Document, NoNode });
+        }
+
+        /// Opens a child element of the current element
+        NodeId open(std::string_view tag) { return open(intern(tag)); }
+
+        /// Opens a child element whose tag is already in the pool
+        NodeId open(StringId tag) {
+            auto& nodes = storage_->nodes;
+            if (nodes.size() >= NoNode) throw std::runtime_error("Widget tree exceeds 2^32-1 nodes");
+            const auto id = static_cast<NodeId>(nodes.size());
+            auto& [parent, last] = open_.back();
+            nodes.push_back({ parent, NoNode, NoNode, last, tag,
+                static_cast<uint32_t>(storage_->attributes.size()), 0, NoNode });
+            if (last == NoNode) nodes[parent].first_child = id;
+            else nodes[last].next_sibling = id;
+            last = id;
+            open_.push_back({ id, NoNode });
+            return id;
+        }
+
+        /// Adds an attribute to the element opened last
+        void attribute(std::string_view name, std::string_view value) { attribute(intern(name), intern(value)); }
+
+        /// Adds an attribute whose name and value are already in the pool
+        void attribute(StringId name, StringId value) {
+            auto& nodes = storage_->nodes;
+            if (open_.size() < 2 || open_.back().node != nodes.size() - 1)
+                throw std::runtime_error("Attribute must directly follow its element's start");
+            storage_->attributes.push_back({ name, value });
+            ++nodes.back().attr_count;
+        }
+
+        /// Closes the current element
+        void close() {
+            if (open_.size() < 2) throw std::runtime_error("Unbalanced end of element");
+            storage_->nodes[open_.back().node].end = static_cast<NodeId>(storage_->nodes.size());
+            open_.pop_back();
+        }
+
+        /// Depth of the element currently open (0 at document level)
+        size_t depth() const { return open_.size() - 1; }
+
+        /// Finishes the tree; every element must have been closed
+        WidgetTree build() && {
+            if (open_.size() != 1)
+                throw std::runtime_error(std::to_string(open_.size() - 1) + " element(s) left open");
+            auto& s = *storage_;
+            s.nodes[WidgetTree::Document].end = static_cast<NodeId>(s.nodes.size());
+
+            // Counting sort by tag; scanning in ID order keeps every run sorted
+            s.tag_offsets.assign(s.strings.size() + 1, 0);
+            for (size_t i = 1; i < s.nodes.size(); ++i) ++s.tag_offsets[s.nodes[i].tag + 1];
+            std::partial_sum(s.tag_offsets.begin(), s.tag_offsets.end(), s.tag_offsets.begin());
+            s.tag_nodes.resize(s.nodes.size() - 1);
+            std::vector<uint32_t> fill(s.tag_offsets.begin(), s.tag_offsets.end() - 1);
+            for (size_t i = 1; i < s.nodes.size(); ++i) s.tag_nodes[fill[s.nodes[i].tag]++] = static_cast<NodeId>(i);
+
+            // Inverted attribute index: attributes are stored in node order, so two stable
+            // counting sorts (by value, then by name) leave (name, value, node) sorted in
+            // linear time; runs are cut at key changes and repeated attributes dropped
+            const size_t count = s.attributes.size();
+            std::vector<NodeId> owner(count);
+            for (size_t i = 1; i < s.nodes.size(); ++i)
+                std::fill_n(owner.begin() + s.nodes[i].attr_begin, s.nodes[i].attr_count, static_cast<NodeId>(i));
+            std::vector<uint32_t> by_value(count), order(count), offsets;
+            auto countingSort = [&](auto key, auto const& in, auto& out) {
+                offsets.assign(s.strings.size() + 1, 0);
+                for (size_t i = 0; i < count; ++i) ++offsets[key(in(i)) + 1];
+                std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+                for (size_t i = 0; i < count; ++i) out[offsets[key(in(i))]++] = in(i);
+            };
+            countingSort([&](uint32_t a) { return s.attributes[a].value; },
+                [](size_t i) { return static_cast<uint32_t>(i); }, by_value);
+            countingSort([&](uint32_t a) { return s.attributes[a].name; },
+                [&](size_t i) { return by_value[i]; }, order);
+
+            s.attribute_nodes.reserve(count);
+            const WidgetAttribute* previous = nullptr;
+            for (const uint32_t a : order) {
+                const WidgetAttribute& attribute = s.attributes[a];
+                const bool same_key = previous && previous->name == attribute.name && previous->value == attribute.value;
+                if (same_key && s.attribute_nodes.back() == owner[a]) continue;
+                if (!same_key) {
+                    s.attribute_runs.push_back({ attribute.name, attribute.value,
+                        static_cast<uint32_t>(s.attribute_nodes.size()) });
+                }
+                s.attribute_nodes.push_back(owner[a]);
+                previous = &attribute;
+            }
+            s.attribute_runs.push_back({ NoString, NoString, static_cast<uint32_t>(s.attribute_nodes.size()) });
+
+            return WidgetTree(std::move(storage_), {
+                s.nodes, s.attributes, s.strings.table(), s.tag_offsets, s.tag_nodes, s.attribute_runs, s.attribute_nodes });
+        }
+
+    private:
+        struct Storage {
+            std::vector<WidgetNode>      nodes;
+            std::vector<WidgetAttribute> attributes;
+            StringPool                   strings;
+            std::vector<uint32_t>        tag_offsets;
+            std::vector<NodeId>          tag_nodes;
+            std::vector<AttributeRun>    attribute_runs;
+            std::vector<NodeId>          attribute_nodes;
+        };
+
+        struct Open {
+            NodeId node; ///< Element being filled
+            NodeId last; ///< Its last child so far
+        };
+
+        StringId intern(std::string_view s) { return storage_->strings.intern(s); }
+
+        std::shared_ptr<Storage> storage_;
+        std::vector<Open>        open_;
+    };
+
+} // namespace hlat